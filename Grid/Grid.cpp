@@ -8,8 +8,12 @@
 #include "Eigen/SparseQR"
 #include "binaryIO.h"
 #include "VTKWriter.h"
-#include "openvdb_wrapper_t.h"
+#include "VTUWriter.h"
+#include "isosurface.h"
+#include "sparseVolume.h"
 #include "tictoc.h"
+#include "profiler.h"
+#include "memory_registry.h"
 #include <set>
 
 using namespace grid;
@@ -51,6 +55,7 @@ void HierarchyGrid::buildAABBTree(const std::vector<float>& pcoords, const std::
 
 
   // build cgal mesh
+  cmesh.clear();
   std::vector<CGMesh::Vertex_index>  vidlist;
   for (int i = 0; i < pcoords.size(); i += 3) {
     vidlist.emplace_back(cmesh.add_vertex(Point(pcoords[i], pcoords[i + 1], pcoords[i + 2])));
@@ -66,6 +71,23 @@ void HierarchyGrid::buildAABBTree(const std::vector<float>& pcoords, const std::
 }
 
 void HierarchyGrid::setSolidShellElement(const std::vector<unsigned int>& ebitfine, BitSAT<unsigned int>& esat, float box[2][3], int ereso, std::vector<int>& eflags) {
+  if (!_sdf.empty()) {
+    // solid elements whose center is within the shell width of the implicit surface
+    double eh = (box[1][0] - box[0][0]) / ereso;
+    double wshell = _setting.shell_width * eh;
+    printf("-- element size h = %lf (%d)\n", eh, ereso);
+    printf("-- shell width %lf \n", wshell);
+    for_each_set_bit(esat, ereso, [&](size_t bitid, int eid, const int* epos) {
+      double ec[3];
+      for (int k = 0; k < 3; k++) ec[k] = box[0][k] + (epos[k] + 0.5) * eh;
+      if (std::abs(_sdf.eval(ec)) < wshell) eflags[eid] |= int(Grid::Bitmask::mask_shellelement);
+    });
+    int n = 0;
+    for (int f : eflags) n += (f & Grid::Bitmask::mask_shellelement) != 0;
+    printf("-- found %d shell elements\n", n);
+    return;
+  }
+
   std::vector<CGMesh::Face_index> fidlist;
   for (auto iter = cmesh.faces_begin(); iter != cmesh.faces_end(); iter++) {
     fidlist.emplace_back(*iter);
@@ -139,7 +161,7 @@ void HierarchyGrid::setSolidShellElement(const std::vector<unsigned int>& ebitfi
 void HierarchyGrid::testShell(void) {
   _gridlayer[0]->init_rho(0);
   fillShell();
-  writeDensity(getPath("shell.vdb"));
+  writeDensity(getPath("shell.svb"));
 }
 
 std::string HierarchyGrid::getModeStr(Mode mode) {
@@ -162,12 +184,12 @@ std::string HierarchyGrid::getModeStr(Mode mode) {
 void grid::HierarchyGrid::log(int itn) {
   char fn[100];
   if (_logFlag & mask_log_density) {
-    sprintf_s(fn, "density%04d.vdb", itn);
+    sprintf_s(fn, "density%04d.svb", itn);
     printf("-- writing density to %s\n", fn);
     writeDensity(getPath(fn));
   }
   if (_logFlag & mask_log_compliance) {
-    sprintf_s(fn, "compliance%04d.vdb", itn);
+    sprintf_s(fn, "compliance%04d.svb", itn);
     printf("-- writing compliance to %s\n", fn);
     writeComplianceDistribution(getPath(fn));
   }
@@ -181,7 +203,12 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
   //_pcoords = pcoords;
   //_trifaces = facevertices;
 
-  buildAABBTree(pcoords, facevertices);
+  _sdf = sdf_t();
+
+  _regions.fixed.bindMesh(pcoords, facevertices);
+  _regions.load.bindMesh(pcoords, facevertices);
+
+  { _PROF("aabb_tree"); buildAABBTree(pcoords, facevertices); }
 
   //for (int i = 0; i < facevertices.size(); i++) std::cout << facevertices[i] << std::endl;
 
@@ -189,14 +216,111 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
   int out_reso[3];
   float out_box[2][3];
 
-  auto voxInfo = voxelize_mesh(pcoords, facevertices, _setting.prefer_reso, solid_bit, out_reso, out_box);
-  //write_obj_cubes(solid_bit.data(), voxInfo, "voxels.obj");
+  {
+    _PROF("voxelize");
+    auto voxInfo = voxelize_mesh(pcoords, facevertices, _setting.prefer_reso, solid_bit, out_reso, out_box);
+    //write_obj_cubes(solid_bit.data(), voxInfo, "voxels.obj");
 
-  // The bits in a word are listed starting from high order in voxelizer, so we reverse the bits in all words
-  wordReverse_g(solid_bit.size(), solid_bit.data());
+    // The bits in a word are listed starting from high order in voxelizer, so we reverse the bits in all words
+    wordReverse_g(solid_bit.size(), solid_bit.data());
+  }
 
   //writeGridVTK("grid.vtk", solid_bit, out_reso, out_box);
 
+  genFromLattice(solid_bit, out_reso, out_box);
+}
+
+void HierarchyGrid::genFromSDF(const sdf_t& sdf, const double* lo, const double* hi) {
+  _sdf = sdf;
+
+  double blo[3], bhi[3];
+  if (lo && hi) {
+    for (int k = 0; k < 3; k++) {
+      blo[k] = lo[k];
+      bhi[k] = hi[k];
+    }
+  } else if (!sdf.bounds(blo, bhi)) {
+    printf("\033[31m-- unbounded sdf, the lattice box must be given\033[0m\n");
+    exit(-1);
+  }
+
+  // same padding as voxelize_mesh : the smallest power of two above the preferred resolution,
+  // the box grows by the same factor around the shape
+  int reso = 1;
+  while (reso <= _setting.prefer_reso) reso <<= 1;
+  reso = std::max(reso, 8);
+  double maxlen = std::max(bhi[0] - blo[0], std::max(bhi[1] - blo[1], bhi[2] - blo[2]));
+  double padlen = maxlen * reso / _setting.prefer_reso;
+
+  int out_reso[3] = { reso, reso, reso };
+  float out_box[2][3];
+  for (int k = 0; k < 3; k++) {
+    double c = (blo[k] + bhi[k]) / 2;
+    out_box[0][k] = c - padlen / 2;
+    out_box[1][k] = c + padlen / 2;
+  }
+  printf("-- sdf lattice %d^3, box (%f, %f, %f)->(%f, %f, %f)\n", reso,
+    out_box[0][0], out_box[0][1], out_box[0][2], out_box[1][0], out_box[1][1], out_box[1][2]);
+
+  std::vector<unsigned int> solid_bit;
+  {
+    _PROF("sdf_lattice");
+    double eh = padlen / reso;
+    size_t nword = snippet::Round<BitCount<unsigned int>::value>(size_t(reso) * reso * reso) / BitCount<unsigned int>::value;
+    solid_bit.assign(nword, 0);
+
+    // blocks of B^3 elements are classified from their center sample when the surface is farther than the block
+    // half diagonal, only blocks crossing the surface are sampled per element
+    constexpr int B = 8;
+    int nb = (reso + B - 1) / B;
+    double rblock = std::sqrt(3.) * B * eh / 2;
+    #pragma omp parallel for schedule(dynamic, 1) collapse(2)
+    for (int bz = 0; bz < nb; bz++) {
+      for (int by = 0; by < nb; by++) {
+        double x[B], y[B], z[B], d[B];
+        for (int bx = 0; bx < nb; bx++) {
+          int e0[3] = { bx * B, by * B, bz * B };
+          int e1[3] = { std::min(e0[0] + B, reso), std::min(e0[1] + B, reso), std::min(e0[2] + B, reso) };
+          double c[3];
+          for (int k = 0; k < 3; k++) c[k] = out_box[0][k] + (e0[k] + e1[k]) * eh / 2;
+          double dc = sdf.eval(c);
+          if (dc > rblock) continue;
+          bool full = dc < -rblock;
+          int nx = e1[0] - e0[0];
+          for (int ez = e0[2]; ez < e1[2]; ez++) {
+            for (int ey = e0[1]; ey < e1[1]; ey++) {
+              unsigned int row = 0;
+              if (full) {
+                row = nx == 32 ? ~0u : (1u << nx) - 1;
+              } else {
+                for (int i = 0; i < nx; i++) {
+                  x[i] = out_box[0][0] + (e0[0] + i + 0.5) * eh;
+                  y[i] = out_box[0][1] + (ey + 0.5) * eh;
+                  z[i] = out_box[0][2] + (ez + 0.5) * eh;
+                }
+                sdf.evaluate(nx, x, y, z, d);
+                for (int i = 0; i < nx; i++) row |= unsigned(d[i] <= 0) << i;
+              }
+              if (row == 0) continue;
+              // B divides the word size, the row bits never straddle two words
+              size_t bitid = e0[0] + size_t(ey) * reso + size_t(ez) * reso * reso;
+              unsigned int bits = row << (bitid % BitCount<unsigned int>::value);
+              unsigned int& word = solid_bit[bitid / BitCount<unsigned int>::value];
+              #pragma omp atomic
+              word |= bits;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  genFromLattice(solid_bit, out_reso, out_box);
+}
+
+void HierarchyGrid::genFromLattice(std::vector<unsigned int>& solid_bit, int out_reso[3], float out_box[2][3]) {
+  tictoc::prof::scope lattice_scope("lattice");
+
   std::vector<unsigned int> inci_vbit;
 
   int nfineelements = out_reso[0] * out_reso[1] * out_reso[2];
@@ -247,6 +371,13 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
     vrtsatlist.emplace_back(std::move(coarse_vbit));
   }
 
+  lattice_scope.stop();
+
+  for (int i = 0; i < elesatlist.size(); i++) {
+    size_t nword = elesatlist[i]._bitArray.size() + elesatlist[i]._chunkSat.size() + vrtsatlist[i]._bitArray.size() + vrtsatlist[i]._chunkSat.size();
+    mem::track("[" + std::to_string(i) + "] lattice bits", mem::topology, mem::host, sizeof(unsigned int) * nword, i);
+  }
+
   printf("-- Building %d layers (%s)\n", elesatlist.size(), (_setting.skiplayer1 ? "Non-dyadic" : "Dyadic"));
 
   std::vector<std::vector<int>> v2ehost[8];
@@ -263,6 +394,7 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
 
   // generate topology between elements and vertices
   for (int i = 0; i < elesatlist.size(); i++) {
+    _PROF_ARG("topology", i);
     std::vector<unsigned int>& ebit = elesatlist[i]._bitArray;
     std::vector<unsigned int>& vbit = vrtsatlist[i]._bitArray;
     int elementreso = resolist[i];
@@ -291,6 +423,10 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
     vbitflaglist.emplace_back(nSolidVertex, 0);
     ebitflaglist.emplace_back(nSolidElement, 0);
 
+    // v2e, v2vcoarse, v2vfine, v2v and flags, held until the grids are uploaded
+    mem::track("[" + std::to_string(i) + "] host topology", mem::topology, mem::host,
+      sizeof(int) * (size_t(nSolidVertex) * (8 + 8 + 27 + 27 + 1) + nSolidElement), i);
+
     // compute flags
     std::vector<int>& vbitflag = *vbitflaglist.rbegin();
     std::vector<int>& ebitflag = *ebitflaglist.rbegin();
@@ -369,6 +505,7 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
         v2vfinec[j].resize(vsatcoarse.total());
         v2vfineclist[j] = v2vfinec[j].data();
       }
+      mem::track("[2] host v2vfinecenter", mem::topology, mem::host, sizeof(int) * 64 * vsatcoarse.total(), i);
       Grid::setV2VFineC_g(vresocoarse, vsatfine, vsatcoarse, v2vfineclist);
     }
 
@@ -376,11 +513,12 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
   } // finished all layers
 
   // find shell elements
-  setSolidShellElement(elesatlist[0]._bitArray, elesatlist[0], out_box, resolist[0], ebitflaglist[0]);
+  { _PROF("shell"); setSolidShellElement(elesatlist[0]._bitArray, elesatlist[0], out_box, resolist[0], ebitflaglist[0]); }
 
 
   // upload grid to device
   for (int i = 0; i < elesatlist.size(); i++) {
+    _PROF_ARG("upload", i);
     auto grd = new Grid();
 
     if (_setting.skiplayer1&&i == 1) {
@@ -437,6 +575,8 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
     grd->_inFixedArea = _inFixedArea;
     grd->_inLoadArea = _inLoadArea;
     grd->_loadField = _loadField;
+    grd->_regions = _regions;
+    grd->_sdf = _sdf.empty() ? nullptr : &_sdf;
 
     for (int i = 0; i < 6; i++) {
       (&grd->_box[0][0])[i] = (&out_box[0][0])[i];
@@ -449,6 +589,8 @@ void grid::HierarchyGrid::genFromMesh(const std::vector<float>& pcoords, const s
     _gridlayer.emplace_back(grd);
   }
 
+  for (int i = 0; i < elesatlist.size(); i++) mem::release("[" + std::to_string(i) + "] host topology");
+  mem::release("[2] host v2vfinecenter");
 }
 
 void HierarchyGrid::writeSupportForce(const std::string& filename) {
@@ -464,41 +606,15 @@ void HierarchyGrid::writeSupportForce(const std::string& filename) {
 }
 
 void HierarchyGrid::writeDensity(const std::string& filename) {
-  printf("-- writing vdb to %s\n", filename.c_str());
+  _PROF("write_density");
+  printf("-- writing density to %s\n", filename.c_str());
 
   std::vector<int> eidmaphost(_gridlayer[0]->n_elements);
   gpu_manager_t::download_buf(eidmaphost.data(), _gridlayer[0]->_gbuf.eidmap, sizeof(int) * _gridlayer[0]->n_elements);
   std::vector<float> rhohost(_gridlayer[0]->n_gselements);
   gpu_manager_t::download_buf(rhohost.data(), _gridlayer[0]->_gbuf.rho_e, sizeof(float) * _gridlayer[0]->n_gselements);
 
-  std::vector<int> epos[3];
-  for (int i = 0; i < 3; i++) epos[i].resize(_gridlayer[0]->n_elements);
-
-  std::vector<float> evalue;
-  evalue.resize(_gridlayer[0]->n_elements);
-
-  int reso = _gridlayer[0]->_ereso;
-
-  auto& esat = elesatlist[0];
-
-  for (int i = 0; i < esat._bitArray.size(); i++) {
-    int eword = esat._bitArray[i];
-    int eidbase = esat._chunkSat[i];
-
-    int eidoffset = 0;
-    for (int ji = 0; ji < BitCount<unsigned int>::value; ji++) {
-      if (!read_bit(eword, ji)) continue;
-      int bitid = i * BitCount<unsigned int>::value + ji;
-      int bitpos[3] = { bitid % reso, bitid / reso % reso, bitid / reso / reso };
-      int eid = eidoffset + eidbase;
-      int rhoid = eidmaphost[eid];
-      for (int k = 0; k < 3; k++) epos[k][eid] = bitpos[k];
-      evalue[eid] = rhohost[rhoid];
-      eidoffset++;
-    }
-  }
-
-  openvdb_wrapper_t<float>::grid2openVDBfile(filename, epos, evalue);
+  writeSparseVolume(filename, elesatlist[0], _gridlayer[0]->_ereso, _gridlayer[0]->_box, eidmaphost, rhohost);
 }
 
 void grid::HierarchyGrid::writeSurfaceElement(const std::string& filename) {
@@ -520,24 +636,22 @@ void grid::HierarchyGrid::writeSurfaceElement(const std::string& filename) {
   float boxOrigin[3] = { _gridlayer[0]->_box[0][0],_gridlayer[0]->_box[0][1],_gridlayer[0]->_box[0][2] };
 
   int ereso = _gridlayer[0]->_ereso;
-
-  for (int i = 0; i < esat._bitArray.size(); i++) {
-    if (esat._bitArray[i] == 0) continue;
-    int eid = esat._chunkSat[i];
-    int bitword = esat._bitArray[i];
-    for (int ji = 0; ji < BitCount<unsigned int>::value; ji++) {
-      int ebitid = i * BitCount<unsigned int>::value + ji;
-      int epos[3] = { ebitid % ereso, ebitid / ereso % ereso, ebitid / ereso / ereso };
-      if (!read_bit(bitword, ji))  continue;
-      int egsid = eidmap[eid];
-      if (egsid == -1) printf("-- error on eidmap\n");
-      int efw = eflags[egsid];
-      if (efw & Grid::Bitmask::mask_surfaceelements) {
-        for (int k = 0; k < 3; k++)  surfpos[k].emplace_back(epos[k] * eh + boxOrigin[k]);
-      }
-      eid++;
-    }
-  }
+  int ne = _gridlayer[0]->n_elements;
+
+  // rank -> slot among surface elements
+  std::vector<int> surfid(ne + 1, 0);
+  for_each_set_bit(esat, ereso, [&](size_t bitid, int eid, const int* epos) {
+    int egsid = eidmap[eid];
+    if (egsid == -1) printf("-- error on eidmap\n");
+    surfid[eid + 1] = (eflags[egsid] & Grid::Bitmask::mask_surfaceelements) != 0;
+  });
+  for (int i = 0; i < ne; i++) surfid[i + 1] += surfid[i];
+
+  for (int k = 0; k < 3; k++) surfpos[k].resize(surfid[ne]);
+  for_each_set_bit(esat, ereso, [&](size_t bitid, int eid, const int* epos) {
+    if (surfid[eid + 1] == surfid[eid]) return;
+    for (int k = 0; k < 3; k++) surfpos[k][surfid[eid]] = epos[k] * eh + boxOrigin[k];
+  });
 
   printf("-- writing surface element pos to file %s\n", filename.c_str());
   bio::write_vectors(filename, surfpos);
@@ -548,27 +662,9 @@ void grid::HierarchyGrid::readDensity(const std::string& filename) {
   gpu_manager_t::download_buf(eidmaphost.data(), _gridlayer[0]->_gbuf.eidmap, sizeof(int) * _gridlayer[0]->n_elements);
   std::vector<float> rhohost(_gridlayer[0]->n_gselements, 0);
 
-  std::vector<int> epos[3];
-  for (int i = 0; i < 3; i++) epos[i].resize(_gridlayer[0]->n_elements);
-  std::vector<float> evalue;
-  openvdb_wrapper_t<float>::openVDBfile2grid(filename, epos, evalue);
-
-  int ereso = _gridlayer[0]->_ereso;
-  auto& esat = elesatlist[0];
-
-  for (int i = 0; i < epos->size(); i++) {
-    if (epos[0][i] >= ereso || epos[1][i] >= ereso || epos[2][i] >= ereso) {
-      printf("\033[31m-- unmatched grid and file \033[0m\n");
-      exit(-1);
-    }
-    int ebid = epos[0][i] + epos[1][i] * ereso + epos[2][i] * ereso * ereso;
-    int eid = esat(ebid);
-    if (eid == -1 || eid >= eidmaphost.size()) {
-      printf("\033[31m-- unmatched grid and file\033[0m\n");
-      exit(-1);
-    }
-    int egsid = eidmaphost[eid];
-    rhohost[egsid] = evalue[i];
+  if (!readSparseVolume(filename, elesatlist[0], _gridlayer[0]->_ereso, eidmaphost, rhohost)) {
+    printf("\033[31m-- unmatched grid and file \033[0m\n");
+    exit(-1);
   }
 
   gpu_manager_t::upload_buf(_gridlayer[0]->_gbuf.rho_e, rhohost.data(), sizeof(float) * _gridlayer[0]->n_gselements);
@@ -580,35 +676,7 @@ void grid::HierarchyGrid::writeSensitivity(const std::string& filename) {
   std::vector<float> senshost(_gridlayer[0]->n_gselements);
   gpu_manager_t::download_buf(senshost.data(), _gridlayer[0]->_gbuf.g_sens, sizeof(float) * _gridlayer[0]->n_gselements);
 
-  std::vector<int> epos[3];
-  for (int i = 0; i < 3; i++) epos[i].resize(_gridlayer[0]->n_elements);
-
-  std::vector<float> evalue;
-  evalue.resize(_gridlayer[0]->n_elements);
-
-  int reso = _gridlayer[0]->_ereso;
-
-  auto& esat = elesatlist[0];
-
-  for (int i = 0; i < esat._bitArray.size(); i++) {
-    int eword = esat._bitArray[i];
-    int eidbase = esat._chunkSat[i];
-
-    int eidoffset = 0;
-    for (int ji = 0; ji < BitCount<unsigned int>::value; ji++) {
-      if (!read_bit(eword, ji)) continue;
-      int bitid = i * BitCount<unsigned int>::value + ji;
-      int bitpos[3] = { bitid % reso, bitid / reso % reso, bitid / reso / reso };
-      int eid = eidoffset + eidbase;
-      int rhoid = eidmaphost[eid];
-      for (int k = 0; k < 3; k++) epos[k][eid] = bitpos[k];
-      evalue[eid] = senshost[rhoid];
-      eidoffset++;
-    }
-  }
-
-  openvdb_wrapper_t<float>::grid2openVDBfile(filename, epos, evalue);
-
+  writeSparseVolume(filename, elesatlist[0], _gridlayer[0]->_ereso, _gridlayer[0]->_box, eidmaphost, senshost);
 }
 
 void grid::HierarchyGrid::writeComplianceDistribution(const std::string& filename) {
@@ -630,6 +698,202 @@ void grid::HierarchyGrid::writeDisplacement(const std::string& filename) {
   bio::write_vectors(filename, u);
 }
 
+void HierarchyGrid::writeVTU(const std::string& filename, bool compress) {
+  _PROF("write_vtu");
+  printf("-- writing vtu to %s\n", filename.c_str());
+
+  Grid& g = *_gridlayer[0];
+  auto& esat = elesatlist[0];
+  auto& vsat = vrtsatlist[0];
+  int ereso = g._ereso;
+  int vreso = ereso + 1;
+  double eh = elementLength();
+  size_t nv = g.n_vertices, ne = g.n_elements;
+
+  std::vector<int> eidmaphost(ne), vidmaphost(nv);
+  gpu_manager_t::download_buf(eidmaphost.data(), g._gbuf.eidmap, sizeof(int) * ne);
+  gpu_manager_t::download_buf(vidmaphost.data(), g._gbuf.vidmap, sizeof(int) * nv);
+
+  VTUWriter vtu(filename, nv, ne, compress);
+
+  // the arrays are streamed in rank order, so the lattices are walked serially
+  vtu.beginArray(VTUWriter::POINTS, "Points", "Float32", 3, sizeof(float) * 3 * nv);
+  for_each_set_bit(vsat, vreso, [&](size_t bitid, int vid, const int* vpos) {
+    for (int k = 0; k < 3; k++) vtu.append(float(g._box[0][k] + vpos[k] * eh));
+  }, false);
+
+  // VTK_VOXEL, corner k at offset (k & 1, k >> 1 & 1, k >> 2)
+  vtu.beginArray(VTUWriter::CELLS, "connectivity", "Int32", 1, sizeof(int) * 8 * ne);
+  for_each_set_bit(esat, ereso, [&](size_t bitid, int eid, const int* epos) {
+    for (int k = 0; k < 8; k++) {
+      size_t vbit = (epos[0] + (k & 1)) + (epos[1] + (k >> 1 & 1)) * size_t(vreso) + (epos[2] + (k >> 2)) * size_t(vreso) * vreso;
+      vtu.append(int(vsat[vbit]));
+    }
+  }, false);
+
+  vtu.beginArray(VTUWriter::CELLS, "offsets", "Int64", 1, sizeof(long long) * ne);
+  for (size_t i = 0; i < ne; i++) vtu.append((long long)(8 * (i + 1)));
+
+  vtu.beginArray(VTUWriter::CELLS, "types", "UInt8", 1, ne);
+  for (size_t i = 0; i < ne; i++) vtu.append((unsigned char)11);
+
+  // element fields, one gs ordered buffer at a time
+  std::vector<float> ehost(g.n_gselements);
+  const char* enames[2] = { "density", "sensitivity" };
+  float* ebufs[2] = { g._gbuf.rho_e, g._gbuf.g_sens };
+  for (int n = 0; n < 2; n++) {
+    gpu_manager_t::download_buf(ehost.data(), ebufs[n], sizeof(float) * g.n_gselements);
+    vtu.beginArray(VTUWriter::CELL_DATA, enames[n], "Float32", 1, sizeof(float) * ne);
+    for (size_t i = 0; i < ne; i++) vtu.append(ehost[eidmaphost[i]]);
+  }
+  ehost.clear(); ehost.shrink_to_fit();
+
+  // vertex fields
+  std::vector<double> vhost[3];
+  const char* vnames[2] = { "displacement", "force" };
+  double** vbufs[2] = { g._gbuf.U, g._gbuf.F };
+  for (int n = 0; n < 2; n++) {
+    for (int k = 0; k < 3; k++) {
+      vhost[k].resize(g.n_gsvertices);
+      gpu_manager_t::download_buf(vhost[k].data(), vbufs[n][k], sizeof(double) * g.n_gsvertices);
+    }
+    vtu.beginArray(VTUWriter::POINT_DATA, vnames[n], "Float32", 3, sizeof(float) * 3 * nv);
+    for (size_t i = 0; i < nv; i++) {
+      int gsid = vidmaphost[i];
+      for (int k = 0; k < 3; k++) vtu.append(float(vhost[k][gsid]));
+    }
+    if (n == 0) {
+      vtu.beginArray(VTUWriter::POINT_DATA, "displacement_norm", "Float32", 1, sizeof(float) * nv);
+      for (size_t i = 0; i < nv; i++) {
+        int gsid = vidmaphost[i];
+        vtu.append(float(std::sqrt(vhost[0][gsid] * vhost[0][gsid] + vhost[1][gsid] * vhost[1][gsid] + vhost[2][gsid] * vhost[2][gsid])));
+      }
+    }
+  }
+
+  vtu.close();
+  if (!vtu.good()) printf("\033[31m-- failed to write vtu %s\033[0m\n", filename.c_str());
+}
+
+density_field_t HierarchyGrid::getDensityField(void) {
+  Grid& g = *_gridlayer[0];
+  density_field_t field(elesatlist[0]);
+  field.ereso = g._ereso;
+  for (int i = 0; i < 6; i++) (&field.box[0][0])[i] = (&g._box[0][0])[i];
+
+  std::vector<int> eidmaphost(g.n_elements);
+  gpu_manager_t::download_buf(eidmaphost.data(), g._gbuf.eidmap, sizeof(int) * g.n_elements);
+  std::vector<float> rhohost(g.n_gselements);
+  gpu_manager_t::download_buf(rhohost.data(), g._gbuf.rho_e, sizeof(float) * g.n_gselements);
+
+  field.rho.resize(g.n_elements);
+  for (int i = 0; i < g.n_elements; i++) field.rho[i] = rhohost[eidmaphost[i]];
+
+  return field;
+}
+
+void HierarchyGrid::writeSurface(const std::string& filename, float isovalue) {
+  _PROF("write_surface");
+  printf("-- writing surface to %s\n", filename.c_str());
+  surface_mesh_t mesh;
+  extractIsoSurface(getDensityField(), isovalue, mesh);
+  bool isply = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".ply") == 0;
+  if (isply) writePLY(filename, mesh);
+  else writeSTL(filename, mesh);
+}
+
+void HierarchyGrid::prolongateDensity(const density_field_t& field) {
+  Grid& g = *_gridlayer[0];
+  std::vector<int> eidmaphost(g.n_elements);
+  gpu_manager_t::download_buf(eidmaphost.data(), g._gbuf.eidmap, sizeof(int) * g.n_elements);
+  std::vector<float> rhohost(g.n_gselements, 0);
+
+  int reso = g._ereso;
+  double eh = g.elementLength();
+  int creso = field.ereso;
+  double ceh = (field.box[1][0] - field.box[0][0]) / creso;
+
+  // fallback value for elements not covered by any source element
+  double rhomean = 0;
+  for (int i = 0; i < field.rho.size(); i++) rhomean += field.rho[i];
+  rhomean /= (std::max)(size_t(1), field.rho.size());
+
+  auto& esat = elesatlist[0];
+
+  printf("-- prolongating density %d -> %d\n", creso, reso);
+
+  for_each_set_bit(esat, reso, [&](size_t bitid, int eid, const int* epos) {
+    // element center in the lattice of source element centers
+    double q[3], t[3];
+    int q0[3], qnear[3];
+    for (int k = 0; k < 3; k++) {
+      double p = g._box[0][k] + (epos[k] + 0.5) * eh;
+      q[k] = (p - field.box[0][k]) / ceh - 0.5;
+      q0[k] = std::floor(q[k]);
+      t[k] = q[k] - q0[k];
+      qnear[k] = std::clamp(int(std::floor(q[k] + 0.5)), 0, creso - 1);
+    }
+
+    // weights of inactive source elements are dropped and the rest renormalized
+    double wsum = 0, rsum = 0;
+    for (int c = 0; c < 8; c++) {
+      int cpos[3] = { q0[0] + c % 2, q0[1] + c / 2 % 2, q0[2] + c / 4 };
+      if (cpos[0] < 0 || cpos[1] < 0 || cpos[2] < 0 || cpos[0] >= creso || cpos[1] >= creso || cpos[2] >= creso) continue;
+      int cid = field.esat(cpos[0] + cpos[1] * creso + cpos[2] * creso * creso);
+      if (cid == -1) continue;
+      double w = (c % 2 ? t[0] : 1 - t[0]) * (c / 2 % 2 ? t[1] : 1 - t[1]) * (c / 4 ? t[2] : 1 - t[2]);
+      wsum += w;
+      rsum += w * field.rho[cid];
+    }
+
+    float rho;
+    if (wsum > 0) {
+      rho = rsum / wsum;
+    } else {
+      int cid = field.esat(qnear[0] + qnear[1] * creso + qnear[2] * creso * creso);
+      rho = cid == -1 ? rhomean : field.rho[cid];
+    }
+
+    rhohost[eidmaphost[eid]] = rho;
+  });
+
+  gpu_manager_t::upload_buf(g._gbuf.rho_e, rhohost.data(), sizeof(float) * g.n_gselements);
+}
+
+void HierarchyGrid::clear(void) {
+  for (int i = 0; i < _gridlayer.size(); i++) {
+    mem::release(_gridlayer[i]->_name + " host v2v");
+    delete _gridlayer[i];
+  }
+  for (int i = 0; i < elesatlist.size(); i++) mem::release("[" + std::to_string(i) + "] lattice bits");
+  _gridlayer.clear();
+  _pre_sweeps.clear();
+  _post_sweeps.clear();
+  elesatlist.clear();
+  vrtsatlist.clear();
+  _nlayer = 0;
+  get_gmem().clear();
+  // the next lattice predicts the resolution from its own peak
+  mem::reset_peak();
+}
+
+void HierarchyGrid::adoptLayers(const std::vector<Grid*>& layers, bool skiplayer) {
+  _setting.skiplayer1 = skiplayer;
+  _gridlayer = layers;
+  _nlayer = layers.size();
+
+  // same links as genFromMesh, the dummy layer 1 is skipped by layer 2
+  for (int i = 1; i < _gridlayer.size(); i++) {
+    Grid* finer = skiplayer && i == 2 ? _gridlayer[0] : _gridlayer[i - 1];
+    _gridlayer[i]->fineGrid = finer;
+    finer->coarseGrid = _gridlayer[i];
+  }
+
+  Grid* coarsest = *_gridlayer.rbegin();
+  coarsest->getV2V();
+  coarsest->buildCoarsestSystem();
+}
+
 void HierarchyGrid::resetAllResidual(void) {
   for (int i = 0; i < _gridlayer.size(); i++) {
     if (_gridlayer[i]->is_dummy()) continue;
@@ -792,29 +1056,46 @@ double HierarchyGrid::elementLength(void) {
   return _gridlayer[0]->elementLength();
 }
 
+// residual norm of the current displacement of a layer, only used by the telemetry
+static double layer_residual(Grid* g) {
+  g->update_residual();
+  return g->residual();
+}
+
 double HierarchyGrid::v_cycle(int pre_relax, int post_relax) {
+  _PROF("v_cycle");
   int depth = n_grid() - 1;
+  mg_cycle_sample_t* tel = _telemetry.enabled() ? &_telemetry.begin_cycle(n_grid(), pre_relax, post_relax) : nullptr;
   // downside
   for (int i = 0; i < depth + 1; i++) {
     if (_gridlayer[i]->is_dummy()) {
       continue;
     }
+    _PROF_ARG("layer", i);
     if (i > 0) {
       //_gridlayer[i]->stencil2matlab("rxcoarse");
-      _gridlayer[i]->fineGrid->update_residual();
+      { _PROF("update_residual"); _gridlayer[i]->fineGrid->update_residual(); }
       //_gridlayer[i]->fineGrid->residual2matlab("rfine");
-      _gridlayer[i]->restrict_residual();
+      { _PROF("restrict"); _gridlayer[i]->restrict_residual(); }
       //_gridlayer[i]->force2matlab("fcoarse");
       _gridlayer[i]->reset_displacement();
     }
+    if (tel) {
+      tel->levels[i].force = _gridlayer[i]->v3norm(_gridlayer[i]->getForce());
+      tel->levels[i].before_smooth = layer_residual(_gridlayer[i]);
+      if (i == 0) tel->r_before = tel->levels[0].before_smooth / tel->levels[0].force;
+    }
     if (i < n_grid() - 1) {
-      _gridlayer[i]->gs_relax(pre_relax);
+      _PROF("pre_relax");
+      _gridlayer[i]->gs_relax(pre_relax >= 0 ? pre_relax : pre_sweeps(i));
       //_gridlayer[i]->displacement2matlab("u");
     } else {
+      _PROF("solve_host");
       //_gridlayer[i]->force2matlab("f");
       _gridlayer[i]->solve_fem_host();
       //_gridlayer[i]->displacement2matlab("u");
     }
+    if (tel) tel->levels[i].after_smooth = layer_residual(_gridlayer[i]);
   }
   // DEBUG
   //_gridlayer[0]->displacement2matlab("u");
@@ -823,22 +1104,31 @@ double HierarchyGrid::v_cycle(int pre_relax, int post_relax) {
     if (_gridlayer[i]->is_dummy()) {
       continue;
     }
+    _PROF_ARG("layer", i);
     //_gridlayer[i]->displacement2matlab("u");
     //_gridlayer[i]->update_residual();
     //printf("-- [%d] r = %lf%%\n", i, _gridlayer[i]->relative_residual() * 100);
-    _gridlayer[i]->prolongate_correction();
+    { _PROF("prolongate"); _gridlayer[i]->prolongate_correction(); }
     //_gridlayer[i]->update_residual();
     //printf("-- [%d] rc=  %lf%%\n", i, _gridlayer[i]->relative_residual() * 100);
     //_gridlayer[i]->displacement2matlab("uc");
     //_gridlayer[i]->force2matlab("fc");
-    _gridlayer[i]->gs_relax(post_relax);
+    if (tel) tel->levels[i].after_correction = layer_residual(_gridlayer[i]);
+    { _PROF("post_relax"); _gridlayer[i]->gs_relax(post_relax >= 0 ? post_relax : post_sweeps(i)); }
+    if (tel) tel->levels[i].after_post = layer_residual(_gridlayer[i]);
     //_gridlayer[i]->update_residual();
     //printf("-- [%d] rr=  %lf%%\n", i, _gridlayer[i]->relative_residual() * 100);
     //_gridlayer[i]->displacement2matlab("ur");
   }
 
+  _PROF("residual");
   _gridlayer[0]->update_residual();
-  return _gridlayer[0]->relative_residual();
+  double rel_res = _gridlayer[0]->relative_residual();
+  if (tel) {
+    tel->r_after = rel_res;
+    if (tel->r_before > 0) tel->factor = rel_res / tel->r_before;
+  }
+  return rel_res;
 }
 
 double grid::HierarchyGrid::v_halfcycle(int depth, int pre_relax /*= 1*/, int post_relax /*= 1*/) {
@@ -874,6 +1164,87 @@ double grid::HierarchyGrid::v_halfcycle(int depth, int pre_relax /*= 1*/, int po
 
 }
 
+double HierarchyGrid::calibrate_factor(int n_calib, double* cycle_ms) {
+  _gridlayer[0]->reset_displacement();
+  // the first cycle removes the smooth start, the factor is the mean reduction of the following ones
+  double r0 = v_cycle();
+  gpu_manager_t::synchronize();
+  auto t0 = tictoc::getTag();
+  double r = r0;
+  for (int k = 0; k < n_calib; k++) r = v_cycle();
+  gpu_manager_t::synchronize();
+  auto t1 = tictoc::getTag();
+  if (cycle_ms) *cycle_ms = tictoc::Duration<tictoc::ms>(t0, t1) / n_calib;
+  if (!(r0 > 0) || !(r == r)) return 1;
+  return std::pow(std::max(r, 1e-300) / r0, 1.0 / n_calib);
+}
+
+double HierarchyGrid::tune_sweeps(int max_sweeps, int n_calib) {
+  _PROF("tune_sweeps");
+  int nlayer = n_grid();
+  Grid* g0 = _gridlayer[0];
+  auto ubackup = g0->v3_backup(g0->getDisplacement());
+  _telemetry.pause(true);
+
+  // time of one sweep of every smoothed layer
+  std::vector<double> sweep_ms(nlayer, 0);
+  for (int i = 0; i < nlayer - 1; i++) {
+    if (_gridlayer[i]->is_dummy()) continue;
+    _gridlayer[i]->gs_relax(1);
+    auto t0 = tictoc::getTag();
+    _gridlayer[i]->gs_relax(n_calib);
+    auto t1 = tictoc::getTag();
+    sweep_ms[i] = tictoc::Duration<tictoc::ms>(t0, t1) / n_calib;
+  }
+
+  // the cycle time of other schedules is predicted from the 1 / 1 cycle and the sweep times, convergence is measured
+  _pre_sweeps.assign(nlayer, 1);
+  _post_sweeps.assign(nlayer, 1);
+  double base_ms = 0;
+  double best_factor = calibrate_factor(n_calib, &base_ms);
+  auto cycle_time = [&]() {
+    double t = base_ms;
+    for (int i = 0; i < nlayer; i++) t += (_pre_sweeps[i] + _post_sweeps[i] - 2) * sweep_ms[i];
+    return t;
+  };
+  auto cost = [&](double factor) {
+    return factor < 1 ? cycle_time() / -std::log(std::max(factor, 1e-12)) : std::numeric_limits<double>::infinity();
+  };
+  double best_cost = cost(best_factor);
+
+  for (int i = 0; i < nlayer - 1; i++) {
+    if (_gridlayer[i]->is_dummy()) continue;
+    int best_pre = 1, best_post = 1;
+    for (int pre = 1; pre <= max_sweeps; pre++) {
+      for (int post = std::max(1, pre - 1); post <= std::min(max_sweeps, pre + 1); post++) {
+        if (pre == best_pre && post == best_post) continue;
+        _pre_sweeps[i] = pre;
+        _post_sweeps[i] = post;
+        double factor = calibrate_factor(n_calib);
+        double c = cost(factor);
+        if (c < best_cost) {
+          best_cost = c;
+          best_factor = factor;
+          best_pre = pre;
+          best_post = post;
+        }
+      }
+    }
+    _pre_sweeps[i] = best_pre;
+    _post_sweeps[i] = best_post;
+  }
+
+  _telemetry.pause(false);
+
+  printf("-- tuned sweeps, factor %.4lf, cycle %.2lf ms (1/1 : %.2lf ms)\n", best_factor, cycle_time(), base_ms);
+  printf("%-6s %10s %5s %5s\n", "layer", "sweep(ms)", "pre", "post");
+  for (int i = 0; i < nlayer - 1; i++) {
+    if (_gridlayer[i]->is_dummy()) continue;
+    printf("%-6d %10.3lf %5d %5d\n", i, sweep_ms[i], _pre_sweeps[i], _post_sweeps[i]);
+  }
+  return best_factor;
+}
+
 void grid::cubeGridSetSolidVertices(int reso, const std::vector<unsigned int>& solid_ebit, std::vector<unsigned int>& solid_vbit) {
   size_t nelements = pow(reso, 3);
 
@@ -1015,7 +1386,6 @@ void Grid::lexico2gsorder(int* idmap, int n_id, int* ids, int n_mapid, int* mapp
 
 void Grid::computeProjectionMatrix(int nv, int nv_gs, int vreso, const std::vector<int>& lexi2gs, const int* lexi2gs_dev, BitSAT<unsigned int>& vsat, int* vflaghost, int* vflagdev) {
   double eh = (_box[1][0] - _box[0][0]) / (vreso - 1);
-  int vreso2 = pow(vreso, 2);
 
   std::vector<int> loadvid;
   std::vector<Eigen::Matrix<double, 3, 1>> loadpos;
@@ -1029,52 +1399,60 @@ void Grid::computeProjectionMatrix(int nv, int nv_gs, int vreso, const std::vect
 
   int nfixnodes = 0;
 
-  // compute surface load nodes positions and set corresponding flag
-  #pragma omp parallel for
-  for (int i = 0; i < vsat._bitArray.size(); i++) {
-    unsigned int word = vsat._bitArray[i];
-    int vidoffset = vsat._chunkSat[i];
-    int nv_word = 0;
-    for (int j = 0; j < BitCount<unsigned int>::value; j++) {
-      if (read_bit(word, j)) {
-        int flag = vflaghost[vidoffset + nv_word];
-        if (flag & Bitmask::mask_surfacenodes) {
-          int bitid = i * BitCount<unsigned int>::value + j;
-          int id[3] = { bitid % vreso, bitid % vreso2 / vreso, bitid / vreso2 };
-          double vpos[3] = { _box[0][0] + id[0] * eh,_box[0][1] + id[1] * eh,_box[0][2] + id[2] * eh };
-          bool isFix = false, isLoad = false;
-          // set support nodes flag
-          if (_inFixedArea(vpos)) {
-            isFix = true;
-            flag |= mask_supportnodes;
-            #pragma omp critical
-            {
-              supportvids.emplace_back(vidoffset + nv_word);
-              supportpos.emplace_back(vpos[0], vpos[1], vpos[2]);
-              nfixnodes++;
-            }
-          }
-
-          if (isFix) {
-            goto _setFlag;
-          }
-
-          // set load nodes flag
-          if (_inLoadArea(vpos)) {
-            isLoad = true;
-            flag |= mask_loadnodes;
-            #pragma omp critical
-            {
-              loadvid.emplace_back(vidoffset + nv_word);
-              loadpos.emplace_back(vpos[0], vpos[1], vpos[2]);
-              loadforce.emplace_back(_loadField(vpos));
-            }
-          }
+  // gather surface node positions in lattice order, rank -> slot among surface nodes first
+  std::vector<int> surfid(nv + 1, 0);
+  for_each_set_bit(vsat, vreso, [&](size_t bitid, int vid, const int* vpos) {
+    surfid[vid + 1] = (vflaghost[vid] & Bitmask::mask_surfacenodes) != 0;
+  });
+  for (int i = 0; i < nv; i++) surfid[i + 1] += surfid[i];
+
+  int ns = surfid[nv];
+  std::vector<int> svid(ns);
+  std::vector<double> spos[3];
+  for (int k = 0; k < 3; k++) spos[k].resize(ns);
+  for_each_set_bit(vsat, vreso, [&](size_t bitid, int vid, const int* vpos) {
+    if (surfid[vid + 1] == surfid[vid]) return;
+    int sid = surfid[vid];
+    svid[sid] = vid;
+    for (int k = 0; k < 3; k++) spos[k][sid] = _box[0][k] + vpos[k] * eh;
+  });
+
+  // classify surface nodes, the declarative regions are evaluated in blocks, callbacks per node
+  std::vector<unsigned char> isFix(ns), isLoad(ns);
+  if (_regions.enabled) {
+    const int block = 4096;
+    #pragma omp parallel for
+    for (int b = 0; b < ns; b += block) {
+      int n = std::min(block, ns - b);
+      _regions.fixed.evaluate(n, &spos[0][b], &spos[1][b], &spos[2][b], &isFix[b]);
+      _regions.load.evaluate(n, &spos[0][b], &spos[1][b], &spos[2][b], &isLoad[b]);
+    }
+  } else {
+    #pragma omp parallel for
+    for (int i = 0; i < ns; i++) {
+      double vpos[3] = { spos[0][i], spos[1][i], spos[2][i] };
+      isFix[i] = _inFixedArea(vpos);
+      isLoad[i] = !isFix[i] && _inLoadArea(vpos);
+    }
+  }
 
-_setFlag:
-          vflaghost[vidoffset + nv_word] = flag;
-        }
-        nv_word++;
+  // set support and load flags, support takes precedence
+  for (int i = 0; i < ns; i++) {
+    int vid = svid[i];
+    double vpos[3] = { spos[0][i], spos[1][i], spos[2][i] };
+    if (isFix[i]) {
+      vflaghost[vid] |= mask_supportnodes;
+      supportvids.emplace_back(vid);
+      supportpos.emplace_back(vpos[0], vpos[1], vpos[2]);
+      nfixnodes++;
+    } else if (isLoad[i]) {
+      vflaghost[vid] |= mask_loadnodes;
+      loadvid.emplace_back(vid);
+      loadpos.emplace_back(vpos[0], vpos[1], vpos[2]);
+      if (_regions.enabled) {
+        loadforce.emplace_back(_regions.force[0], _regions.force[1], _regions.force[2]);
+      } else {
+        loadforce.emplace_back(_loadField(vpos));
       }
     }
   }
@@ -1132,6 +1510,12 @@ _setFlag:
 
 Eigen::Matrix<double, 3, 1> Grid::outwardNormal(double p[3]) {
   Eigen::Matrix<double, 3, 1> normal;
+  if (_sdf) {
+    double g[3];
+    _sdf->gradient(p, elementLength() / 2, g);
+    for (int i = 0; i < 3; i++) normal[i] = g[i];
+    return normal;
+  }
   Point pos(p[0], p[1], p[2]);
   auto ptri = aabb_tree.closest_point_and_primitive(pos);
   auto trinormal = ptri.second->supporting_plane().orthogonal_vector();
@@ -1150,51 +1534,32 @@ Eigen::Matrix<double, 3, 1> Grid::outwardNormal(double p[3]) {
 }
 
 void Grid::setVerticesPosFlag(int vreso, BitSAT<unsigned int>& vrtsat, int* flags) {
-  auto& vbit = vrtsat._bitArray;
-  int vreso2 = vreso * vreso;
-  for (int j = 0; j < vbit.size(); j++) {
-    auto word = vbit[j];
-    if (word == 0) continue;
-    for (int ji = 0; ji < BitCount<unsigned int>::value; ji++) {
-      if (!read_bit(word, ji)) continue;
-      int vbitid = j * BitCount<unsigned int>::value + ji;
-      int flagword = 0;
-
-      // position mod 8 flag
-      int vpos[3] = { vbitid % vreso, vbitid / vreso % vreso, vbitid / vreso2 };
-      flagword |= vpos[0] % 8;
-      flagword |= (vpos[1] % 8) << 3;
-      flagword |= (vpos[2] % 8) << 6;
-
-      int vid = vrtsat[vbitid];
-
-      // write flag word to memory
-      flags[vid] = flagword;
-    }
-  }
+  for_each_set_bit(vrtsat, vreso, [&](size_t vbitid, int vid, const int* vpos) {
+    int flagword = 0;
+
+    // position mod 8 flag
+    flagword |= vpos[0] % 8;
+    flagword |= (vpos[1] % 8) << 3;
+    flagword |= (vpos[2] % 8) << 6;
+
+    // write flag word to memory
+    flags[vid] = flagword;
+  });
 
 }
 
 void Grid::setV2E(int vreso, BitSAT<unsigned int>& vrtsat, BitSAT<unsigned int>& elsat, int* v2elist[8]) {
   int vreso2 = pow(vreso, 2);
   int elementreso = vreso - 1;
-  int elementreso2 = pow(elementreso, 2);
-  auto& ebit = elsat._bitArray;
   for (int k = 0; k < 8; k++) {
     int* v2e = v2elist[k];
     int loc[3] = { k % 2,(k % 4) / 2,k / 4 };
-    for (int j = 0; j < ebit.size(); j++) {
-      auto word = ebit[j];
-      if (word == 0) continue;
-      for (int ji = 0; ji < sizeof(unsigned int) * 8; ji++) {
-        if (!read_bit(word, ji)) continue;
-        int eid = j * sizeof(unsigned int) * 8 + ji;
-        int epos[3] = { eid % elementreso, (eid % elementreso2) / elementreso, eid / elementreso2 };
-        int vloc[3] = { epos[0] + loc[0],epos[1] + loc[1],epos[2] + loc[2] };
-        int vid = vloc[0] + vloc[1] * vreso + vloc[2] * vreso2;
-        v2e[vrtsat[vid]] = elsat[eid];
-      }
-    }
+    // every vertex is corner k of at most one element, the writes do not collide
+    for_each_set_bit(elsat, elementreso, [&](size_t eid, int erank, const int* epos) {
+      int vloc[3] = { epos[0] + loc[0],epos[1] + loc[1],epos[2] + loc[2] };
+      int vid = vloc[0] + vloc[1] * vreso + vloc[2] * vreso2;
+      v2e[vrtsat[vid]] = erank;
+    });
   }
 
 }
@@ -1202,22 +1567,15 @@ void Grid::setV2E(int vreso, BitSAT<unsigned int>& vrtsat, BitSAT<unsigned int>&
 void Grid::setV2V(int vreso, BitSAT<unsigned int>& vrtsat, int* v2vlist[27]) {
   int vertexreso = vreso;
   int vertexreso2 = pow(vreso, 2);
-  auto& vbit = vrtsat._bitArray;
   for (int k = 0; k < 27; k++) {
     int* v2v = v2vlist[k];
     int loc[3] = { k % 3 - 1,k / 3 % 3 - 1,k / 9 - 1 };
-    for (int j = 0; j < vbit.size(); j++) {
-      auto word = vbit[j];
-      if (word == 0) continue;
-      for (int ji = 0; ji < BitCount<unsigned int>::value; ji++) {
-        if (!read_bit(word, ji)) continue;
-        int vid = BitCount<unsigned int>::value*j + ji;
-        int vloc[3] = { vid % vertexreso + loc[0], (vid % vertexreso2) / vertexreso + loc[1], vid / vertexreso2 + loc[2] };
-        if (vloc[0] < 0 || vloc[1] < 0 || vloc[2] < 0) continue;
-        int neighid = vloc[0] + vloc[1] * vertexreso + vloc[2] * vertexreso2;
-        v2v[vrtsat[vid]] = vrtsat[neighid];
-      }
-    }
+    for_each_set_bit(vrtsat, vertexreso, [&](size_t vid, int vrank, const int* vpos) {
+      int vloc[3] = { vpos[0] + loc[0], vpos[1] + loc[1], vpos[2] + loc[2] };
+      if (vloc[0] < 0 || vloc[1] < 0 || vloc[2] < 0) return;
+      int neighid = vloc[0] + vloc[1] * vertexreso + vloc[2] * vertexreso2;
+      v2v[vrank] = vrtsat[neighid];
+    });
   }
 }
 
@@ -1230,6 +1588,39 @@ void Grid::getV2V(void) {
     _v2v[i].resize(n_gsvertices);
     gpu_manager_t::download_buf(_v2v[i].data(), _gbuf.v2v[i], sizeof(int) * n_gsvertices);
   }
+  mem::track(_name + " host v2v", mem::coarse_solver, mem::host, sizeof(int) * 27 * n_gsvertices, _layer);
+}
+
+std::vector<Grid::gbuf_entry_t> Grid::listBuffers(void) {
+  size_t nv = n_gsvertices;
+  size_t ne = n_gselements;
+  std::vector<gbuf_entry_t> bufs;
+  auto add = [&](const std::string& name, void** ptr, size_t bytes, mem::category_t cat) {
+    bufs.push_back({ _name + name, ptr, bytes, cat });
+  };
+
+  add(" vid map ", (void**)&_gbuf.vidmap, sizeof(int) * n_vertices, mem::topology);
+  add(" eid map ", (void**)&_gbuf.eidmap, sizeof(int) * n_elements, mem::topology);
+  for (int i = 0; i < 3; i++) {
+    add(" U " + std::to_string(i), (void**)&_gbuf.U[i], sizeof(double) * nv, mem::fields);
+    add(" F " + std::to_string(i), (void**)&_gbuf.F[i], sizeof(double) * nv, mem::fields);
+    add(" R " + std::to_string(i), (void**)&_gbuf.R[i], sizeof(double) * nv, mem::fields);
+  }
+  add("rho_e ", (void**)&_gbuf.rho_e, sizeof(float) * ne, mem::fields);
+  add("eActiveBits", (void**)&_gbuf.eActiveBits, sizeof(unsigned int) * _gbuf.nword_ebits, mem::topology);
+  add("eActiveChunkSum", (void**)&_gbuf.eActiveChunkSum, sizeof(int) * (_gbuf.nword_ebits + 1), mem::topology);
+  for (int i = 0; i < 8; i++) add(" v2e " + std::to_string(i), (void**)&_gbuf.v2e[i], sizeof(int) * nv, mem::topology);
+  for (int i = 0; i < 27; i++) add(" v2vfine " + std::to_string(i), (void**)&_gbuf.v2vfine[i], sizeof(int) * nv, mem::topology);
+  for (int i = 0; i < 8; i++) add(" v2vcoarse " + std::to_string(i), (void**)&_gbuf.v2vcoarse[i], sizeof(int) * nv, mem::topology);
+  for (int i = 0; i < 27; i++) add(" v2v " + std::to_string(i), (void**)&_gbuf.v2v[i], sizeof(int) * nv, mem::topology);
+  for (int i = 0; i < 64; i++) add(" v2vfinecenter " + std::to_string(i), (void**)&_gbuf.v2vfinecenter[i], sizeof(int) * nv, mem::topology);
+  add(" g_sens ", (void**)&_gbuf.g_sens, sizeof(float) * ne, mem::fields);
+  add(" vbitflag ", (void**)&_gbuf.vBitflag, sizeof(int) * nv, mem::topology);
+  add(" ebitflag ", (void**)&_gbuf.eBitflag, sizeof(int) * ne, mem::topology);
+  add(" rxStencil ", (void**)&_gbuf.rxStencil, sizeof(double) * nv * 27 * 9, mem::stencil);
+  // Fsupport is sized by the load nodes of the projection, it is not read by the v-cycle
+
+  return bufs;
 }
 
 size_t grid::Grid::build(
@@ -1267,6 +1658,9 @@ size_t grid::Grid::build(
 
   _name = sbuf;
 
+  // device buffers below are tracked under this layer, the category is switched per group
+  mem::tag memtag(mem::topology, layer);
+
   // mark GS color id in element and vertex bitflag word
   compute_gscolor(gm, vbit, ebit, vreso, vbitflags, ebitflags);
 
@@ -1295,6 +1689,7 @@ size_t grid::Grid::build(
   _gbuf.vidmap = vidmap;
 
   // allocate GPU memory for FEM displacement, force, residual
+  memtag.set(mem::fields);
   for (int i = 0; i < 3; i++) {
     _gbuf.U[i] = (double*)gm.add_buf(_name + " U " + std::to_string(i), sizeof(double)* nv_gs);
     gbuf_size += sizeof(double) * nv_gs;
@@ -1312,6 +1707,7 @@ size_t grid::Grid::build(
   if (layer == 0) {
     _gbuf.rho_e = (float*)gm.add_buf(_name + "rho_e ", sizeof(float) * ne_gs);
     gbuf_size += sizeof(float) * ne_gs;
+    memtag.set(mem::topology);
     _gbuf.eActiveBits = (unsigned int*)gm.add_buf(_name + "eActiveBits", sizeof(unsigned int)*ebit._bitArray.size(), ebit._bitArray.data());
     gbuf_size += sizeof(unsigned int) * ebit._bitArray.size();
     _gbuf.eActiveChunkSum = (int*)gm.add_buf(_name + "eActiveChunkSum", sizeof(int)*ebit._chunkSat.size(), ebit._chunkSat.data());
@@ -1320,6 +1716,7 @@ size_t grid::Grid::build(
   }
 
   // allocate v2e topology buffer
+  memtag.set(mem::topology);
   if (layer == 0) {
     for (int i = 0; i < 8; i++) {
       _gbuf.v2e[i] = (int*)gm.add_buf(_name + " v2e " + std::to_string(i), sizeof(int) * nv_gs, v2ehost[i], sizeof(int) * nv);
@@ -1371,11 +1768,13 @@ size_t grid::Grid::build(
 
   // allocate sensitivity buffer on first grid
   if (_layer == 0) {
+    memtag.set(mem::fields);
     _gbuf.g_sens = (float*)gm.add_buf(_name + " g_sens ", sizeof(float) * ne_gs);
     gbuf_size += sizeof(float) * ne_gs;
   }
 
   // allocate bitflag buffer for vertex and element
+  memtag.set(mem::topology);
   _gbuf.vBitflag = (int*)gm.add_buf(_name + " vbitflag ", sizeof(int) * nv_gs, vbitflags, sizeof(int) * nv);
   gbuf_size += sizeof(int) * nv_gs;
   _gbuf.eBitflag = (int*)gm.add_buf(_name + " ebitflag ", sizeof(int) * ne_gs, ebitflags, sizeof(int) * ne);
@@ -1392,6 +1791,7 @@ size_t grid::Grid::build(
     //lexico2gsorder(nullptr, _gsLoadNodes.size(), _gsLoadNodes.data(), _gsLoadNodes.size(), _gsLoadNodes.data(), vidmap);
 
     // add force support buf
+    memtag.set(mem::fields);
     for (int i = 0; i < 3; i++) _gbuf.Fsupport[i] = (double*)gm.add_buf(_name + " fsupport " + std::to_string(i), sizeof(double) * n_loadnodes());
   }
 
@@ -1405,6 +1805,7 @@ size_t grid::Grid::build(
   lexico2gsorder_g(eidmap, ne, _gbuf.eBitflag, ne_gs, _gbuf.eBitflag);
 
   if (_layer != 0) {
+    memtag.set(mem::stencil);
     _gbuf.rxStencil = (double*)gm.add_buf(_name + " rxStencil ", sizeof(double) * nv_gs * 27 * 9);
     gbuf_size += sizeof(double) * nv_gs * 27 * 9;
     gpu_manager_t::initMem(_gbuf.rxStencil, sizeof(double) * nv_gs * 27 * 9);
@@ -1416,22 +1817,16 @@ size_t grid::Grid::build(
 }
 
 void grid::Grid::readForce(std::string forcefile) {
-  std::vector<double> fhost;
-  bool suc = bio::read_vector(forcefile, fhost);
+  std::vector<double> f[3];
+  bool suc = bio::read_vectors(forcefile, f);
   if (!suc) {
     printf("\033[31mFailed to open file %s \n\033[0m", forcefile.c_str());
     throw std::runtime_error("error open file");
   }
-  if (fhost.size() != n_gsvertices * 3) {
+  if (f[0].size() != n_gsvertices) {
     printf("\033[31mForce Size does not match\033[0m\n");
     throw std::runtime_error("invalid size");
   }
-  std::vector<double> f[3];
-  for (int i = 0; i < fhost.size(); i += 3) {
-    f[0].emplace_back(fhost[i]);
-    f[1].emplace_back(fhost[i + 1]);
-    f[2].emplace_back(fhost[i + 2]);
-  }
 
   for (int i = 0; i < 3; i++) {
     gpu_manager_t::upload_buf(_gbuf.F[i], f[i].data(), sizeof(double) * n_gsvertices);
@@ -1439,22 +1834,16 @@ void grid::Grid::readForce(std::string forcefile) {
 }
 
 void grid::Grid::readSupportForce(std::string fsfile) {
-  std::vector<double> fhost;
-  bool suc = bio::read_vector(fsfile, fhost);
+  std::vector<double> f[3];
+  bool suc = bio::read_vectors(fsfile, f);
   if (!suc) {
     printf("\033[31mFailed to open file %s \n\033[0m", fsfile.c_str());
     throw std::runtime_error("error open file");
   }
-  if (fhost.size() != n_loadnodes() * 3) {
+  if (f[0].size() != n_loadnodes()) {
     printf("\033[31mForce Size does not match\033[0m\n");
     throw std::runtime_error("invalid size");
   }
-  std::vector<double> f[3];
-  for (int i = 0; i < fhost.size(); i += 3) {
-    f[0].emplace_back(fhost[i]);
-    f[1].emplace_back(fhost[i + 1]);
-    f[2].emplace_back(fhost[i + 2]);
-  }
 
   double* pload[3] = { f[0].data(),f[1].data(),f[2].data() };
   uploadLoadForce(pload);
@@ -1462,25 +1851,18 @@ void grid::Grid::readSupportForce(std::string fsfile) {
 }
 
 void grid::Grid::readDisplacement(std::string displacementfile) {
-  std::vector<double> uhost;
-  bool suc = bio::read_vector(displacementfile, uhost);
+  std::vector<double> u[3];
+  bool suc = bio::read_vectors(displacementfile, u);
   if (!suc) {
     printf("\033[31mFailed to open file %s \n\033[0m", displacementfile.c_str());
     throw std::runtime_error("error open file");
   }
 
-  if (uhost.size() != n_gsvertices * 3) {
+  if (u[0].size() != n_gsvertices) {
     printf("\033[31mDisplacement Size does not match\033[0m\n");
     throw std::runtime_error("invalid size");
   }
 
-  std::vector<double> u[3];
-  for (int i = 0; i < uhost.size(); i += 3) {
-    u[0].emplace_back(uhost[i]);
-    u[1].emplace_back(uhost[i + 1]);
-    u[2].emplace_back(uhost[i + 2]);
-  }
-
   for (int i = 0; i < 3; i++) {
     gpu_manager_t::upload_buf(_gbuf.U[i], u[i].data(), sizeof(double) * n_gsvertices);
   }
@@ -1648,6 +2030,12 @@ void Grid::buildCoarsestSystem(void) {
   //fullK = Klast;
   //svd.setThreshold(1e-11);
   svd.compute(fullK, Eigen::ComputeFullU | Eigen::ComputeFullV);
+
+  // dense system and its full U, V factors dominate, they grow with the square of the coarsest vertex count
+  size_t n = fullK.rows();
+  mem::track("coarse fullK", mem::coarse_solver, mem::host, sizeof(double) * fullK.size(), _layer);
+  mem::track("coarse Klast", mem::coarse_solver, mem::host, (sizeof(double) + sizeof(int)) * Klast.nonZeros() + sizeof(int) * (Klast.outerSize() + 1), _layer);
+  mem::track("coarse svd", mem::coarse_solver, mem::host, sizeof(double) * (2 * n * n + n), _layer);
   int lossrank = fullK.rows() - svd.rank();
   printf("-- degenerate rank = %d\n", lossrank);
   if (lossrank > 0) {
@@ -1832,12 +2220,15 @@ void Grid::enumerate_gs_subset(
 }
 
 void HierarchyGrid::update_stencil(void) {
+  _PROF("update_stencil");
   for (int i = 0; i < _gridlayer.size(); i++) {
     if (_gridlayer[i]->is_dummy()) continue;
     if (i == 0) continue;
-    restrict_stencil(*_gridlayer[i], *_gridlayer[i]->fineGrid);
+    _PROF_ARG("layer", i);
+    { _PROF("restrict_stencil"); restrict_stencil(*_gridlayer[i], *_gridlayer[i]->fineGrid); }
     // last layer build host system
     if (i == _gridlayer.size() - 1) {
+      _PROF("coarsest_system");
       _gridlayer[i]->buildCoarsestSystem();
     }
   }
@@ -6,6 +6,8 @@
 #include "lib.cuh"
 #include "projection.h"
 #include "tictoc.h"
+#include "memory_registry.h"
+#include "profiler.h"
 //#define GLM_FORCE_CUDA
 //// #define GLM_FORCE_PURE (not needed anymore with recent GLM versions)
 //#include <glm/glm.hpp>
@@ -628,11 +630,13 @@ void* Grid::getTempBuf(size_t requre)
 	if (_tmp_buf == nullptr) {
 		cudaMalloc(&_tmp_buf, req_size);
 		_tmp_buf_size = req_size;
+		mem::track("grid temp buffer", mem::temp, mem::device, _tmp_buf_size);
 	}
 	if (_tmp_buf_size < req_size) {
 		cudaFree(_tmp_buf);
 		_tmp_buf_size = snippet::Round<512>(req_size);
 		cudaMalloc(&_tmp_buf, req_size);
+		mem::track("grid temp buffer", mem::temp, mem::device, _tmp_buf_size);
 	}
 	return _tmp_buf;
 }
@@ -641,6 +645,10 @@ void* Grid::getTempBuf(size_t requre)
 void Grid::clearBuf(void)
 {
 	cudaFree(_tmp_buf);
+	// the next getTempBuf allocates and tracks again
+	_tmp_buf = nullptr;
+	_tmp_buf_size = 0;
+	mem::release("grid temp buffer");
 }
 
 void Grid::lexico2gsorder_g(int* idmap, int n_id, int* ids, int n_mapid, int* mapped_ids, int* valuemap /*= nullptr*/)
@@ -1074,6 +1082,7 @@ void Grid::gs_relax(int n_times)
 		for (int n = 0; n < n_times; n++) {
 			int gs_offset = 0;
 			for (int i = 0; i < 8; i++) {
+				_PROF_ARG("color", i);
 				constexpr int BlockSize = 32 * 8;
 				size_t grid_size, block_size;
 				make_kernel_param(&grid_size, &block_size, gs_num[i] * 8, BlockSize);
@@ -1096,6 +1105,7 @@ void Grid::gs_relax(int n_times)
 		for (int n = 0; n < n_times; n++) {
 			int gs_offset = 0;
 			for (int i = 0; i < 8; i++) {
+				_PROF_ARG("color", i);
 				size_t grid_size, block_size;
 				constexpr int BlockSize = 32 * 13;
 				make_kernel_param(&grid_size, &block_size, gs_num[i] * 13, BlockSize);
@@ -2411,6 +2421,8 @@ __global__ void filterSensitivity_kernel(int nebitword, gBitSAT<unsigned int> es
 void Grid::filterSensitivity(double radii)
 {
 	if (_layer != 0) return;
+
+	_PROF("filter");
 	
 	size_t grid_size, block_size;
 
@@ -10,8 +10,15 @@
 #include "type_traits"
 #include "gpu_manager_t.h"
 #include "snippet.h"
+#include "region.h"
+#include "sdf.h"
+#include "mg_telemetry.h"
+#include "memory_registry.h"
 #include "set"
 #include <memory>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace grid {
 
@@ -110,7 +117,7 @@ namespace grid {
 
 		BitSAT(std::vector<T>&& bitArray) noexcept : _bitArray(bitArray) { buildChunkSat(); }
 		// the sat sum at id-th element in bit array
-		int operator[](size_t id) {
+		int operator[](size_t id) const {
 			int ent = id >> firstOne<sizeof(T) * 8>::value;
 			int mod = id & size_mask;
 			return _chunkSat[ent] + countOne(_bitArray[ent] & ((T{ 1 } << mod) - 1));
@@ -133,6 +140,67 @@ namespace grid {
 			}
 		}
 	};
+
+	// index of the lowest set bit, word must not be 0
+	template<typename T>
+	inline int countTrailingZeros(T word) {
+#ifdef _MSC_VER
+		unsigned long id;
+		if (sizeof(T) > 4) _BitScanForward64(&id, (unsigned long long)word);
+		else _BitScanForward(&id, (unsigned long)word);
+		return id;
+#else
+		return sizeof(T) > 4 ? __builtin_ctzll((unsigned long long)word) : __builtin_ctz((unsigned int)word);
+#endif
+	}
+
+	// fn(j) for each set bit j of word, lowest first
+	template<typename T, typename Fn>
+	inline void for_each_bit(T word, Fn&& fn) {
+		while (word) {
+			fn(countTrailingZeros(word));
+			word &= word - 1;
+		}
+	}
+
+	// lattice coordinates of a bit id on a reso^3 lattice, advanced without div / mod
+	struct lattice_cursor_t {
+		int reso;
+		int pos[3];
+		lattice_cursor_t(int reso_, size_t bitid) : reso(reso_) {
+			pos[0] = bitid % reso; pos[1] = bitid / reso % reso; pos[2] = bitid / reso / reso;
+		}
+		void advance(int step) {
+			pos[0] += step;
+			while (pos[0] >= reso) {
+				pos[0] -= reso;
+				if (++pos[1] == reso) { pos[1] = 0; pos[2]++; }
+			}
+		}
+	};
+
+	// fn(bitid, rank, pos) for every set bit of sat, pos are the lattice coordinates of bitid on a reso^3 lattice.
+	// Words are distributed over threads, the ranks come from _chunkSat so every call knows its output slot
+	// and results can be written to rank-indexed arrays without synchronization.
+	template<typename T, typename Fn>
+	void for_each_set_bit(const BitSAT<T>& sat, int reso, Fn&& fn, bool parallel = true) {
+		int nword = sat._bitArray.size();
+#pragma omp parallel for schedule(dynamic, 64) if(parallel)
+		for (int i = 0; i < nword; i++) {
+			T word = sat._bitArray[i];
+			if (word == 0) continue;
+			int rank = sat._chunkSat[i];
+			size_t base = size_t(i) * BitCount<T>::value;
+			lattice_cursor_t cur(reso, base);
+			int last = 0;
+			for_each_bit(word, [&](int j) {
+				cur.advance(j - last);
+				last = j;
+				fn(base + j, rank++, (const int*)cur.pos);
+			});
+		}
+	}
+
 	void wordReverse_g(size_t nword, unsigned int* wordlist);
 
 	void cubeGridSetSolidVertices(int reso, const std::vector<unsigned int>& solid_ebit, std::vector<unsigned int>& solid_vbit);
@@ -169,6 +237,15 @@ namespace grid {
 	};
 
 
+	// density field of the finest layer on host, rho is indexed by element rank in esat
+	struct density_field_t {
+		int ereso = 0;
+		float box[2][3];
+		BitSAT<unsigned int> esat;
+		std::vector<float> rho;
+		density_field_t(const BitSAT<unsigned int>& sat) : esat(sat) {}
+	};
+
 	class Grid
 	{
 	public:
@@ -289,6 +366,9 @@ namespace grid {
 		std::function<bool(double[3])> _inLoadArea;
 		std::function<bool(double[3])> _inFixedArea;
 		std::function<Eigen::Matrix<double, 3, 1>(double[3])> _loadField;
+		boundary_regions_t _regions;
+		// implicit domain the hierarchy was built from, nullptr for meshes
+		const sdf_t* _sdf = nullptr;
 
 		std::vector<int> _gsLoadNodes;
 
@@ -348,6 +428,18 @@ namespace grid {
 
 		void computeProjectionMatrix(int nv, int nv_gs, int vreso, const std::vector<int>& lexi2gs, const int* lexi2gs_dev, BitSAT<unsigned int>& vsat, int* vflaghost, int* vflagdev);
 
+		// a device buffer of the layer under the name build allocates it with
+		struct gbuf_entry_t {
+			std::string name;
+			void** ptr;
+			size_t bytes;
+			mem::category_t cat;
+		};
+
+		// every buffer build may allocate on this layer, sized from the vertex / element counts whether allocated or not.
+		// The solver capture downloads the allocated ones and restores them by name
+		std::vector<gbuf_entry_t> listBuffers(void);
+
 		int* getEidmap(void) { return _gbuf.eidmap; }
 
 		int* getVidmap(void) { return _gbuf.vidmap; }
@@ -546,6 +638,16 @@ namespace grid {
 
 		int _nlayer = 0;
 
+		// Gauss-Seidel sweeps of every layer before / after the coarse correction, layers not listed do 1
+		std::vector<int> _pre_sweeps;
+		std::vector<int> _post_sweeps;
+
+		// convergence factor of the current sweeps over n_calib cycles started from zero displacement, cycle_ms receives the mean cycle time
+		double calibrate_factor(int n_calib, double* cycle_ms = nullptr);
+
+		// build all layers from the solid bits of the finest lattice, shared by genFromMesh and genFromSDF
+		void genFromLattice(std::vector<unsigned int>& solid_bit, int out_reso[3], float out_box[2][3]);
+
 	public:
 		std::vector<BitSAT<unsigned int>> elesatlist;
 		std::vector<BitSAT<unsigned int>> vrtsatlist;
@@ -553,6 +655,12 @@ namespace grid {
 		std::function<bool(double[3])> _inLoadArea;
 		std::function<bool(double[3])> _inFixedArea;
 		std::function<Eigen::Matrix<double, 3, 1>(double[3])> _loadField;
+		boundary_regions_t _regions;
+		// set by genFromSDF, shell elements and outward normals then come from the distance function instead of the mesh
+		sdf_t _sdf;
+
+		// per level residuals of the v-cycles, off by default
+		mg_telemetry_t _telemetry;
 
 		std::string _outdir;
 
@@ -617,6 +725,10 @@ namespace grid {
 
 		void genFromMesh(const std::vector<float>& pcoords, const std::vector<int>& facevertices);
 
+		// build the hierarchy from an implicit solid, element centers with d <= 0 are solid. The lattice box is
+		// the bounds of sdf padded as in genFromMesh, an unbounded sdf needs lo / hi.
+		void genFromSDF(const sdf_t& sdf, const double* lo = nullptr, const double* hi = nullptr);
+
 		void resetAllResidual(void);
 
 		void restrict_stencil_dyadic(Grid& dstcoarse, Grid& srcfine);
@@ -657,13 +769,44 @@ namespace grid {
 
 		void writeDisplacement(const std::string& filename);
 
+		// export density, sensitivity, displacement and force of the finest layer as VTK XML unstructured grid
+		void writeVTU(const std::string& filename, bool compress = false);
+
 		void getNodePos(Grid& g, std::vector<double>& p3host);
 
+		density_field_t getDensityField(void);
+
+		// extract the density iso-surface of the finest layer, written as binary PLY for *.ply and binary STL otherwise
+		void writeSurface(const std::string& filename, float isovalue = 0.5f);
+
+		// trilinear interpolation of a density field built on another (coarser) lattice to the active elements of layer 0
+		void prolongateDensity(const density_field_t& field);
+
+		// release all layers and device buffers, the hierarchy can be rebuilt by genFromMesh
+		void clear(void);
+
+		// take over layers whose metadata and buffers were filled elsewhere (a solver capture), finest first with dummy
+		// layers included. The hierarchy must be cleared before the buffers are allocated. Links the layers like
+		// genFromMesh and builds the coarsest system from the restored stencil
+		void adoptLayers(const std::vector<Grid*>& layers, bool skiplayer);
+
 		void update_stencil(void);
 
 		//void update_adjoint_stencil(void);
 
-		double v_cycle(int pre_relax = 1, int post_relax = 1);
+		// negative sweep counts take the per layer counts of set_sweeps / tune_sweeps
+		double v_cycle(int pre_relax = -1, int post_relax = -1);
+
+		void set_sweeps(const std::vector<int>& pre, const std::vector<int>& post) { _pre_sweeps = pre; _post_sweeps = post; }
+
+		int pre_sweeps(int layer) const { return layer < _pre_sweeps.size() ? _pre_sweeps[layer] : 1; }
+
+		int post_sweeps(int layer) const { return layer < _post_sweeps.size() ? _post_sweeps[layer] : 1; }
+
+		// time one sweep per layer, then choose the sweeps of each layer (finest first, at most max_sweeps) minimizing the
+		// predicted time to tolerance t_cycle / -log(factor). The force of layer 0 is the right hand side of the calibration
+		// cycles, the displacement is restored. Returns the convergence factor of the chosen schedule
+		double tune_sweeps(int max_sweeps = 3, int n_calib = 4);
 
 		double v_halfcycle(int depth, int pre_relax = 1, int post_relax = 1);
 
@@ -0,0 +1,165 @@
+#include "VTUWriter.h"
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace grid {
+static const char* sectionName(VTUWriter::Section sec) {
+  switch(sec) {
+  case VTUWriter::POINTS:
+    return "Points";
+  case VTUWriter::CELLS:
+    return "Cells";
+  case VTUWriter::CELL_DATA:
+    return "CellData";
+  default:
+    return "PointData";
+  }
+}
+VTUWriter::VTUWriter(const std::string& path,size_t nrPoint,size_t nrCell,bool compress)
+  :_os(path.c_str(),std::ios_base::binary),_nrPoint(nrPoint),_nrCell(nrCell),
+   _dataBegin(headerReserve),_arrayBegin(0),_arrayBytes(0),_appended(0),
+   _compress(compress),_inArray(false),_closed(false),_failed(false) {
+#ifndef WITH_ZLIB
+  if(_compress) {
+    printf("\033[31m-- built without zlib, writing uncompressed vtu\033[0m\n");
+    _compress=false;
+  }
+#endif
+  //reserve the header region, filled in close()
+  std::string blank(headerReserve,' ');
+  _os.write(blank.data(),blank.size());
+  _block.reserve(blockSize);
+}
+VTUWriter::~VTUWriter() {
+  if(!_closed)
+    close();
+}
+bool VTUWriter::good() const {
+  return _os.good() && !_failed;
+}
+void VTUWriter::beginArray(Section sec,const std::string& name,const std::string& type,int ncomp,size_t nbytes) {
+  if(_inArray)
+    endArray();
+  ArrayInfo info;
+  info._sec=sec;
+  info._name=name;
+  info._type=type;
+  info._ncomp=ncomp;
+  info._offset=(size_t)_os.tellp()-_dataBegin;
+  _arrays.push_back(info);
+  _arrayBegin=_os.tellp();
+  _arrayBytes=nbytes;
+  _appended=0;
+  _block.clear();
+  _csizes.clear();
+  _inArray=true;
+  unsigned long long head=nbytes;
+  if(_compress) {
+    //[nblocks][blocksize][lastblocksize][csize_0 ... csize_n-1], sizes filled in endArray
+    unsigned long long nblocks=(nbytes+blockSize-1)/blockSize;
+    std::vector<unsigned long long> ch(3+nblocks,0);
+    _os.write((const char*)ch.data(),sizeof(unsigned long long)*ch.size());
+  } else {
+    _os.write((const char*)&head,sizeof(head));
+  }
+}
+void VTUWriter::append(const void* data,size_t bytes) {
+  const char* p=(const char*)data;
+  while(bytes>0) {
+    size_t n=std::min(bytes,blockSize-_block.size());
+    _block.insert(_block.end(),p,p+n);
+    p+=n;
+    bytes-=n;
+    _appended+=n;
+    if(_block.size() == blockSize)
+      flushBlock();
+  }
+}
+void VTUWriter::flushBlock() {
+  if(_block.empty())
+    return;
+#ifdef WITH_ZLIB
+  if(_compress) {
+    uLongf clen=compressBound(_block.size());
+    _cblock.resize(clen);
+    compress2((Bytef*)_cblock.data(),&clen,(const Bytef*)_block.data(),_block.size(),Z_BEST_SPEED);
+    _os.write(_cblock.data(),clen);
+    _csizes.push_back(clen);
+    _block.clear();
+    return;
+  }
+#endif
+  _os.write(_block.data(),_block.size());
+  _block.clear();
+}
+void VTUWriter::endArray() {
+  if(!_inArray)
+    return;
+  flushBlock();
+  _inArray=false;
+  //the size slots were reserved for the declared bytes, a mismatch leaves the array unreadable
+  if(_appended != _arrayBytes) {
+    printf("\033[31m-- vtu array %s : %zu bytes declared, %zu written\033[0m\n",_arrays.back()._name.c_str(),_arrayBytes,_appended);
+    _failed=true;
+  }
+  //more sizes than reserved slots would overwrite the compressed blocks
+  size_t nreserved=(_arrayBytes+blockSize-1)/blockSize;
+  if(_compress && _csizes.size() <= nreserved) {
+    std::vector<unsigned long long> ch;
+    ch.push_back(_csizes.size());
+    ch.push_back(blockSize);
+    ch.push_back(_appended%blockSize);
+    ch.insert(ch.end(),_csizes.begin(),_csizes.end());
+    std::streampos end=_os.tellp();
+    _os.seekp(_arrayBegin);
+    _os.write((const char*)ch.data(),sizeof(unsigned long long)*ch.size());
+    _os.seekp(end);
+  }
+}
+void VTUWriter::close() {
+  if(_closed)
+    return;
+  endArray();
+  _closed=true;
+  _os << "\n  </AppendedData>\n</VTKFile>\n";
+
+  std::ostringstream hs;
+  hs << "<?xml version=\"1.0\"?>\n";
+  hs << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\"";
+  if(_compress)
+    hs << " compressor=\"vtkZLibDataCompressor\"";
+  hs << ">\n";
+  hs << "  <UnstructuredGrid>\n";
+  hs << "    <Piece NumberOfPoints=\"" << _nrPoint << "\" NumberOfCells=\"" << _nrCell << "\">\n";
+  for(int s=POINTS; s<=POINT_DATA; s++) {
+    hs << "      <" << sectionName((Section)s) << ">\n";
+    for(const ArrayInfo& info:_arrays) {
+      if(info._sec != s)
+        continue;
+      hs << "        <DataArray type=\"" << info._type << "\" Name=\"" << info._name << "\" NumberOfComponents=\"" << info._ncomp
+         << "\" format=\"appended\" offset=\"" << info._offset << "\"/>\n";
+    }
+    hs << "      </" << sectionName((Section)s) << ">\n";
+  }
+  hs << "    </Piece>\n";
+  hs << "  </UnstructuredGrid>\n";
+  hs << "  <AppendedData encoding=\"raw\">\n";
+  std::string head=hs.str();
+  if(head.size()+1 > headerReserve) {
+    printf("\033[31m-- vtu header exceeds reserved size\033[0m\n");
+    _failed=true;
+    _os.close();
+    return;
+  }
+  //pad with white space, the appended data starts right after '_'
+  head.resize(headerReserve-1,' ');
+  head.push_back('_');
+  _os.seekp(0);
+  _os.write(head.data(),head.size());
+  _os.close();
+}
+}
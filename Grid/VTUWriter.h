@@ -0,0 +1,55 @@
+#ifndef VTU_WRITER_H
+#define VTU_WRITER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace grid {
+// Streaming writer of VTK XML UnstructuredGrid (.vtu) with appended raw binary arrays.
+// Arrays are written one after another through beginArray / append / endArray, only one block
+// (blockSize bytes) is buffered at a time. The XML header is written last into a reserved region
+// at the file start, so offsets and compressed sizes need not be known in advance.
+// Compression (vtkZLibDataCompressor) requires the build WITH_ZLIB.
+class VTUWriter {
+ public:
+  enum Section {
+    POINTS,
+    CELLS,
+    CELL_DATA,
+    POINT_DATA
+  };
+  static constexpr size_t blockSize=1<<20;
+  static constexpr size_t headerReserve=1<<14;
+  VTUWriter(const std::string& path,size_t nrPoint,size_t nrCell,bool compress);
+  ~VTUWriter();
+  // false once a write failed or an array did not get its declared bytes
+  bool good() const;
+  // type is a VTK type name (Float32, Int32, Int64, UInt8 ...), nbytes the total size of the array
+  void beginArray(Section sec,const std::string& name,const std::string& type,int ncomp,size_t nbytes);
+  void append(const void* data,size_t bytes);
+  template<typename T> void append(const T& val) {
+    append(&val,sizeof(T));
+  }
+  void endArray();
+  // write the header and close the file
+  void close();
+ private:
+  struct ArrayInfo {
+    Section _sec;
+    std::string _name,_type;
+    int _ncomp;
+    size_t _offset;
+  };
+  void flushBlock();
+  std::ofstream _os;
+  std::vector<ArrayInfo> _arrays;
+  std::vector<char> _block,_cblock;
+  std::vector<unsigned long long> _csizes;
+  size_t _nrPoint,_nrCell;
+  size_t _dataBegin,_arrayBegin,_arrayBytes,_appended;
+  bool _compress,_inArray,_closed,_failed;
+};
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include "async_writer_t.h"
+#include "projection.h"
+#include "binaryIO.h"
+#include "sparseVolume.h"
+
+using namespace grid;
+
+async_writer_t::async_writer_t(void) {
+  for (int i = 0; i < n_stage; i++) _free.push_back(i);
+}
+
+async_writer_t::~async_writer_t() {
+  flush();
+  {
+    std::lock_guard<std::mutex> lk(_mtx);
+    _stop = true;
+  }
+  _cv_ready.notify_all();
+  if (_worker.joinable()) _worker.join();
+}
+
+int async_writer_t::acquire(void) {
+  std::unique_lock<std::mutex> lk(_mtx);
+  _cv_free.wait(lk, [&] { return !_free.empty(); });
+  int slot = _free.front();
+  _free.pop_front();
+  _n_busy++;
+  return slot;
+}
+
+void async_writer_t::submit(int slot) {
+  {
+    std::lock_guard<std::mutex> lk(_mtx);
+    _ready.push_back(slot);
+    if (!_worker.joinable()) _worker = std::thread(&async_writer_t::run, this);
+  }
+  _cv_ready.notify_one();
+}
+
+void async_writer_t::run(void) {
+  while (true) {
+    int slot;
+    {
+      std::unique_lock<std::mutex> lk(_mtx);
+      _cv_ready.wait(lk, [&] { return _stop || !_ready.empty(); });
+      if (_ready.empty()) return;
+      slot = _ready.front();
+      _ready.pop_front();
+    }
+
+    process(_stage[slot]);
+
+    {
+      std::lock_guard<std::mutex> lk(_mtx);
+      _free.push_back(slot);
+      _n_busy--;
+    }
+    _cv_free.notify_one();
+    _cv_idle.notify_all();
+  }
+}
+
+void async_writer_t::process(staging_t& st) {
+  // a failed output must not bring down the optimization
+  try {
+    switch (st.type) {
+    case job_element_field:
+      writeSparseVolume(st.filename, *st.esat, st.ereso, st.box, st.eidmap, st.gsvalue);
+      break;
+    case job_support_force:
+      bio::write_vectors<double, 3>(st.filename, st.fs);
+      break;
+    }
+  }
+  catch (std::exception& e) {
+    printf("\033[31m-- failed to write %s : %s\033[0m\n", st.filename.c_str(), e.what());
+  }
+}
+
+void async_writer_t::flush(void) {
+  std::unique_lock<std::mutex> lk(_mtx);
+  _cv_idle.wait(lk, [&] { return _n_busy == 0; });
+}
+
+void async_writer_t::stageElementField(grid::HierarchyGrid& grds, const std::string& filename, const float* gsfield) {
+  Grid& g = *grds[0];
+  int slot = acquire();
+  staging_t& st = _stage[slot];
+  st.type = job_element_field;
+  st.filename = filename;
+  // assigning to the slot's copy reuses its storage
+  if (st.esat == nullptr) st.esat.reset(new BitSAT<unsigned int>(grds.elesatlist[0]));
+  else *st.esat = grds.elesatlist[0];
+  st.ereso = g._ereso;
+  for (int i = 0; i < 6; i++) (&st.box[0][0])[i] = (&g._box[0][0])[i];
+  st.eidmap.resize(g.n_elements);
+  gpu_manager_t::download_buf(st.eidmap.data(), g._gbuf.eidmap, sizeof(int) * g.n_elements);
+  st.gsvalue.resize(g.n_gselements);
+  gpu_manager_t::download_buf(st.gsvalue.data(), gsfield, sizeof(float) * g.n_gselements);
+  submit(slot);
+}
+
+void async_writer_t::writeDensity(grid::HierarchyGrid& grds, const std::string& filename) {
+  stageElementField(grds, filename, grds[0]->_gbuf.rho_e);
+}
+
+void async_writer_t::writeSensitivity(grid::HierarchyGrid& grds, const std::string& filename) {
+  stageElementField(grds, filename, grds[0]->_gbuf.g_sens);
+}
+
+void async_writer_t::writeSupportForce(grid::HierarchyGrid& grds, const std::string& filename) {
+  Grid& g = *grds[0];
+  int slot = acquire();
+  staging_t& st = _stage[slot];
+  st.type = job_support_force;
+  st.filename = filename;
+  double* fs[3];
+  Grid::getTempBufArray(fs, 3, n_loadnodes());
+  getForceSupport(g._gbuf.F, fs);
+  for (int i = 0; i < 3; i++) {
+    st.fs[i].resize(n_loadnodes());
+    gpu_manager_t::download_buf(st.fs[i].data(), fs[i], sizeof(double) * n_loadnodes());
+  }
+  submit(slot);
+}
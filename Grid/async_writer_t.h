@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef __ASYNC_WRITER_T_H
+#define __ASYNC_WRITER_T_H
+
+#include "Grid.h"
+#include "thread"
+#include "mutex"
+#include "condition_variable"
+#include "deque"
+#include "memory"
+
+// Writes per-iteration outputs on a background thread. Device buffers are downloaded into one of
+// n_stage host staging slots on the calling thread, decoding and file writing happen on the writer
+// thread. When all slots are busy the caller blocks, so staging memory stays bounded. The thread is
+// started by the first submitted output, so a static writer does not start it during static initialization.
+class async_writer_t {
+public:
+	static constexpr int n_stage = 2;
+
+private:
+	enum job_type {
+		job_element_field,
+		job_support_force
+	};
+
+	struct staging_t {
+		job_type type;
+		std::string filename;
+		// element field in gs order and element rank -> gs map
+		std::vector<float> gsvalue;
+		std::vector<int> eidmap;
+		// copy of the lattice, the grids may be cleared or rebuilt before the slot is written
+		std::unique_ptr<grid::BitSAT<unsigned int>> esat;
+		int ereso = 0;
+		float box[2][3];
+		std::vector<double> fs[3];
+	};
+
+	staging_t _stage[n_stage];
+	std::deque<int> _free;
+	std::deque<int> _ready;
+	int _n_busy = 0;
+	bool _stop = false;
+
+	std::mutex _mtx;
+	std::condition_variable _cv_free;
+	std::condition_variable _cv_ready;
+	std::condition_variable _cv_idle;
+	std::thread _worker;
+
+	int acquire(void);
+	void submit(int slot);
+	void stageElementField(grid::HierarchyGrid& grds, const std::string& filename, const float* gsfield);
+	void run(void);
+	void process(staging_t& st);
+
+public:
+	async_writer_t(void);
+	~async_writer_t();
+
+	// snapshot the density of the finest layer
+	void writeDensity(grid::HierarchyGrid& grds, const std::string& filename);
+
+	// snapshot the sensitivity of the finest layer
+	void writeSensitivity(grid::HierarchyGrid& grds, const std::string& filename);
+
+	// snapshot the support of the worst-case force on load nodes
+	void writeSupportForce(grid::HierarchyGrid& grds, const std::string& filename);
+
+	// block until all submitted outputs are written
+	void flush(void);
+};
+
+#endif
+
@@ -7,6 +7,10 @@
 #include "set"
 #include "list"
 #include "type_traits"
+#include "string"
+#include "cstring"
+#include "fstream"
+#include "iostream"
 
 namespace bio {
 
@@ -66,6 +70,46 @@ namespace bio {
 	//	return size_account;
 	//}
 	
+	// header leading every file written by bio, files without it are read as raw arrays of T
+	struct file_header_t {
+		char magic[4];
+		// see type_code
+		int type;
+		int elem_size;
+		// number of interleaved components per entry
+		int n_comp;
+		unsigned long long count;
+	};
+
+	constexpr char header_magic[4] = { 'B','I','O','1' };
+
+	template<typename T>
+	constexpr int type_code(void) {
+		if (std::is_same<T, float>::value) return 1;
+		if (std::is_same<T, double>::value) return 2;
+		if (std::is_same<T, int>::value) return 3;
+		if (std::is_same<T, unsigned int>::value) return 4;
+		if (std::is_same<T, char>::value) return 5;
+		if (std::is_same<T, unsigned char>::value) return 6;
+		if (std::is_same<T, long long>::value) return 7;
+		if (std::is_same<T, unsigned long long>::value) return 8;
+		return 0;
+	}
+
+	template<typename T>
+	file_header_t make_header(size_t count, int n_comp) {
+		file_header_t header;
+		memcpy(header.magic, header_magic, sizeof(header_magic));
+		header.type = type_code<T>();
+		header.elem_size = sizeof(T);
+		header.n_comp = n_comp;
+		header.count = count;
+		return header;
+	}
+
+	// entries per chunk when interleaving
+	constexpr size_t write_chunk = 1 << 16;
+
 	template<typename T, typename std::enable_if<std::is_scalar<T>::value, void*>::type = nullptr>
 	void write_vector(const std::string& filename, const std::vector<T>& datavector) {
 		std::ofstream ofs(filename, std::ios::binary);
@@ -73,7 +117,9 @@ namespace bio {
 			std::cout << "\033[31m" << "Cannot open file " << filename << "\033[0m" << std::endl;
 			return;
 		}
-		ofs.write((char*)&datavector[0], sizeof(T)*datavector.size());
+		file_header_t header = make_header<T>(datavector.size(), 1);
+		ofs.write((char*)&header, sizeof(header));
+		ofs.write((char*)datavector.data(), sizeof(T)*datavector.size());
 		ofs.close();
 	}
 
@@ -81,29 +127,96 @@ namespace bio {
 	template<typename T, int N, typename std::enable_if<std::is_scalar<T>::value, void*>::type = nullptr>
 	void write_vectors(const std::string& filename, const std::vector<T>(&datavectors)[N], bool transpose = false) {
 		std::ofstream ofs(filename, std::ios::binary);
-		int vecsize = datavectors->size();
-		for (int i = 0; i < datavectors->size(); i++) {
-			for (int j = 0; j < N; j++) {
-				ofs.write((char*)&datavectors[j][i], sizeof(T));
+		if (!ofs.is_open()) {
+			std::cout << "\033[31m" << "Cannot open file " << filename << "\033[0m" << std::endl;
+			return;
+		}
+		size_t vecsize = datavectors->size();
+		file_header_t header = make_header<T>(vecsize, N);
+		ofs.write((char*)&header, sizeof(header));
+		// interleave a chunk in memory and write it at once
+		std::vector<T> chunk((std::min)(vecsize, write_chunk) * N);
+		for (size_t base = 0; base < vecsize; base += write_chunk) {
+			size_t n = (std::min)(write_chunk, vecsize - base);
+			for (size_t i = 0; i < n; i++) {
+				for (int j = 0; j < N; j++) {
+					chunk[i * N + j] = datavectors[j][base + i];
+				}
 			}
+			ofs.write((char*)chunk.data(), sizeof(T) * n * N);
 		}
 		ofs.close();
 	}
 
+	// read the whole file, n_comp is set to the number of interleaved components (1 for raw files),
+	// has_header tells whether the file carried a header, i.e. whether n_comp comes from the file
 	template<typename T, typename std::enable_if<std::is_scalar<T>::value, void*>::type = nullptr>
-	bool read_vector(const std::string& filename, std::vector<T>& datavector) {
+	bool read_vector(const std::string& filename, std::vector<T>& datavector, int* n_comp = nullptr, bool* has_header = nullptr) {
 		std::ifstream ifs(filename, std::ios::binary);
 		if (!ifs.is_open()) return false;
 		ifs.seekg(0, std::ios::end);
 		size_t filelen = ifs.tellg();
 		ifs.seekg(0, std::ios::beg);
-		datavector.resize(filelen / sizeof(T));
-		for (int i = 0; i < datavector.size(); i++) {
-			T value = 0;
-			ifs.read((char*)&value, sizeof(T));
-			datavector[i] = value;
+
+		file_header_t header;
+		size_t datalen = filelen;
+		int ncomp = 1;
+		bool headered = false;
+		if (filelen >= sizeof(header) && ifs.read((char*)&header, sizeof(header)) && memcmp(header.magic, header_magic, sizeof(header_magic)) == 0) {
+			if (header.elem_size != sizeof(T) || (header.type != 0 && type_code<T>() != 0 && header.type != type_code<T>())) {
+				std::cout << "\033[31m" << "Unmatched data type in file " << filename << "\033[0m" << std::endl;
+				return false;
+			}
+			if (header.n_comp <= 0) {
+				std::cout << "\033[31m" << "Invalid component count in file " << filename << "\033[0m" << std::endl;
+				return false;
+			}
+			datalen = filelen - sizeof(header);
+			// compare by division, a corrupted count must not wrap the byte size
+			if (header.count > datalen / (size_t(header.n_comp) * sizeof(T))) {
+				std::cout << "\033[31m" << "Truncated file " << filename << "\033[0m" << std::endl;
+				return false;
+			}
+			datalen = header.count * header.n_comp * sizeof(T);
+			ncomp = header.n_comp;
+			headered = true;
+		}
+		else {
+			// legacy file without header
+			ifs.clear();
+			ifs.seekg(0, std::ios::beg);
+		}
+
+		datavector.resize(datalen / sizeof(T));
+		if (!ifs.read((char*)datavector.data(), datavector.size() * sizeof(T))) {
+			std::cout << "\033[31m" << "Failed to read file " << filename << "\033[0m" << std::endl;
+			return false;
 		}
 		ifs.close();
+		if (n_comp != nullptr) *n_comp = ncomp;
+		if (has_header != nullptr) *has_header = headered;
+		return true;
+	}
+
+	// read a file written by write_vectors and split the components
+	template<typename T, int N, typename std::enable_if<std::is_scalar<T>::value, void*>::type = nullptr>
+	bool read_vectors(const std::string& filename, std::vector<T>(&datavectors)[N]) {
+		std::vector<T> data;
+		int ncomp = N;
+		bool headered = false;
+		if (!read_vector(filename, data, &ncomp, &headered)) return false;
+		// raw files carry no component count, they are trusted to be interleaved by N
+		if ((headered && ncomp != N) || data.size() % N != 0) {
+			std::cout << "\033[31m" << "Unmatched component number in file " << filename << "\033[0m" << std::endl;
+			return false;
+		}
+		size_t vecsize = data.size() / N;
+		for (int j = 0; j < N; j++) datavectors[j].resize(vecsize);
+		for (size_t i = 0; i < vecsize; i++) {
+			for (int j = 0; j < N; j++) {
+				datavectors[j][i] = data[i * N + j];
+			}
+		}
 		return true;
 	}
 };
@@ -0,0 +1,336 @@
+#include "capture.h"
+#include "projection.h"
+#include "cstring"
+#include "cstdio"
+#include "map"
+#include "snippet.h"
+
+using namespace grid;
+
+struct capture_header_t {
+  char magic[8];
+  int version;
+  int itn;
+  int mode;
+  int n_layer;
+  int skiplayer;
+  float youngs_modulu;
+  float poisson_ratio;
+  float power_penalty;
+  // lattices of genFromLattice and load nodes of the finest layer
+  int n_lattice;
+  int n_loadnode;
+};
+
+struct capture_layer_t {
+  int layer;
+  int dummy;
+  int ereso;
+  int n_vertices;
+  int n_elements;
+  int n_gsvertices;
+  int n_gselements;
+  int nword_ebits;
+  int gs_num[8];
+  float box[2][3];
+  int n_buf;
+};
+
+struct capture_buf_t {
+  char name[64];
+  unsigned long long bytes;
+};
+
+struct capture_lattice_t {
+  unsigned long long nword_ebits;
+  unsigned long long nword_vbits;
+};
+
+static const char capture_magic[8] = { 'H','E','X','C','A','P','T','\0' };
+
+static const int capture_version = 2;
+
+bool writeCapture(const std::string& filename, int itn) {
+  capture_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, capture_magic, sizeof(capture_magic));
+  header.version = capture_version;
+  header.itn = itn;
+  header.mode = grids._mode;
+  header.n_layer = grids.n_grid();
+  header.skiplayer = grids[0]->is_skip();
+  header.youngs_modulu = params.youngs_modulu;
+  header.poisson_ratio = params.poisson_ratio;
+  header.power_penalty = params.power_penalty;
+  header.n_lattice = grids.elesatlist.size();
+  header.n_loadnode = n_loadnodes();
+
+  std::vector<int> sweeps(2 * header.n_layer);
+  for (int i = 0; i < header.n_layer; i++) {
+    sweeps[i] = grids.pre_sweeps(i);
+    sweeps[header.n_layer + i] = grids.post_sweeps(i);
+  }
+
+  std::string tmpfile = filename + ".tmp";
+  FILE* fp = fopen(tmpfile.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("\033[31m-- cannot open capture file %s\033[0m\n", tmpfile.c_str());
+    return false;
+  }
+
+  bool suc = true;
+  auto put = [&](const void* data, size_t bytes) {
+    if (bytes == 0 || !suc) return;
+    suc = fwrite(data, 1, bytes, fp) == bytes;
+  };
+
+  put(&header, sizeof(header));
+  put(sweeps.data(), sizeof(int) * sweeps.size());
+
+  size_t total = 0;
+  std::vector<char> hostbuf;
+  for (int i = 0; i < header.n_layer && suc; i++) {
+    Grid& g = *grids[i];
+    std::vector<Grid::gbuf_entry_t> bufs;
+    if (!g.is_dummy()) {
+      for (auto& b : g.listBuffers()) {
+        if (*b.ptr != nullptr && b.bytes > 0) bufs.push_back(b);
+      }
+    }
+
+    capture_layer_t lh;
+    memset(&lh, 0, sizeof(lh));
+    lh.layer = g._layer;
+    lh.dummy = g.is_dummy();
+    lh.ereso = g._ereso;
+    lh.n_vertices = g.n_vertices;
+    lh.n_elements = g.n_elements;
+    lh.n_gsvertices = g.n_gsvertices;
+    lh.n_gselements = g.n_gselements;
+    lh.nword_ebits = g._gbuf.nword_ebits;
+    memcpy(lh.gs_num, g.gs_num, sizeof(lh.gs_num));
+    memcpy(lh.box, g._box, sizeof(lh.box));
+    lh.n_buf = bufs.size();
+    put(&lh, sizeof(lh));
+
+    for (auto& b : bufs) {
+      capture_buf_t bh;
+      memset(&bh, 0, sizeof(bh));
+      strncpy(bh.name, b.name.c_str(), sizeof(bh.name) - 1);
+      bh.bytes = b.bytes;
+      hostbuf.resize(b.bytes);
+      gpu_manager_t::download_buf(hostbuf.data(), *b.ptr, b.bytes);
+      put(&bh, sizeof(bh));
+      put(hostbuf.data(), b.bytes);
+      total += b.bytes;
+    }
+  }
+
+  for (int i = 0; i < header.n_lattice; i++) {
+    auto& ebits = grids.elesatlist[i]._bitArray;
+    auto& vbits = grids.vrtsatlist[i]._bitArray;
+    capture_lattice_t lt = { ebits.size(), vbits.size() };
+    put(&lt, sizeof(lt));
+    put(ebits.data(), sizeof(unsigned int) * ebits.size());
+    put(vbits.data(), sizeof(unsigned int) * vbits.size());
+  }
+
+  // load nodes in gs order with position, normal and preload, so the projection is set up without the mesh
+  std::vector<Eigen::Matrix<double, 3, 1>> loadgeo[3];
+  getLoadGeometry(loadgeo[0], loadgeo[1], loadgeo[2]);
+  put(getLoadNodes().data(), sizeof(int) * header.n_loadnode);
+  std::vector<double> flat(3 * header.n_loadnode);
+  for (int k = 0; k < 3; k++) {
+    for (int i = 0; i < header.n_loadnode; i++) {
+      for (int j = 0; j < 3; j++) flat[i * 3 + j] = loadgeo[k][i][j];
+    }
+    put(flat.data(), sizeof(double) * flat.size());
+  }
+
+  suc = suc && snippet::sync_file(fp);
+  suc = fclose(fp) == 0 && suc;
+  if (!suc || rename(tmpfile.c_str(), filename.c_str()) != 0) {
+    printf("\033[31m-- failed to write capture %s\033[0m\n", filename.c_str());
+    remove(tmpfile.c_str());
+    return false;
+  }
+
+  printf("-- solver state at iter %d captured to %s (%zu MB)\n", itn, filename.c_str(), total / 1024 / 1024);
+  return true;
+}
+
+bool readCapture(const std::string& filename, int* itn) {
+  snippet::mapped_file_t file;
+  if (!file.open(filename, snippet::mapped_file_t::sequential)) {
+    printf("\033[31m-- cannot open capture file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  size_t filesize = file.size();
+  if (filesize < sizeof(capture_header_t)) {
+    printf("\033[31m-- invalid capture file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+
+  const char* pdata = file.data();
+  size_t offset = 0;
+  bool truncated = false;
+  // next bytes of the mapping, nullptr past its end
+  auto take = [&](size_t bytes) -> const char* {
+    if (offset + bytes > filesize) {
+      truncated = true;
+      return nullptr;
+    }
+    const char* p = pdata + offset;
+    offset += bytes;
+    return p;
+  };
+
+  capture_header_t header;
+  memcpy(&header, take(sizeof(header)), sizeof(header));
+  if (memcmp(header.magic, capture_magic, sizeof(capture_magic)) != 0 || header.version != capture_version
+    || header.n_layer <= 0 || header.n_lattice < 0 || header.n_loadnode < 0) {
+    printf("\033[31m-- %s is not a capture file\033[0m\n", filename.c_str());
+    return false;
+  }
+
+  const int* psweeps = (const int*)take(sizeof(int) * 2 * header.n_layer);
+
+  grids.clear();
+  gpu_manager_t& gm = grids.get_gmem();
+
+  bool valid = psweeps != nullptr;
+  std::vector<Grid*> layers;
+  for (int i = 0; i < header.n_layer && valid; i++) {
+    const char* plh = take(sizeof(capture_layer_t));
+    if (plh == nullptr) {
+      valid = false;
+      break;
+    }
+    capture_layer_t lh;
+    memcpy(&lh, plh, sizeof(lh));
+
+    Grid* g = new Grid();
+    layers.push_back(g);
+    g->_layer = lh.layer;
+    g->_ereso = lh.ereso;
+    g->n_vertices = lh.n_vertices;
+    g->n_elements = lh.n_elements;
+    g->n_gsvertices = lh.n_gsvertices;
+    g->n_gselements = lh.n_gselements;
+    g->_gbuf.nword_ebits = lh.nword_ebits;
+    memcpy(g->gs_num, lh.gs_num, sizeof(lh.gs_num));
+    memcpy(g->_box, lh.box, sizeof(lh.box));
+    if (lh.dummy) g->set_dummy();
+    if (header.skiplayer) g->set_skip();
+    if (lh.dummy) continue;
+    g->_name = "[" + std::to_string(lh.layer) + "]";
+
+    std::map<std::string, Grid::gbuf_entry_t> entries;
+    for (auto& b : g->listBuffers()) entries[b.name] = b;
+
+    for (int k = 0; k < lh.n_buf; k++) {
+      const char* pbh = take(sizeof(capture_buf_t));
+      if (pbh == nullptr) {
+        valid = false;
+        break;
+      }
+      capture_buf_t bh;
+      memcpy(&bh, pbh, sizeof(bh));
+      bh.name[sizeof(bh.name) - 1] = '\0';
+      auto it = entries.find(bh.name);
+      const char* pbuf = take(bh.bytes);
+      if (pbuf == nullptr) {
+        valid = false;
+        break;
+      }
+      if (it == entries.end() || it->second.bytes != bh.bytes) {
+        printf("\033[31m-- capture buffer %s does not match layer %d\033[0m\n", bh.name, lh.layer);
+        valid = false;
+        break;
+      }
+      // copy mapped pages to device directly
+      mem::tag memtag(it->second.cat, lh.layer);
+      *it->second.ptr = gm.add_buf(bh.name, bh.bytes, pbuf, bh.bytes);
+    }
+  }
+
+  std::vector<BitSAT<unsigned int>> elesat, vrtsat;
+  for (int i = 0; i < header.n_lattice && valid; i++) {
+    const char* plt = take(sizeof(capture_lattice_t));
+    if (plt == nullptr) {
+      valid = false;
+      break;
+    }
+    capture_lattice_t lt;
+    memcpy(&lt, plt, sizeof(lt));
+    const unsigned int* pebits = (const unsigned int*)take(sizeof(unsigned int) * lt.nword_ebits);
+    const unsigned int* pvbits = (const unsigned int*)take(sizeof(unsigned int) * lt.nword_vbits);
+    if (pebits == nullptr || pvbits == nullptr) {
+      valid = false;
+      break;
+    }
+    elesat.emplace_back(std::vector<unsigned int>(pebits, pebits + lt.nword_ebits));
+    vrtsat.emplace_back(std::vector<unsigned int>(pvbits, pvbits + lt.nword_vbits));
+  }
+
+  std::vector<int> loadnodes;
+  std::vector<Eigen::Matrix<double, 3, 1>> loadgeo[3];
+  if (valid) {
+    const int* pnodes = (const int*)take(sizeof(int) * header.n_loadnode);
+    const char* pgeo = take(sizeof(double) * 9 * header.n_loadnode);
+    if (pnodes != nullptr && pgeo != nullptr) {
+      loadnodes.assign(pnodes, pnodes + header.n_loadnode);
+      for (int k = 0; k < 3; k++) {
+        loadgeo[k].resize(header.n_loadnode);
+        for (int i = 0; i < header.n_loadnode; i++) {
+          memcpy(loadgeo[k][i].data(), pgeo + sizeof(double) * 3 * (k * header.n_loadnode + i), sizeof(double) * 3);
+        }
+      }
+    } else {
+      valid = false;
+    }
+  }
+
+  if (truncated) {
+    printf("\033[31m-- capture file %s is truncated\033[0m\n", filename.c_str());
+  } else if (valid && offset != filesize) {
+    printf("\033[31m-- capture file %s has trailing data\033[0m\n", filename.c_str());
+    valid = false;
+  }
+
+  if (valid) {
+    grids.adoptLayers(layers, header.skiplayer);
+    grids.set_sweeps(std::vector<int>(psweeps, psweeps + header.n_layer),
+      std::vector<int>(psweeps + header.n_layer, psweeps + 2 * header.n_layer));
+    grids.setMode(Mode(header.mode));
+    params.youngs_modulu = header.youngs_modulu;
+    params.poisson_ratio = header.poisson_ratio;
+    params.power_penalty = header.power_penalty;
+    uploadTemplateMatrix();
+
+    grids.elesatlist = std::move(elesat);
+    grids.vrtsatlist = std::move(vrtsat);
+    for (int i = 0; i < grids.elesatlist.size(); i++) {
+      size_t nword = grids.elesatlist[i]._bitArray.size() + grids.elesatlist[i]._chunkSat.size()
+        + grids.vrtsatlist[i]._bitArray.size() + grids.vrtsatlist[i]._chunkSat.size();
+      mem::track("[" + std::to_string(i) + "] lattice bits", mem::topology, mem::host, sizeof(unsigned int) * nword, i);
+    }
+
+    // the projection of computeProjectionMatrix, from the captured id map and load nodes
+    Grid& g = *layers[0];
+    if (!grids.vrtsatlist.empty() && !g.is_dummy()) {
+      std::vector<int> vlexi2gs(g.n_vertices);
+      gpu_manager_t::download_buf(vlexi2gs.data(), g._gbuf.vidmap, sizeof(int) * g.n_vertices);
+      setNodes(grids.vrtsatlist[0], g._ereso + 1, vlexi2gs, g._gbuf.vidmap, g._gbuf.vBitflag, g.n_gsvertices);
+      setLoadNodes(loadnodes, loadgeo[0], loadgeo[1], loadgeo[2]);
+    }
+    if (itn != nullptr) *itn = header.itn;
+  } else {
+    for (Grid* g : layers) delete g;
+    grids.clear();
+  }
+
+  if (valid) printf("-- restored %d layers captured at iter %d from %s\n", header.n_layer, header.itn, filename.c_str());
+
+  return valid;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+#include "optimization.h"
+#include "string"
+
+// Solver capture file layout (native endian) :
+//   capture_header_t | pre sweeps [n_layer] | post sweeps [n_layer]
+//   | per layer : capture_layer_t | (capture_buf_t | data [bytes]) * n_buf
+//   | per lattice : capture_lattice_t | element bits | vertex bits
+//   | load nodes [n_loadnode] | positions, normals, preloads [3][n_loadnode][3]
+// Every buffer the v-cycle kernels read is stored under its gpu_manager_t name : id maps, flags, topology,
+// stencils, densities and U / F / R of all layers, so a production state can be replayed without the mesh
+// and without running the optimization up to it. With the lattices and load nodes the optimization itself
+// can continue from a capture, which is how checkpoints restart without the grid build.
+
+// write the whole hierarchy at iteration itn to filename, the file is replaced atomically
+bool writeCapture(const std::string& filename, int itn);
+
+// clear the grids and restore the hierarchy of a capture. Mode, material and penalty are set, the template
+// matrix uploaded and the force projection set up from the load nodes, itn receives the captured iteration
+bool readCapture(const std::string& filename, int* itn = nullptr);
+
+#endif
+
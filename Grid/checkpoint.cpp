@@ -0,0 +1,196 @@
+#include "checkpoint.h"
+#include "projection.h"
+#include "cstring"
+#include "cstdio"
+#include "snippet.h"
+
+using namespace grid;
+
+struct checkpoint_header_t {
+  char magic[8];
+  int version;
+  int itn;
+  float Vgoal;
+  int ereso;
+  int n_gselements;
+  int n_gsvertices;
+  int n_loadnodes;
+  int n_record;
+  int n_stopcheck;
+  // fingerprint of the active element lattice
+  unsigned long long topo_hash;
+};
+
+static const char checkpoint_magic[8] = { 'H','E','X','C','K','P','T','\0' };
+
+static const int checkpoint_version = 1;
+
+// FNV-1a over the element bit array of the finest layer
+static unsigned long long topologyHash(void) {
+  auto& bits = grids.elesatlist[0]._bitArray;
+  unsigned long long h = 1469598103934665603ull;
+  const unsigned char* p = (const unsigned char*)bits.data();
+  for (size_t i = 0; i < bits.size() * sizeof(unsigned int); i++) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static void fillHeader(checkpoint_header_t& header) {
+  Grid& g = *grids[0];
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+  header.version = checkpoint_version;
+  header.ereso = g._ereso;
+  header.n_gselements = g.n_gselements;
+  header.n_gsvertices = g.n_gsvertices;
+  header.n_loadnodes = n_loadnodes();
+  header.topo_hash = topologyHash();
+}
+
+bool writeCheckpoint(const std::string& filename, OptimizationState& state) {
+  Grid& g = *grids[0];
+
+  checkpoint_header_t header;
+  fillHeader(header);
+  header.itn = state.itn;
+  header.Vgoal = state.Vgoal;
+  header.n_record = state.cRecord.size();
+  std::vector<double> stophis = state.stop_check.getHistory();
+  header.n_stopcheck = stophis.size();
+
+  if (state.volRecord.size() != header.n_record || state.tRecord.size() != header.n_record) {
+    printf("\033[31m-- inconsistent optimization records, checkpoint skipped\033[0m\n");
+    return false;
+  }
+
+  std::vector<float> rhohost(g.n_gselements);
+  gpu_manager_t::download_buf(rhohost.data(), g._gbuf.rho_e, sizeof(float) * g.n_gselements);
+  std::vector<double> vhost(g.n_gsvertices);
+  std::vector<double> fs[3];
+  for (int i = 0; i < 3; i++) {
+    fs[i].resize(header.n_loadnodes);
+    gpu_manager_t::download_buf(fs[i].data(), g.getSupportForce()[i], sizeof(double) * header.n_loadnodes);
+  }
+
+  // write to a temporary file in the same directory and rename it, a crash never leaves a truncated checkpoint
+  std::string tmpfile = filename + ".tmp";
+  FILE* fp = fopen(tmpfile.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("\033[31m-- cannot open checkpoint file %s\033[0m\n", tmpfile.c_str());
+    return false;
+  }
+
+  bool suc = true;
+  auto put = [&](const void* data, size_t bytes) {
+    if (bytes == 0 || !suc) return;
+    suc = fwrite(data, 1, bytes, fp) == bytes;
+  };
+
+  put(&header, sizeof(header));
+  put(state.cRecord.data(), sizeof(double) * header.n_record);
+  put(state.volRecord.data(), sizeof(double) * header.n_record);
+  put(state.tRecord.data(), sizeof(double) * header.n_record);
+  put(stophis.data(), sizeof(double) * stophis.size());
+  put(rhohost.data(), sizeof(float) * rhohost.size());
+  for (int i = 0; i < 3; i++) {
+    gpu_manager_t::download_buf(vhost.data(), g.getDisplacement()[i], sizeof(double) * g.n_gsvertices);
+    put(vhost.data(), sizeof(double) * vhost.size());
+  }
+  for (int i = 0; i < 3; i++) {
+    gpu_manager_t::download_buf(vhost.data(), g.getForce()[i], sizeof(double) * g.n_gsvertices);
+    put(vhost.data(), sizeof(double) * vhost.size());
+  }
+  for (int i = 0; i < 3; i++) {
+    put(fs[i].data(), sizeof(double) * fs[i].size());
+  }
+
+  suc = suc && snippet::sync_file(fp);
+  suc = fclose(fp) == 0 && suc;
+  if (!suc || rename(tmpfile.c_str(), filename.c_str()) != 0) {
+    printf("\033[31m-- failed to write checkpoint %s\033[0m\n", filename.c_str());
+    remove(tmpfile.c_str());
+    return false;
+  }
+
+  printf("-- checkpoint at iter %d written to %s\n", state.itn, filename.c_str());
+  return true;
+}
+
+bool readCheckpoint(const std::string& filename, OptimizationState& state) {
+  Grid& g = *grids[0];
+
+  snippet::mapped_file_t file;
+  if (!file.open(filename, snippet::mapped_file_t::sequential)) {
+    printf("\033[31m-- cannot open checkpoint file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  size_t filesize = file.size();
+  if (filesize < sizeof(checkpoint_header_t)) {
+    printf("\033[31m-- invalid checkpoint file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+
+  const char* pdata = file.data();
+  checkpoint_header_t header;
+  memcpy(&header, pdata, sizeof(header));
+
+  checkpoint_header_t expect;
+  fillHeader(expect);
+
+  bool valid = memcmp(header.magic, checkpoint_magic, sizeof(checkpoint_magic)) == 0 && header.version == checkpoint_version;
+  if (!valid) {
+    printf("\033[31m-- %s is not a checkpoint file\033[0m\n", filename.c_str());
+  }
+  else if (header.ereso != expect.ereso || header.n_gselements != expect.n_gselements || header.n_gsvertices != expect.n_gsvertices
+    || header.n_loadnodes != expect.n_loadnodes || header.topo_hash != expect.topo_hash) {
+    printf("\033[31m-- checkpoint was written on a different grid (reso %d, %d elements)\033[0m\n", header.ereso, header.n_gselements);
+    valid = false;
+  }
+
+  size_t expect_size = sizeof(header)
+    + sizeof(double) * (3 * size_t(header.n_record) + header.n_stopcheck)
+    + sizeof(float) * size_t(header.n_gselements)
+    + sizeof(double) * 6 * size_t(header.n_gsvertices)
+    + sizeof(double) * 3 * size_t(header.n_loadnodes);
+  if (valid && filesize != expect_size) {
+    printf("\033[31m-- checkpoint file %s is truncated\033[0m\n", filename.c_str());
+    valid = false;
+  }
+
+  if (valid) {
+    const double* precord = (const double*)(pdata + sizeof(header));
+    int nrec = header.n_record;
+    state.cRecord.assign(precord, precord + nrec);
+    state.volRecord.assign(precord + nrec, precord + 2 * nrec);
+    state.tRecord.assign(precord + 2 * nrec, precord + 3 * nrec);
+    const double* pstop = precord + 3 * nrec;
+    valid = state.stop_check.setHistory(pstop, header.n_stopcheck);
+    if (!valid) printf("\033[31m-- checkpoint convergence history does not match\033[0m\n");
+
+    // copy mapped pages to device directly
+    const char* pbuf = (const char*)(pstop + header.n_stopcheck);
+    gpu_manager_t::upload_buf(g._gbuf.rho_e, pbuf, sizeof(float) * g.n_gselements);
+    pbuf += sizeof(float) * g.n_gselements;
+    for (int i = 0; i < 3; i++) {
+      gpu_manager_t::upload_buf(g.getDisplacement()[i], pbuf, sizeof(double) * g.n_gsvertices);
+      pbuf += sizeof(double) * g.n_gsvertices;
+    }
+    for (int i = 0; i < 3; i++) {
+      gpu_manager_t::upload_buf(g.getForce()[i], pbuf, sizeof(double) * g.n_gsvertices);
+      pbuf += sizeof(double) * g.n_gsvertices;
+    }
+    for (int i = 0; i < 3; i++) {
+      gpu_manager_t::upload_buf(g.getSupportForce()[i], pbuf, sizeof(double) * header.n_loadnodes);
+      pbuf += sizeof(double) * header.n_loadnodes;
+    }
+
+    state.itn = header.itn;
+    state.Vgoal = header.Vgoal;
+  }
+
+  if (valid) printf("-- resumed from checkpoint %s at iter %d\n", filename.c_str(), state.itn);
+
+  return valid;
+}
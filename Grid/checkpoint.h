@@ -0,0 +1,21 @@
+#pragma once
+
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include "optimization.h"
+#include "string"
+
+// Checkpoint file layout (native endian) :
+//   checkpoint_header_t | cRecord | volRecord | tRecord | stop_check history
+//   | rho_e [n_gselements] | U[3] [n_gsvertices] | F[3] [n_gsvertices] | Fsupport[3] [n_loadnodes]
+// Vectors are stored in Grid (gs) order so they can be copied to device without remapping.
+
+// write state and finest grid buffers to filename, the file is replaced atomically
+bool writeCheckpoint(const std::string& filename, OptimizationState& state);
+
+// map the checkpoint and copy it back to the finest grid, the grid must be built from the same mesh and resolution
+bool readCheckpoint(const std::string& filename, OptimizationState& state);
+
+#endif
+
@@ -1,4 +1,5 @@
 #include "gpu_manager_t.h"
+#include "memory_registry.h"
 //#include "matlab_utils.h"
 std::string gpu_manager_t::make_anonymous_name(void) {
   char buf[512];
@@ -25,6 +26,33 @@ size_t gpu_manager_t::size(void) {
   return total_size;
 }
 
+void gpu_manager_t::clear(void) {
+  for (auto& b : gpu_buf) grid::mem::release(b._desc);
+  if (_recycle) {
+    for (auto& b : gpu_buf) {
+      size_t capacity = b._capacity;
+      _pool.emplace(capacity, b.release());
+    }
+  }
+  gpu_buf.clear();
+  track_pool();
+}
+
+void gpu_manager_t::track_pool(void) {
+  grid::mem::track("gpu recycle pool", grid::mem::other, grid::mem::device, pool_size());
+}
+
+void gpu_manager_t::enable_recycle(bool recycle) {
+  _recycle = recycle;
+  if (!_recycle) trim();
+}
+
+size_t gpu_manager_t::pool_size(void) {
+  size_t total_size = 0;
+  for (auto& p : _pool) total_size += p.first;
+  return total_size;
+}
+
 void gpu_manager_t::pass_dev_buf_to_matlab(const char*name, float* dev_ptr, size_t n) {
 #ifdef ENABLE_MATLAB
   Eigen::Matrix<float, -1, 1> mat_buf;
@@ -11,6 +11,7 @@
 //#include "mytimer.h"
 //#include "lib.cuh"
 #include "gpu_manager_t.h"
+#include "memory_registry.h"
 #include "cudaCommon.cuh"
 //#include "matlab_utils.h"
 
@@ -39,6 +40,15 @@ gpu_manager_t::gpu_buf_t::gpu_buf_t(const std::string& name, size_t size)
 	cuda_error_check;
 	_desc = name;
 	_size = size;
+	_capacity = size;
+}
+
+gpu_manager_t::gpu_buf_t::gpu_buf_t(const std::string& name, size_t size, void* ptr, size_t capacity)
+	:std::unique_ptr<void, std::function<void(void*)>>(ptr, deleteDeviceMemory)
+{
+	_desc = name;
+	_size = size;
+	_capacity = capacity;
 }
 
 gpu_manager_t::gpu_buf_t::gpu_buf_t(gpu_buf_t&& tmp_buf) noexcept
@@ -46,6 +56,7 @@ gpu_manager_t::gpu_buf_t::gpu_buf_t(gpu_buf_t&& tmp_buf) noexcept
 {
 	_desc = tmp_buf._desc;
 	_size = tmp_buf._size;
+	_capacity = tmp_buf._capacity;
 	cuda_error_check;
 }
 
@@ -54,6 +65,7 @@ gpu_manager_t::gpu_buf_t& gpu_manager_t::gpu_buf_t::operator=(gpu_buf_t&& tmp_bu
 	unique_void_ptr::operator=(std::move(tmp_buf));
 	_desc = tmp_buf._desc;
 	_size = tmp_buf._size;
+	_capacity = tmp_buf._capacity;
 	cuda_error_check;
 	return *this;
 }
@@ -72,6 +84,63 @@ void gpu_manager_t::download_buf(void* host_dst, const void* dev_src, size_t n)
 	cuda_error_check;
 }
 
+void gpu_manager_t::copy_buf(void* dst, const void* src, size_t n)
+{
+	if (dst == nullptr || n == 0) return;
+	cudaMemcpy(dst, src, n, cudaMemcpyDefault);
+	cuda_error_check;
+}
+
+void gpu_manager_t::copy_buf2D(void* dst, size_t dpitch, const void* src, size_t spitch, size_t width, size_t height)
+{
+	if (dst == nullptr || width == 0 || height == 0) return;
+	cudaMemcpy2D(dst, dpitch, src, spitch, width, height, cudaMemcpyDefault);
+	cuda_error_check;
+}
+
+size_t gpu_manager_t::device_memory(size_t* free_bytes)
+{
+	size_t free_mem = 0, total_mem = 0;
+	cudaMemGetInfo(&free_mem, &total_mem);
+	cuda_error_check;
+	if (free_bytes != nullptr) *free_bytes = free_mem;
+	return total_mem;
+}
+
+void gpu_manager_t::device_peak(double* gbps, double* fp64_gflops)
+{
+	int dev = device_id();
+	int memclock = 0, buswidth = 0, clock = 0, nsm = 0, major = 0, minor = 0;
+	cudaDeviceGetAttribute(&memclock, cudaDevAttrMemoryClockRate, dev);
+	cudaDeviceGetAttribute(&buswidth, cudaDevAttrGlobalMemoryBusWidth, dev);
+	cudaDeviceGetAttribute(&clock, cudaDevAttrClockRate, dev);
+	cudaDeviceGetAttribute(&nsm, cudaDevAttrMultiProcessorCount, dev);
+	cudaDeviceGetAttribute(&major, cudaDevAttrComputeCapabilityMajor, dev);
+	cudaDeviceGetAttribute(&minor, cudaDevAttrComputeCapabilityMinor, dev);
+	cuda_error_check;
+	// clocks in kHz, double data rate memory
+	if (gbps != nullptr) *gbps = 2. * memclock * 1e3 * (buswidth / 8) / 1e9;
+	// FP64 units per SM by architecture : half rate on the data center parts (x.0), 1/32 or 1/64 of FP32 on the others
+	int fp64_units = 2;
+	if (minor == 0 && major >= 9) fp64_units = 64;
+	else if (minor == 0 && major >= 6) fp64_units = 32;
+	else if (major <= 6) fp64_units = 4;
+	if (fp64_gflops != nullptr) *fp64_gflops = 2. * nsm * fp64_units * clock * 1e3 / 1e9;
+}
+
+int gpu_manager_t::device_id(void)
+{
+	int dev = 0;
+	cudaGetDevice(&dev);
+	return dev;
+}
+
+void gpu_manager_t::synchronize(void)
+{
+	cudaDeviceSynchronize();
+	cuda_error_check;
+}
+
 void* gpu_manager_t::add_buf(const std::string& name, size_t size, const void* src, size_t size_copy)
 {
 	void* ptr_buf;
@@ -99,7 +168,15 @@ void* gpu_manager_t::add_buf(const std::string& name, size_t size, const void* s
 		return ptr_buf;
 	}
 
-	gpu_buf.emplace_back(name, size);
+	auto pooled = _pool.lower_bound(size);
+	if (pooled != _pool.end() && pooled->first - size <= size / 4) {
+		gpu_buf.emplace_back(name, size, pooled->second, pooled->first);
+		_pool.erase(pooled);
+		track_pool();
+	} else {
+		gpu_buf.emplace_back(name, size);
+	}
+	grid::mem::track(name, grid::mem::current_category(), grid::mem::device, gpu_buf.rbegin()->_capacity, grid::mem::current_layer());
 	ptr_buf = gpu_buf.rbegin()->get_buf();
 	if (ptr_buf == nullptr) {
 		printf("\033[31m-- unexcepted error at file %s, line %d\n\033[0m", __FILE__, __LINE__);
@@ -157,6 +234,7 @@ void gpu_manager_t::delete_buf(const std::string& name)
 		return;
 	}
 	else {
+		grid::mem::release(k->_desc);
 		gpu_buf.erase(k);
 	}
 }
@@ -169,10 +247,20 @@ void gpu_manager_t::delete_buf(void * pbuf)
 		return;
 	}
 	else {
+		grid::mem::release(k->_desc);
 		gpu_buf.erase(k);
 	}
 }
 
+void gpu_manager_t::trim(void)
+{
+	for (auto& p : _pool) {
+		deleteDeviceMemory(p.second);
+	}
+	_pool.clear();
+	track_pool();
+}
+
 void gpu_manager_t::initMem(void* pdata, size_t len, char value)
 {
 	cudaMemset(pdata, value, len);
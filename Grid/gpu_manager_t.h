@@ -4,6 +4,7 @@
 #include "memory"
 #include "functional"
 #include "optional"
+#include "map"
 //#include "mycommon.h"
 
 
@@ -17,10 +18,15 @@ private:
 		std::string _desc;
 		//void* _buf;
 		size_t _size;
+		/* allocated size, larger than _size when the memory is taken from the recycle pool */
+		size_t _capacity;
 		friend class gpu_manager_t;
 	public:
 		gpu_buf_t(const std::string& name, size_t size);
 
+		/* adopt memory of capacity bytes from the recycle pool */
+		gpu_buf_t(const std::string& name, size_t size, void* ptr, size_t capacity);
+
 		gpu_buf_t(gpu_buf_t&& tmp_buf)noexcept;
 
 		gpu_buf_t& operator=(gpu_buf_t&& tmp_buf);
@@ -37,15 +43,40 @@ private:
 	/* GPU buf array */
 	std::vector<gpu_buf_t> gpu_buf;
 
+	/* memory released by clear() while recycling is enabled, capacity -> pointer */
+	std::multimap<size_t, void*> _pool;
+	bool _recycle = false;
+
+	/* report the bytes held by the recycle pool to the memory registry */
+	void track_pool(void);
+
 public:
 	/* upload data from host to GPU buf allocated */
 	static void upload_buf(void* dst, const void* src, size_t size);
 
 	static void download_buf(void* host_dst, const void* dev_src, size_t n);
 
+	/* copy between any two host or GPU addresses, the direction is inferred from the pointers */
+	static void copy_buf(void* dst, const void* src, size_t n);
+
+	/* copy height rows of width bytes, rows start every dpitch / spitch bytes at dst / src, direction inferred as in copy_buf */
+	static void copy_buf2D(void* dst, size_t dpitch, const void* src, size_t spitch, size_t width, size_t height);
+
+	/* total memory of the current GPU, free_bytes receives the memory not allocated yet */
+	static size_t device_memory(size_t* free_bytes = nullptr);
+
+	/* theoretical DRAM bandwidth (GB/s) and FP64 throughput (GFLOP/s, FMA counted as 2) of the current GPU from its clocks */
+	static void device_peak(double* gbps, double* fp64_gflops);
+
+	/* ordinal of the current GPU */
+	static int device_id(void);
+
+	/* wait for all work queued on the current GPU */
+	static void synchronize(void);
+
 	static void initMem(void* pdata, size_t len, char value = 0);
 
-	/* add a GPU buf with specified name and size */
+	/* add a GPU buf with specified name and size, it is tracked in the memory registry under the current grid::mem::tag */
 	void* add_buf(const std::string& name, size_t size, const void* src, size_t size_copy);
 
 	void* add_buf(const std::string& name, size_t size, const void* src = nullptr);
@@ -65,6 +96,18 @@ public:
 
 	size_t size(void);
 
+	/* release all GPU bufs, their memory goes to the recycle pool if recycling is enabled */
+	void clear(void);
+
+	/* keep memory released by clear() and hand it to later bufs of similar size (at most 25% larger) */
+	void enable_recycle(bool recycle);
+
+	/* free the memory held by the recycle pool */
+	void trim(void);
+
+	/* bytes held by the recycle pool */
+	size_t pool_size(void);
+
 	static void pass_dev_buf_to_matlab(const char*name, float* dev_ptr, size_t n);
 
 	static void pass_dev_buf_to_matlab(const char* name, const int* dev_ptr, size_t n);
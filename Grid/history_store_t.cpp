@@ -0,0 +1,287 @@
+#include "history_store_t.h"
+#include "algorithm"
+#include "cstring"
+#include "cmath"
+#include <filesystem>
+
+namespace {
+  const char history_magic[8] = "HEXHIST";
+
+  inline void putVarint(std::vector<uint8_t>& buf, uint32_t v) {
+    while (v >= 0x80) {
+      buf.push_back(uint8_t(v | 0x80));
+      v >>= 7;
+    }
+    buf.push_back(uint8_t(v));
+  }
+
+  inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      if (p >= end) return false;
+      uint8_t b = *p++;
+      v |= uint32_t(b & 0x7f) << shift;
+      if (!(b & 0x80)) return true;
+    }
+    return false;
+  }
+
+  inline uint32_t zigzag(int32_t v) { return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+
+  inline int32_t unzigzag(uint32_t v) { return int32_t(v >> 1) ^ -int32_t(v & 1); }
+
+  // [zero run][value] pairs, the trailing run of zeros has no value
+  void encodeDelta(const int32_t* d, size_t n, std::vector<uint8_t>& buf) {
+    size_t i = 0;
+    while (i < n) {
+      uint32_t run = 0;
+      while (i < n && d[i] == 0) { run++; i++; }
+      putVarint(buf, run);
+      if (i < n) putVarint(buf, zigzag(d[i++]));
+    }
+  }
+
+  bool decodeDelta(const uint8_t* p, const uint8_t* end, int32_t* q, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+      uint32_t run, v;
+      if (!getVarint(p, end, run)) return false;
+      i += run;
+      if (i > n) return false;
+      if (i == n) break;
+      if (!getVarint(p, end, v)) return false;
+      q[i++] += unzigzag(v);
+    }
+    return p == end;
+  }
+
+  // frame index of a mapped history, scanned from the frame headers if the writer did not close the file
+  void indexFrames(const char* data, size_t len, const history_header_t& header, std::vector<history_frame_t>& index, bool& closed) {
+    index.clear();
+    closed = header.index_offset != 0 && header.index_offset + header.n_frame * sizeof(history_frame_t) <= len;
+    if (closed) {
+      index.resize(header.n_frame);
+      memcpy(index.data(), data + header.index_offset, sizeof(history_frame_t) * header.n_frame);
+      return;
+    }
+    size_t pos = sizeof(history_header_t);
+    while (pos + sizeof(history_frame_t) <= len) {
+      history_frame_t frame;
+      memcpy(&frame, data + pos, sizeof(frame));
+      if (frame.offset != pos || pos + sizeof(frame) + frame.nbytes > len) break;
+      index.push_back(frame);
+      pos += sizeof(frame) + frame.nbytes;
+    }
+  }
+}
+
+history_writer_t::~history_writer_t() {
+  close();
+}
+
+bool history_writer_t::open(const std::string& filename, size_t n_value, int bits, float lo, float hi, int keyframe_interval) {
+  close();
+  if (bits != 8 && bits != 16) {
+    printf("\033[31m-- history supports 8 or 16 bit quantization\033[0m\n");
+    return false;
+  }
+  _fp = fopen(filename.c_str(), "wb");
+  if (_fp == nullptr) {
+    printf("\033[31m-- failed to open history %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  _filename = filename;
+  memset(&_header, 0, sizeof(_header));
+  memcpy(_header.magic, history_magic, sizeof(_header.magic));
+  _header.version = 1;
+  _header.bits = bits;
+  _header.n_value = n_value;
+  _header.range[0] = lo;
+  _header.range[1] = hi;
+  _header.keyframe_interval = std::max(keyframe_interval, 1);
+  fwrite(&_header, sizeof(_header), 1, _fp);
+  _index.clear();
+  _prev.assign(n_value, 0);
+  _cur.resize(n_value);
+  _raw_bytes = 0;
+  _stored_bytes = sizeof(_header);
+  _force_key = false;
+  return true;
+}
+
+bool history_writer_t::resume(const std::string& filename, size_t n_value, int last_itn) {
+  close();
+  size_t end = 0;
+  {
+    snippet::mapped_file_t file;
+    if (!file.open(filename)) {
+      printf("\033[31m-- cannot open history %s\033[0m\n", filename.c_str());
+      return false;
+    }
+    if (file.size() < sizeof(history_header_t)) {
+      printf("\033[31m-- history %s is truncated\033[0m\n", filename.c_str());
+      return false;
+    }
+    memcpy(&_header, file.data(), sizeof(_header));
+    if (memcmp(_header.magic, history_magic, sizeof(_header.magic)) != 0 || _header.version != 1 || _header.n_value != n_value) {
+      printf("\033[31m-- %s is not a history of %zu values\033[0m\n", filename.c_str(), n_value);
+      return false;
+    }
+    bool closed = false;
+    indexFrames(file.data(), file.size(), _header, _index, closed);
+
+    // frames are in iteration order, the ones after the checkpoint are recorded again
+    while (!_index.empty() && _index.back().itn > last_itn) _index.pop_back();
+    end = _index.empty() ? sizeof(history_header_t) : _index.back().offset + sizeof(history_frame_t) + _index.back().nbytes;
+  }
+
+  // the mapping is released before truncating, Windows refuses to resize a mapped file
+  std::error_code ec;
+  std::filesystem::resize_file(filename, end, ec);
+  if (!ec) _fp = fopen(filename.c_str(), "r+b");
+  // drop the index of a closed file and mark the header unfinished, so an interrupted run is scanned again
+  _header.n_frame = 0;
+  _header.index_offset = 0;
+  bool suc = _fp != nullptr && fwrite(&_header, sizeof(_header), 1, _fp) == 1;
+  if (!suc || fseek(_fp, end, SEEK_SET) != 0) {
+    printf("\033[31m-- failed to reopen history %s\033[0m\n", filename.c_str());
+    if (_fp != nullptr) fclose(_fp);
+    _fp = nullptr;
+    return false;
+  }
+  _filename = filename;
+  _prev.assign(n_value, 0);
+  _cur.resize(n_value);
+  _raw_bytes = sizeof(float) * n_value * _index.size();
+  _stored_bytes = end;
+  _force_key = true;
+  printf("-- history %s resumed after iter %d with %zu frames\n", filename.c_str(), last_itn, _index.size());
+  return true;
+}
+
+bool history_writer_t::append(int itn, const float* values) {
+  if (_fp == nullptr) return false;
+  size_t n = _header.n_value;
+  history_frame_t frame;
+  frame.itn = itn;
+  frame.keyframe = _force_key || _index.size() % _header.keyframe_interval == 0;
+  _force_key = false;
+  frame.range[0] = _header.range[0];
+  frame.range[1] = _header.range[1];
+  if (frame.range[0] == frame.range[1] && n > 0) {
+    auto mm = std::minmax_element(values, values + n);
+    frame.range[0] = *mm.first;
+    frame.range[1] = *mm.second;
+  }
+
+  // quantize, then difference against the previous frame (or zero for key frames)
+  double qmax = (1 << _header.bits) - 1;
+  double width = frame.range[1] - frame.range[0];
+  double scale = width > 0 ? qmax / width : 0;
+  for (size_t i = 0; i < n; i++) {
+    double q = std::round((values[i] - frame.range[0]) * scale);
+    _cur[i] = std::min(std::max(q, 0.), qmax);
+  }
+  if (frame.keyframe) std::fill(_prev.begin(), _prev.end(), 0);
+  for (size_t i = 0; i < n; i++) _prev[i] = _cur[i] - _prev[i];
+
+  _payload.clear();
+  encodeDelta(_prev.data(), n, _payload);
+  _prev.swap(_cur);
+
+  frame.offset = ftell(_fp);
+  frame.nbytes = _payload.size();
+  bool suc = fwrite(&frame, sizeof(frame), 1, _fp) == 1;
+  suc = suc && fwrite(_payload.data(), 1, _payload.size(), _fp) == _payload.size();
+  // keep frames readable if the run is interrupted
+  fflush(_fp);
+  if (!suc) {
+    printf("\033[31m-- failed to append to history %s\033[0m\n", _filename.c_str());
+    return false;
+  }
+  _index.push_back(frame);
+  _raw_bytes += sizeof(float) * n;
+  _stored_bytes += sizeof(frame) + _payload.size();
+  return true;
+}
+
+void history_writer_t::close(void) {
+  if (_fp == nullptr) return;
+  _header.index_offset = ftell(_fp);
+  _header.n_frame = _index.size();
+  fwrite(_index.data(), sizeof(history_frame_t), _index.size(), _fp);
+  fseek(_fp, 0, SEEK_SET);
+  fwrite(&_header, sizeof(_header), 1, _fp);
+  fclose(_fp);
+  _fp = nullptr;
+  _stored_bytes += sizeof(history_frame_t) * _index.size();
+  printf("-- history %s : %zu frames, %.1f%% of full snapshots\n", _filename.c_str(), _index.size(),
+    _raw_bytes == 0 ? 0. : 100. * _stored_bytes / _raw_bytes);
+}
+
+history_reader_t::~history_reader_t() {
+  close();
+}
+
+void history_reader_t::close(void) {
+  _file.close();
+  _index.clear();
+}
+
+bool history_reader_t::open(const std::string& filename) {
+  close();
+  if (!_file.open(filename)) {
+    printf("\033[31m-- cannot open history %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  if (_file.size() < sizeof(history_header_t)) {
+    printf("\033[31m-- history %s is truncated\033[0m\n", filename.c_str());
+    close();
+    return false;
+  }
+  const char* data = _file.data();
+  memcpy(&_header, data, sizeof(_header));
+  if (memcmp(_header.magic, history_magic, sizeof(_header.magic)) != 0 || _header.version != 1) {
+    printf("\033[31m-- %s is not a history file\033[0m\n", filename.c_str());
+    close();
+    return false;
+  }
+
+  bool closed = false;
+  indexFrames(data, _file.size(), _header, _index, closed);
+  if (!closed) {
+    // unfinished file, the frames were recovered by scanning
+    printf("-- history %s was not closed, recovered %zu frames\n", filename.c_str(), _index.size());
+  }
+  return true;
+}
+
+int history_reader_t::find(int itn) const {
+  for (int i = 0; i < _index.size(); i++) {
+    if (_index[i].itn == itn) return i;
+  }
+  return -1;
+}
+
+bool history_reader_t::read(int frame, std::vector<float>& values) const {
+  if (!_file.is_open() || frame < 0 || frame >= _index.size()) return false;
+  int key = frame;
+  while (key > 0 && !_index[key].keyframe) key--;
+
+  size_t n = _header.n_value;
+  std::vector<int32_t> q(n, 0);
+  const uint8_t* data = (const uint8_t*)_file.data();
+  for (int f = key; f <= frame; f++) {
+    const uint8_t* p = data + _index[f].offset + sizeof(history_frame_t);
+    if (!decodeDelta(p, p + _index[f].nbytes, q.data(), n)) {
+      printf("\033[31m-- corrupted history frame %d\033[0m\n", f);
+      return false;
+    }
+  }
+
+  const float* range = _index[frame].range;
+  double step = double(range[1] - range[0]) / ((1 << _header.bits) - 1);
+  values.resize(n);
+  for (size_t i = 0; i < n; i++) values[i] = range[0] + q[i] * step;
+  return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#ifndef __HISTORY_STORE_T_H
+#define __HISTORY_STORE_T_H
+
+#include "vector"
+#include "string"
+#include "cstdio"
+#include "cstdint"
+#include "snippet.h"
+
+/*
+  Per-iteration history of a fixed size float field.
+  file : | header | frame 0 | frame 1 | ... | index [n_frame] |
+  frame : | history_frame_t | payload |
+  Values are quantized to 8 or 16 bits over [range[0], range[1]] of the frame. A key frame stores its
+  quantized values, other frames store the difference to the previous frame, both as zigzag varints
+  where runs of zero are collapsed to a single varint count. Every keyframe_interval-th frame is a key
+  frame, so reconstructing any iteration decodes at most keyframe_interval frames.
+*/
+struct history_header_t {
+	char magic[8];
+	int32_t version;
+	int32_t bits;
+	uint64_t n_value;
+	// fixed quantization range, equal bounds mean a per frame [min, max] range
+	float range[2];
+	int32_t keyframe_interval;
+	int32_t reserved;
+	// written on close, 0 if the writer did not finish and the frames have to be scanned
+	uint64_t n_frame;
+	uint64_t index_offset;
+};
+
+struct history_frame_t {
+	int32_t itn;
+	int32_t keyframe;
+	float range[2];
+	// offset of this frame header in the file and payload size
+	uint64_t offset;
+	uint64_t nbytes;
+};
+
+class history_writer_t {
+	FILE* _fp = nullptr;
+	std::string _filename;
+	history_header_t _header;
+	std::vector<history_frame_t> _index;
+	std::vector<int32_t> _prev;
+	std::vector<int32_t> _cur;
+	std::vector<uint8_t> _payload;
+	size_t _raw_bytes = 0;
+	size_t _stored_bytes = 0;
+	// the previous frame is not known after resume, the next frame has to be a key frame
+	bool _force_key = false;
+
+public:
+	~history_writer_t();
+
+	// fixed range [lo, hi], lo == hi computes the range of each frame
+	bool open(const std::string& filename, size_t n_value, int bits = 16, float lo = 0, float hi = 0, int keyframe_interval = 32);
+
+	// reopen the history of an interrupted run for append, frames after iteration last_itn are dropped.
+	// Quantization and key frame interval are those of the file, the next appended frame is a key frame
+	bool resume(const std::string& filename, size_t n_value, int last_itn);
+
+	bool is_open(void) const { return _fp != nullptr; }
+
+	bool append(int itn, const float* values);
+
+	// write the frame index and header, print the compression ratio
+	void close(void);
+};
+
+class history_reader_t {
+	snippet::mapped_file_t _file;
+	history_header_t _header;
+	std::vector<history_frame_t> _index;
+
+public:
+	~history_reader_t();
+
+	bool open(const std::string& filename);
+
+	void close(void);
+
+	int n_frame(void) const { return _index.size(); }
+
+	size_t n_value(void) const { return _header.n_value; }
+
+	int itn(int frame) const { return _index[frame].itn; }
+
+	// frame holding iteration itn, -1 if it was not recorded
+	int find(int itn) const;
+
+	// reconstruct the values of a frame
+	bool read(int frame, std::vector<float>& values) const;
+};
+
+#endif
+
@@ -0,0 +1,257 @@
+#include "isosurface.h"
+#include "unordered_map"
+#include "fstream"
+#include "cstring"
+#include "omp.h"
+
+using namespace grid;
+
+// 6 tetrahedra around the diagonal 0-7 of a cube, corner k sits at (k & 1, k >> 1 & 1, k >> 2)
+static const int cube_tets[6][4] = {
+  {0,7,1,3}, {0,7,3,2}, {0,7,2,6}, {0,7,6,4}, {0,7,4,5}, {0,7,5,1}
+};
+
+namespace {
+  // samples are element centers, indexed on the lattice [-1, ereso]^3 so the surface closes at the border
+  struct sample_lattice_t {
+    const density_field_t& field;
+    int ereso;
+    long long S;
+
+    sample_lattice_t(const density_field_t& f) : field(f), ereso(f.ereso), S(f.ereso + 2) {}
+
+    float value(int x, int y, int z) const {
+      if (x < 0 || y < 0 || z < 0 || x >= ereso || y >= ereso || z >= ereso) return 0;
+      int eid = field.esat(x + size_t(y) * ereso + size_t(z) * ereso * ereso);
+      return eid == -1 ? 0 : field.rho[eid];
+    }
+
+    bool active(int x, int y, int z) const {
+      if (x < 0 || y < 0 || z < 0 || x >= ereso || y >= ereso || z >= ereso) return false;
+      return field.esat(x + size_t(y) * ereso + size_t(z) * ereso * ereso) != -1;
+    }
+
+    long long id(int x, int y, int z) const {
+      return (x + 1) + (y + 1) * S + (z + 1) * S * S;
+    }
+
+    void coord(long long sid, int p[3]) const {
+      p[0] = sid % S - 1; p[1] = sid / S % S - 1; p[2] = sid / S / S - 1;
+    }
+
+    // edge key = sample id of the lower end * 8 + offset bits (dx | dy << 1 | dz << 2)
+    long long edgeKey(const int pa[3], const int pb[3]) const {
+      const int* lo = pa;
+      if (pb[0] < pa[0] || pb[1] < pa[1] || pb[2] < pa[2]) lo = pb;
+      int dir = std::abs(pb[0] - pa[0]) | std::abs(pb[1] - pa[1]) << 1 | std::abs(pb[2] - pa[2]) << 2;
+      return id(lo[0], lo[1], lo[2]) * 8 + dir;
+    }
+
+    // crossing point of the edge in lattice coordinates
+    void crossing(long long key, float iso, double p[3]) const {
+      int pa[3], pb[3];
+      coord(key / 8, pa);
+      int dir = key % 8;
+      for (int k = 0; k < 3; k++) pb[k] = pa[k] + (dir >> k & 1);
+      float va = value(pa[0], pa[1], pa[2]);
+      float vb = value(pb[0], pb[1], pb[2]);
+      double t = (iso - va) / (vb - va);
+      for (int k = 0; k < 3; k++) p[k] = pa[k] + t * (pb[k] - pa[k]);
+    }
+  };
+}
+
+// emit triangles of one tetrahedron as edge keys, oriented from inside (value > iso) to outside
+static void marchTet(const sample_lattice_t& lat, float iso, const int pos[4][3], const float val[4], std::vector<long long>& tris) {
+  int in[4], out[4], nin = 0, nout = 0;
+  for (int i = 0; i < 4; i++) {
+    if (val[i] > iso) in[nin++] = i;
+    else out[nout++] = i;
+  }
+  if (nin == 0 || nout == 0) return;
+
+  // polygon vertices on edges crossing the surface, as (inside, outside) corner pairs
+  int poly[4][2];
+  int npoly = 3;
+  if (nin == 1) {
+    for (int i = 0; i < 3; i++) { poly[i][0] = in[0]; poly[i][1] = out[i]; }
+  }
+  else if (nin == 3) {
+    for (int i = 0; i < 3; i++) { poly[i][0] = in[i]; poly[i][1] = out[0]; }
+  }
+  else {
+    int quad[4][2] = { {in[0], out[0]}, {in[0], out[1]}, {in[1], out[1]}, {in[1], out[0]} };
+    memcpy(poly, quad, sizeof(quad));
+    npoly = 4;
+  }
+
+  double cin[3] = { 0,0,0 }, cex[3] = { 0,0,0 };
+  for (int i = 0; i < nin; i++) for (int k = 0; k < 3; k++) cin[k] += pos[in[i]][k] / double(nin);
+  for (int i = 0; i < nout; i++) for (int k = 0; k < 3; k++) cex[k] += pos[out[i]][k] / double(nout);
+  double dir_out[3] = { cex[0] - cin[0], cex[1] - cin[1], cex[2] - cin[2] };
+
+  auto emit = [&](const int* e0, const int* e1, const int* e2) {
+    long long k[3] = {
+      lat.edgeKey(pos[e0[0]], pos[e0[1]]),
+      lat.edgeKey(pos[e1[0]], pos[e1[1]]),
+      lat.edgeKey(pos[e2[0]], pos[e2[1]]) };
+    double p[3][3];
+    for (int i = 0; i < 3; i++) lat.crossing(k[i], iso, p[i]);
+    double u[3], v[3];
+    for (int i = 0; i < 3; i++) { u[i] = p[1][i] - p[0][i]; v[i] = p[2][i] - p[0][i]; }
+    double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+    if (n[0] * dir_out[0] + n[1] * dir_out[1] + n[2] * dir_out[2] < 0) std::swap(k[1], k[2]);
+    tris.insert(tris.end(), k, k + 3);
+  };
+
+  emit(poly[0], poly[1], poly[2]);
+  if (npoly == 4) emit(poly[0], poly[2], poly[3]);
+}
+
+void grid::extractIsoSurface(const density_field_t& field, float isovalue, surface_mesh_t& mesh) {
+  sample_lattice_t lat(field);
+  int ereso = field.ereso;
+  auto& esat = field.esat;
+
+  int nthread = omp_get_max_threads();
+  std::vector<std::vector<long long>> threadtris(nthread);
+
+  for_each_set_bit(esat, ereso, [&](size_t bitid, int eid, const int* epos) {
+    auto& tris = threadtris[omp_get_thread_num()];
+    // dual cubes having this element as corner k, a cube is handled by its first active corner
+    for (int k = 0; k < 8; k++) {
+      int c[3] = { epos[0] - (k & 1), epos[1] - (k >> 1 & 1), epos[2] - (k >> 2) };
+      bool owner = true;
+      for (int kk = 0; kk < k && owner; kk++) {
+        if (lat.active(c[0] + (kk & 1), c[1] + (kk >> 1 & 1), c[2] + (kk >> 2))) owner = false;
+      }
+      if (!owner) continue;
+
+      int cpos[8][3];
+      float cval[8];
+      for (int kk = 0; kk < 8; kk++) {
+        cpos[kk][0] = c[0] + (kk & 1); cpos[kk][1] = c[1] + (kk >> 1 & 1); cpos[kk][2] = c[2] + (kk >> 2);
+        cval[kk] = lat.value(cpos[kk][0], cpos[kk][1], cpos[kk][2]);
+      }
+      for (int t = 0; t < 6; t++) {
+        int tpos[4][3];
+        float tval[4];
+        for (int j = 0; j < 4; j++) {
+          memcpy(tpos[j], cpos[cube_tets[t][j]], sizeof(tpos[j]));
+          tval[j] = cval[cube_tets[t][j]];
+        }
+        marchTet(lat, isovalue, tpos, tval, tris);
+      }
+    }
+  });
+
+  // weld vertices, keys are bucketed into shards first so every shard map is built by one thread
+  int nshard = nthread * 4;
+  auto shardOf = [&](long long key) { return int((unsigned long long)(key * 0x9E3779B97F4A7C15ull) >> 40) % nshard; };
+  std::vector<std::vector<std::vector<long long>>> bucket(nthread, std::vector<std::vector<long long>>(nshard));
+#pragma omp parallel for
+  for (int t = 0; t < nthread; t++) {
+    for (long long key : threadtris[t]) bucket[t][shardOf(key)].push_back(key);
+  }
+
+  std::vector<std::unordered_map<long long, int>> shardmap(nshard);
+  std::vector<std::vector<long long>> shardkeys(nshard);
+#pragma omp parallel for schedule(dynamic)
+  for (int s = 0; s < nshard; s++) {
+    auto& mp = shardmap[s];
+    for (int t = 0; t < nthread; t++) {
+      for (long long key : bucket[t][s]) {
+        if (mp.emplace(key, int(shardkeys[s].size())).second) shardkeys[s].push_back(key);
+      }
+      std::vector<long long>().swap(bucket[t][s]);
+    }
+  }
+
+  std::vector<int> shardbase(nshard + 1, 0);
+  for (int s = 0; s < nshard; s++) shardbase[s + 1] = shardbase[s] + shardkeys[s].size();
+
+  int nvert = shardbase[nshard];
+  mesh.vertices.resize(size_t(nvert) * 3);
+  double eh = (field.box[1][0] - field.box[0][0]) / ereso;
+#pragma omp parallel for schedule(dynamic)
+  for (int s = 0; s < nshard; s++) {
+    for (int j = 0; j < shardkeys[s].size(); j++) {
+      double p[3];
+      lat.crossing(shardkeys[s][j], isovalue, p);
+      for (int k = 0; k < 3; k++) mesh.vertices[size_t(shardbase[s] + j) * 3 + k] = field.box[0][k] + (p[k] + 0.5) * eh;
+    }
+  }
+
+  std::vector<size_t> tribase(nthread + 1, 0);
+  for (int t = 0; t < nthread; t++) tribase[t + 1] = tribase[t] + threadtris[t].size();
+  mesh.faces.resize(tribase[nthread]);
+#pragma omp parallel for
+  for (int t = 0; t < nthread; t++) {
+    for (size_t j = 0; j < threadtris[t].size(); j++) {
+      long long key = threadtris[t][j];
+      int s = shardOf(key);
+      mesh.faces[tribase[t] + j] = shardbase[s] + shardmap[s].at(key);
+    }
+  }
+
+  printf("-- iso-surface %4.2f : %d vertices, %zu faces\n", isovalue, nvert, mesh.faces.size() / 3);
+}
+
+bool grid::writeSTL(const std::string& filename, const surface_mesh_t& mesh) {
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs.is_open()) {
+    printf("\033[31m-- cannot open file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  char header[80] = { 0 };
+  strncpy(header, "iso-surface of density field", sizeof(header) - 1);
+  ofs.write(header, sizeof(header));
+  unsigned int nface = mesh.faces.size() / 3;
+  ofs.write((const char*)&nface, sizeof(nface));
+
+  // 50 bytes per facet : normal, 3 vertices, attribute
+  std::vector<char> buf(size_t(nface) * 50);
+#pragma omp parallel for
+  for (int i = 0; i < int(nface); i++) {
+    const float* v[3];
+    for (int j = 0; j < 3; j++) v[j] = &mesh.vertices[size_t(mesh.faces[i * 3 + j]) * 3];
+    float u[3], w[3];
+    for (int k = 0; k < 3; k++) { u[k] = v[1][k] - v[0][k]; w[k] = v[2][k] - v[0][k]; }
+    float n[3] = { u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0] };
+    float nn = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (nn > 0) for (int k = 0; k < 3; k++) n[k] /= nn;
+    char* p = buf.data() + size_t(i) * 50;
+    memcpy(p, n, sizeof(n));
+    for (int j = 0; j < 3; j++) memcpy(p + 12 + j * 12, v[j], 12);
+    memset(p + 48, 0, 2);
+  }
+  ofs.write(buf.data(), buf.size());
+  return ofs.good();
+}
+
+bool grid::writePLY(const std::string& filename, const surface_mesh_t& mesh) {
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs.is_open()) {
+    printf("\033[31m-- cannot open file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  size_t nvert = mesh.vertices.size() / 3, nface = mesh.faces.size() / 3;
+  ofs << "ply\nformat binary_little_endian 1.0\n";
+  ofs << "element vertex " << nvert << "\n";
+  ofs << "property float x\nproperty float y\nproperty float z\n";
+  ofs << "element face " << nface << "\n";
+  ofs << "property list uchar int vertex_indices\n";
+  ofs << "end_header\n";
+  ofs.write((const char*)mesh.vertices.data(), sizeof(float) * mesh.vertices.size());
+
+  // 13 bytes per face : count, 3 indices
+  std::vector<char> buf(nface * 13);
+#pragma omp parallel for
+  for (int i = 0; i < int(nface); i++) {
+    char* p = buf.data() + size_t(i) * 13;
+    p[0] = 3;
+    memcpy(p + 1, &mesh.faces[size_t(i) * 3], sizeof(int) * 3);
+  }
+  ofs.write(buf.data(), buf.size());
+  return ofs.good();
+}
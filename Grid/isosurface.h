@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef __ISOSURFACE_H
+#define __ISOSURFACE_H
+
+#include "Grid.h"
+#include "string"
+
+namespace grid {
+
+	struct surface_mesh_t {
+		// [x0 y0 z0 x1 y1 z1 ...]
+		std::vector<float> vertices;
+		// [v0 v1 v2 ...], counter clockwise seen from outside
+		std::vector<int> faces;
+	};
+
+	// Extract the iso-surface of the element density. Densities are sampled at element centers, inactive
+	// elements count as 0 so the surface is closed. Each dual cube is split into 6 tetrahedra around its
+	// main diagonal (marching tetrahedra), vertices on shared lattice edges are welded by edge id.
+	void extractIsoSurface(const density_field_t& field, float isovalue, surface_mesh_t& mesh);
+
+	bool writeSTL(const std::string& filename, const surface_mesh_t& mesh);
+
+	bool writePLY(const std::string& filename, const surface_mesh_t& mesh);
+}
+
+#endif
+
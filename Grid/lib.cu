@@ -3,6 +3,7 @@
 #include "cusolverSp.h"
 #include "cusparse.h"
 #include <vector>
+#include "memory_registry.h"
 
 
 void* _libbuf = nullptr;
@@ -220,6 +221,7 @@ void* reserve_buf(size_t require) {
 	} else {
 		cudaMalloc(&_libbuf, require);
 		_libbufSize = require;
+		grid::mem::track("lib reduction buffer", grid::mem::temp, grid::mem::device, _libbufSize);
 		return _libbuf;
 	}
 }
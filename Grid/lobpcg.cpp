@@ -0,0 +1,262 @@
+#include "lobpcg.h"
+#include "projection.h"
+#include "Eigen/Eigen"
+
+using namespace grid;
+
+// a block of 3 component vectors allocated on given grid, tracked as a field of the grid under its name
+struct v3block_t {
+  Grid& _g;
+  std::vector<double*> _buf;
+  std::string _name;
+
+  v3block_t(Grid& g, int n, const std::string& name) : _g(g), _buf(n * 3, nullptr), _name("lobpcg " + name) {
+    for (int i = 0; i < n; i++) _g.v3_create(&_buf[i * 3]);
+    mem::track(_name, mem::fields, mem::device, sizeof(double) * _g.n_gsvertices * _buf.size(), _g._layer);
+  }
+
+  ~v3block_t() {
+    for (int i = 0; i < _buf.size() / 3; i++) _g.v3_destroy(&_buf[i * 3]);
+    mem::release(_name);
+  }
+
+  double** operator[](int i) { return &_buf[i * 3]; }
+
+  void swap(v3block_t& other) { _buf.swap(other._buf); }
+};
+
+// P * v restricted on load nodes, flattened as [x0 y0 z0 x1 y1 z1 ...]
+static Eigen::VectorXd projectedSupport(double* v[3]) {
+  std::vector<double> fs[3];
+  getForceSupport(v, fs);
+  forceProject(fs);
+  Eigen::VectorXd pv(fs[0].size() * 3);
+  for (int i = 0; i < fs[0].size(); i++) {
+    for (int k = 0; k < 3; k++) pv[i * 3 + k] = fs[k][i];
+  }
+  return pv;
+}
+
+// dst = sum_i coeff[i] * src[i]
+static void v3_combine(Grid& g, double* dst[3], const std::vector<double**>& src, const Eigen::VectorXd& coeff) {
+  double zeros[3] = { 0,0,0 };
+  g.v3_init(dst, zeros);
+  for (int i = 0; i < src.size(); i++) {
+    if (coeff[i] == 0) continue;
+    g.v3_add(dst, coeff[i], src[i]);
+  }
+}
+
+// Rayleigh-Ritz on span(S) for the pencil (S^T P S, S^T K S), keep the largest m pairs
+static bool rayleighRitz(
+  Grid& g, const std::vector<double**>& S, const std::vector<double**>& KS, const std::vector<Eigen::VectorXd*>& PS,
+  int m, Eigen::MatrixXd& C, Eigen::VectorXd& lam
+) {
+  int k = S.size();
+  Eigen::MatrixXd A(k, k), B(k, k);
+  for (int i = 0; i < k; i++) {
+    for (int j = i; j < k; j++) {
+      A(i, j) = A(j, i) = PS[i]->dot(*PS[j]);
+      B(i, j) = B(j, i) = 0.5 * (g.v3_dot(S[i], KS[j]) + g.v3_dot(S[j], KS[i]));
+    }
+  }
+
+  // scale columns to unit K norm, this removes most of the ill conditioning of the Gram matrix
+  Eigen::VectorXd dscale(k);
+  for (int i = 0; i < k; i++) {
+    if (!(B(i, i) > 0)) return false;
+    dscale[i] = 1 / sqrt(B(i, i));
+  }
+  A = dscale.asDiagonal() * A * dscale.asDiagonal();
+  B = dscale.asDiagonal() * B * dscale.asDiagonal();
+
+  Eigen::LLT<Eigen::MatrixXd> llt(B);
+  if (llt.info() != Eigen::Success) return false;
+
+  Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd> ges(A, B);
+  if (ges.info() != Eigen::Success) return false;
+
+  // eigenvalues are sorted in increasing order
+  C.resize(k, m);
+  lam.resize(m);
+  for (int j = 0; j < m; j++) {
+    C.col(j) = dscale.asDiagonal() * ges.eigenvectors().col(k - 1 - j);
+    lam[j] = ges.eigenvalues()[k - 1 - j];
+  }
+  return true;
+}
+
+std::vector<worst_mode_t> lobpcgWorstModes(grid::HierarchyGrid& grds, const lobpcg_setting_t& setting) {
+  Grid& g = *grds[0];
+  int m = setting.n_mode;
+  bool support = grds.hasSupport();
+
+  v3block_t X(g, m, "X"), KX(g, m, "KX"), W(g, m, "W"), KW(g, m, "KW"), D(g, m, "D"), KD(g, m, "KD");
+  v3block_t Xn(g, m, "Xn"), KXn(g, m, "KXn"), Dn(g, m, "Dn"), KDn(g, m, "KDn");
+  std::vector<Eigen::VectorXd> PX(m), PW(m), PD(m), PXn(m), PDn(m);
+
+  double* tmp[3];
+  g.v3_create(tmp);
+
+  // keep search directions in the admissible displacement space
+  auto constrain = [&](double* v[3]) {
+    if (support) g.resetDirchlet(v);
+    else displacementProject(v);
+  };
+
+  auto applyK = [&](double* v[3], double* kv[3]) {
+    g.applyK(v, kv);
+    if (support) g.resetDirchlet(kv);
+  };
+
+  Eigen::MatrixXd C;
+  Eigen::VectorXd lam;
+
+  // random initial block
+  for (int j = 0; j < m; j++) {
+    g.v3_rand(X[j], -1, 1);
+    constrain(X[j]);
+    applyK(X[j], KX[j]);
+    PX[j] = projectedSupport(X[j]);
+  }
+
+  {
+    std::vector<double**> S, KS;
+    std::vector<Eigen::VectorXd*> PS;
+    for (int j = 0; j < m; j++) { S.push_back(X[j]); KS.push_back(KX[j]); PS.push_back(&PX[j]); }
+    if (!rayleighRitz(g, S, KS, PS, m, C, lam)) {
+      printf("\033[31m-- LOBPCG failed on initial block\033[0m\n");
+      g.v3_destroy(tmp);
+      return {};
+    }
+    for (int j = 0; j < m; j++) {
+      v3_combine(g, Xn[j], S, C.col(j));
+      v3_combine(g, KXn[j], KS, C.col(j));
+      PXn[j] = Eigen::VectorXd::Zero(PX[j].rows());
+      for (int i = 0; i < m; i++) PXn[j] += C(i, j) * *PS[i];
+    }
+    Xn.swap(X); KXn.swap(KX);
+    for (int j = 0; j < m; j++) std::swap(PX[j], PXn[j]);
+  }
+
+  std::vector<double> res(m, 1);
+  bool hasD = false;
+  bool converged = false;
+  int itn = 0;
+
+  while (itn++ < setting.max_itn) {
+    // residual  R = P x - lambda K x, stored in W
+    double maxres = 0;
+    for (int j = 0; j < m; j++) {
+      g.v3_copy(X[j], tmp);
+      forceProject(tmp);
+      g.v3_minus(W[j], tmp, lam[j], KX[j]);
+      res[j] = g.v3_norm(W[j]) / g.v3_norm(tmp);
+      maxres = (std::max)(maxres, res[j]);
+    }
+
+    printf("--[%d] lambda %6.3e  r_max %6.2lf%%\n", itn, lam[0], maxres * 100);
+
+    if (maxres < setting.tol) {
+      converged = true;
+      break;
+    }
+
+    // precondition residual with V-cycles,  W = T R
+    for (int j = 0; j < m; j++) {
+      g.v3_copy(W[j], g.getForce());
+      g.reset_displacement();
+      for (int n = 0; n < setting.n_vcycle; n++) grds.v_cycle();
+      g.v3_copy(g.getDisplacement(), W[j]);
+      constrain(W[j]);
+      applyK(W[j], KW[j]);
+      PW[j] = projectedSupport(W[j]);
+    }
+
+    // S = [X W D]
+    std::vector<double**> S, KS;
+    std::vector<Eigen::VectorXd*> PS;
+    for (int j = 0; j < m; j++) { S.push_back(X[j]); KS.push_back(KX[j]); PS.push_back(&PX[j]); }
+    for (int j = 0; j < m; j++) { S.push_back(W[j]); KS.push_back(KW[j]); PS.push_back(&PW[j]); }
+    if (hasD) {
+      for (int j = 0; j < m; j++) { S.push_back(D[j]); KS.push_back(KD[j]); PS.push_back(&PD[j]); }
+    }
+
+    bool suc = rayleighRitz(g, S, KS, PS, m, C, lam);
+    // Gram matrix lost definiteness, restart without the old directions
+    if (!suc && hasD) {
+      printf("-- LOBPCG restart\n");
+      S.resize(2 * m); KS.resize(2 * m); PS.resize(2 * m);
+      hasD = false;
+      suc = rayleighRitz(g, S, KS, PS, m, C, lam);
+    }
+    if (!suc) {
+      printf("\033[31m-- LOBPCG Rayleigh-Ritz failed\033[0m\n");
+      break;
+    }
+
+    // D' = W Cw + D Cd,  X' = X Cx + D'
+    std::vector<double**> SD(S.begin() + m, S.end()), KSD(KS.begin() + m, KS.end());
+    std::vector<double**> SX(S.begin(), S.begin() + m), KSX(KS.begin(), KS.begin() + m);
+    for (int j = 0; j < m; j++) {
+      Eigen::VectorXd cd = C.col(j).tail(S.size() - m);
+      Eigen::VectorXd cx = C.col(j).head(m);
+      v3_combine(g, Dn[j], SD, cd);
+      v3_combine(g, KDn[j], KSD, cd);
+      PDn[j] = Eigen::VectorXd::Zero(PX[j].rows());
+      for (int i = 0; i < cd.rows(); i++) PDn[j] += cd[i] * *PS[m + i];
+
+      v3_combine(g, Xn[j], SX, cx);
+      g.v3_add(Xn[j], 1, Dn[j]);
+      v3_combine(g, KXn[j], KSX, cx);
+      g.v3_add(KXn[j], 1, KDn[j]);
+      PXn[j] = PDn[j];
+      for (int i = 0; i < m; i++) PXn[j] += cx[i] * *PS[i];
+    }
+
+    Xn.swap(X); KXn.swap(KX);
+    Dn.swap(D); KDn.swap(KD);
+    for (int j = 0; j < m; j++) { std::swap(PX[j], PXn[j]); std::swap(PD[j], PDn[j]); }
+    hasD = true;
+  }
+
+  if (!converged && itn > setting.max_itn) {
+    printf("\033[33m-- LOBPCG not converged in %d iterations, r_max %6.2lf%%\033[0m\n", setting.max_itn,
+      *std::max_element(res.begin(), res.end()) * 100);
+  }
+
+  // write worst mode to U, F :  F = P x / |P x|,  U = lambda * x / |P x|
+  g.v3_copy(X[0], g.getForce());
+  forceProject(g.getForce());
+  double pn = g.v3_norm(g.getForce());
+  g.v3_scale(g.getForce(), 1.0 / pn);
+  g.v3_copy(X[0], g.getDisplacement());
+  g.v3_scale(g.getDisplacement(), lam[0] / pn);
+  getForceSupport(g.getForce(), g.getSupportForce());
+
+  g.v3_destroy(tmp);
+
+  std::vector<worst_mode_t> modes(m);
+  for (int j = 0; j < m; j++) {
+    modes[j].compliance = lam[j];
+    modes[j].residual = res[j];
+    double pxn = PX[j].norm();
+    for (int k = 0; k < 3; k++) {
+      modes[j].fsupport[k].resize(PX[j].rows() / 3);
+      for (int i = 0; i < modes[j].fsupport[k].size(); i++) {
+        modes[j].fsupport[k][i] = PX[j][i * 3 + k] / pxn;
+      }
+    }
+  }
+
+  return modes;
+}
+
+int countDegenerateModes(const std::vector<worst_mode_t>& modes, double gap) {
+  if (modes.empty()) return 0;
+  int n = 1;
+  for (int i = 1; i < modes.size(); i++) {
+    if ((modes[0].compliance - modes[i].compliance) < gap * modes[0].compliance) n++;
+  }
+  return n;
+}
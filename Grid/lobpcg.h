@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef __LOBPCG_H
+#define __LOBPCG_H
+
+#include "Grid.h"
+#include "vector"
+
+struct lobpcg_setting_t {
+	// number of worst-case modes solved together (block size)
+	int n_mode = 3;
+	int max_itn = 100;
+	// relative eigen residual |P x - lambda K x| / |P x|
+	double tol = 1e-3;
+	// V-cycles applied as the preconditioner T ~ K^-1
+	int n_vcycle = 1;
+	// relative compliance gap below which two modes are considered degenerate
+	double degenerate_gap = 5e-2;
+};
+
+struct worst_mode_t {
+	double compliance;
+	double residual;
+	// unit support force on load nodes
+	std::vector<double> fsupport[3];
+};
+
+// Solve the top modes of the pencil  P u = lambda K u  (P : projection onto balanced loads),
+// lambda is the worst compliance of mode u. Modes are returned in descending compliance,
+// the first one is written to U / F / Fsupport of the finest grid as modifiedPM does.
+// An empty list is returned when the initial block has no Rayleigh-Ritz solution, U / F are not written then.
+std::vector<worst_mode_t> lobpcgWorstModes(grid::HierarchyGrid& grds, const lobpcg_setting_t& setting = lobpcg_setting_t());
+
+// number of modes whose compliance is within the relative gap of the worst one
+int countDegenerateModes(const std::vector<worst_mode_t>& modes, double gap);
+
+#endif
+
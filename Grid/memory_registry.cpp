@@ -0,0 +1,177 @@
+#include "memory_registry.h"
+#include "mutex"
+#include "map"
+#include "set"
+#include "cmath"
+#include "algorithm"
+#include "cstdio"
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace grid;
+
+namespace {
+  struct entry_t {
+    mem::category_t cat;
+    mem::space_t space;
+    int layer;
+    size_t bytes;
+  };
+
+  std::mutex mem_mutex;
+
+  std::map<std::string, entry_t> mem_entries;
+
+  size_t mem_current[2][mem::n_category] = { 0 };
+
+  size_t mem_category_peak[2][mem::n_category] = { 0 };
+
+  size_t mem_total[2] = { 0 };
+
+  size_t mem_peak[2] = { 0 };
+
+  size_t mem_phase_peak[2] = { 0 };
+
+  mem::category_t mem_tag_cat = mem::other;
+
+  int mem_tag_layer = -1;
+
+  void add_bytes(const entry_t& e, bool add) {
+    size_t& cur = mem_current[e.space][e.cat];
+    size_t& tot = mem_total[e.space];
+    if (add) {
+      cur += e.bytes;
+      tot += e.bytes;
+    } else {
+      cur -= e.bytes;
+      tot -= e.bytes;
+    }
+    mem_category_peak[e.space][e.cat] = std::max(mem_category_peak[e.space][e.cat], cur);
+    mem_peak[e.space] = std::max(mem_peak[e.space], tot);
+    mem_phase_peak[e.space] = std::max(mem_phase_peak[e.space], tot);
+  }
+
+  double MB(size_t bytes) {
+    return double(bytes) / 1024 / 1024;
+  }
+}
+
+const char* mem::category_name(category_t cat) {
+  static const char* names[n_category] = { "topology", "stencil", "fields", "temp", "projection", "coarse solver", "other" };
+  return cat >= 0 && cat < n_category ? names[cat] : "unknown";
+}
+
+void mem::track(const std::string& name, category_t cat, space_t space, size_t bytes, int layer) {
+  std::lock_guard<std::mutex> lk(mem_mutex);
+  auto it = mem_entries.find(name);
+  if (it != mem_entries.end()) {
+    add_bytes(it->second, false);
+    mem_entries.erase(it);
+  }
+  if (bytes == 0) return;
+  entry_t e = { cat, space, layer, bytes };
+  mem_entries[name] = e;
+  add_bytes(e, true);
+}
+
+void mem::release(const std::string& name) {
+  track(name, other, host, 0);
+}
+
+mem::tag::tag(category_t cat, int layer) {
+  _old_cat = mem_tag_cat;
+  _old_layer = mem_tag_layer;
+  mem_tag_cat = cat;
+  mem_tag_layer = layer;
+}
+
+mem::tag::~tag() {
+  mem_tag_cat = _old_cat;
+  mem_tag_layer = _old_layer;
+}
+
+void mem::tag::set(category_t cat) {
+  mem_tag_cat = cat;
+}
+
+mem::category_t mem::current_category(void) {
+  return mem_tag_cat;
+}
+
+int mem::current_layer(void) {
+  return mem_tag_layer;
+}
+
+size_t mem::current(space_t space) {
+  std::lock_guard<std::mutex> lk(mem_mutex);
+  return mem_total[space];
+}
+
+size_t mem::peak(space_t space) {
+  std::lock_guard<std::mutex> lk(mem_mutex);
+  return mem_peak[space];
+}
+
+void mem::reset_peak(void) {
+  std::lock_guard<std::mutex> lk(mem_mutex);
+  for (int s = 0; s < 2; s++) {
+    for (int c = 0; c < n_category; c++) mem_category_peak[s][c] = mem_current[s][c];
+    mem_peak[s] = mem_total[s];
+    mem_phase_peak[s] = mem_total[s];
+  }
+}
+
+void mem::report(const std::string& phase) {
+  std::lock_guard<std::mutex> lk(mem_mutex);
+
+  // bytes per (category, layer) summed over both spaces, layer -1 goes to the shared column
+  std::set<int> layers;
+  std::map<std::pair<int, int>, size_t> bylayer;
+  for (auto& it : mem_entries) {
+    const entry_t& e = it.second;
+    layers.insert(e.layer);
+    bylayer[{ e.cat, e.layer }] += e.bytes;
+  }
+
+  printf("\n-- memory after %s (MB)\n", phase.c_str());
+  printf("%-14s %10s %10s %10s %10s", "category", "device", "dev peak", "host", "host peak");
+  for (int l : layers) {
+    std::string head = l < 0 ? "shared" : "layer[" + std::to_string(l) + "]";
+    printf(" %9s", head.c_str());
+  }
+  printf("\n");
+  for (int c = 0; c < n_category; c++) {
+    if (mem_category_peak[device][c] == 0 && mem_category_peak[host][c] == 0) continue;
+    printf("%-14s %10.1lf %10.1lf %10.1lf %10.1lf", category_name(category_t(c)),
+      MB(mem_current[device][c]), MB(mem_category_peak[device][c]), MB(mem_current[host][c]), MB(mem_category_peak[host][c]));
+    for (int l : layers) {
+      auto it = bylayer.find({ c, l });
+      printf(" %9.1lf", it == bylayer.end() ? 0. : MB(it->second));
+    }
+    printf("\n");
+  }
+  printf("%-14s %10.1lf %10.1lf %10.1lf %10.1lf\n", "total", MB(mem_total[device]), MB(mem_peak[device]), MB(mem_total[host]), MB(mem_peak[host]));
+  printf("-- phase peak : device %.1lf MB, host %.1lf MB\n", MB(mem_phase_peak[device]), MB(mem_phase_peak[host]));
+
+  mem_phase_peak[device] = mem_total[device];
+  mem_phase_peak[host] = mem_total[host];
+}
+
+int mem::predictResolution(space_t space, int reso, size_t capacity) {
+  std::lock_guard<std::mutex> lk(mem_mutex);
+  // the coarsest layer stays below a fixed element count, its dense system does not grow with the resolution
+  double fixed = mem_current[space][coarse_solver];
+  double scaled = double(mem_peak[space]) - fixed;
+  if (scaled <= 0 || capacity <= fixed) return 0;
+  return int(reso * std::cbrt((capacity - fixed) / scaled));
+}
+
+size_t mem::host_capacity(void) {
+#ifdef __linux__
+  long pages = sysconf(_SC_PHYS_PAGES);
+  long pagesize = sysconf(_SC_PAGE_SIZE);
+  if (pages > 0 && pagesize > 0) return size_t(pages) * size_t(pagesize);
+#endif
+  return 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#ifndef __MEMORY_REGISTRY_H
+#define __MEMORY_REGISTRY_H
+
+#include "string"
+
+namespace grid {
+
+	/*
+	  Registry of the large host and device allocations, so the footprint of a run can be broken down by
+	  category and layer and its high-water mark is known. Allocations are identified by name, tracking a
+	  name again replaces its size, e.g. a buffer growing or a matrix being resized on a rebuild.
+	  Device buffers of gpu_manager_t are tracked automatically under the current tag, other allocations
+	  (the temp buffer, Eigen globals, host topology) are tracked where they are made.
+	*/
+	namespace mem {
+
+		enum category_t {
+			topology,
+			stencil,
+			fields,
+			temp,
+			projection,
+			coarse_solver,
+			other,
+			n_category
+		};
+
+		enum space_t {
+			device,
+			host
+		};
+
+		const char* category_name(category_t cat);
+
+		// set the bytes of a named allocation, 0 removes it. layer -1 is shared by all layers
+		void track(const std::string& name, category_t cat, space_t space, size_t bytes, int layer = -1);
+
+		void release(const std::string& name);
+
+		// category and layer given to the device buffers allocated by gpu_manager_t while the tag is alive
+		class tag {
+			category_t _old_cat;
+			int _old_layer;
+		public:
+			tag(category_t cat, int layer = -1);
+			~tag();
+			void set(category_t cat);
+			tag(const tag&) = delete;
+			tag& operator=(const tag&) = delete;
+		};
+
+		category_t current_category(void);
+
+		int current_layer(void);
+
+		size_t current(space_t space);
+
+		// high-water mark since the start of the run or the last reset_peak
+		size_t peak(space_t space);
+
+		// restart the high-water marks from the current totals, called when the grids are rebuilt so the peaks
+		// describe the current lattice only
+		void reset_peak(void);
+
+		// print the breakdown by category and layer with the peaks of the phase ending now, a new phase starts
+		void report(const std::string& phase);
+
+		// largest resolution whose peak fits in capacity bytes, assuming everything but the coarse solver scales
+		// with the element count (reso^3) of the run at the given resolution. 0 if nothing has been tracked
+		int predictResolution(space_t space, int reso, size_t capacity);
+
+		// physical memory of the host, 0 if unknown
+		size_t host_capacity(void);
+	}
+};
+
+#endif
+
@@ -0,0 +1,494 @@
+#include "meshLoader.h"
+#include "profiler.h"
+#include "snippet.h"
+#include "unordered_map"
+#include "array"
+#include "algorithm"
+#include "cstring"
+#include "cstdio"
+#include "cmath"
+#include "omp.h"
+
+namespace {
+  inline const char* skipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+  }
+
+  inline const char* nextLine(const char* p, const char* end) {
+    const char* q = (const char*)memchr(p, '\n', end - p);
+    return q == nullptr ? end : q + 1;
+  }
+
+  inline const char* skipToken(const char* p, const char* end) {
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+    return p;
+  }
+
+  const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  inline double pow10i(int e) {
+    if (e >= 0 && e <= 22) return pow10_table[e];
+    if (e < 0 && e >= -22) return 1 / pow10_table[-e];
+    return std::pow(10.0, e);
+  }
+
+  // decimal float [+-]digits[.digits][(e|E)[+-]digits], returns nullptr if no digit is found
+  inline const char* parseFloat(const char* p, const char* end, double& val) {
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    unsigned long long mant = 0;
+    int exp10 = 0, ndigit = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, ndigit++) {
+      if (mant < 1000000000000000000ull) mant = mant * 10 + (*p - '0');
+      else exp10++;
+    }
+    if (p < end && *p == '.') {
+      p++;
+      for (; p < end && *p >= '0' && *p <= '9'; p++, ndigit++) {
+        if (mant < 1000000000000000000ull) { mant = mant * 10 + (*p - '0'); exp10--; }
+      }
+    }
+    if (ndigit == 0) return nullptr;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      const char* q = p + 1;
+      bool eneg = false;
+      if (q < end && (*q == '-' || *q == '+')) eneg = *q++ == '-';
+      if (q < end && *q >= '0' && *q <= '9') {
+        int e = 0;
+        for (; q < end && *q >= '0' && *q <= '9'; q++) e = std::min(e * 10 + (*q - '0'), 100000);
+        exp10 += eneg ? -e : e;
+        p = q;
+      }
+    }
+    val = double(mant) * pow10i(exp10);
+    if (neg) val = -val;
+    return p;
+  }
+
+  inline const char* parseInt(const char* p, const char* end, long long& val) {
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    if (p >= end || *p < '0' || *p > '9') return nullptr;
+    long long v = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) v = v * 10 + (*p - '0');
+    val = neg ? -v : v;
+    return p;
+  }
+
+  const long long obj_relative = -(1ll << 48);
+
+  struct obj_chunk_t {
+    std::vector<float> v;
+    // >= 0 : absolute 0-based index, < 0 : index relative to the first vertex of the chunk + obj_relative
+    std::vector<long long> f;
+    bool failed = false;
+  };
+
+  void parseOBJChunk(const char* p, const char* end, obj_chunk_t& chunk) {
+    std::vector<long long> poly;
+    while (p < end) {
+      const char* line = skipSpace(p, end);
+      const char* lend = nextLine(line, end);
+      if (line + 1 < lend && line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+        const char* q = line + 1;
+        for (int k = 0; k < 3; k++) {
+          double x = 0;
+          q = skipSpace(q, lend);
+          const char* r = parseFloat(q, lend, x);
+          if (r == nullptr) { chunk.failed = true; r = skipToken(q, lend); }
+          chunk.v.push_back(x);
+          q = r;
+        }
+      }
+      else if (line + 1 < lend && line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+        poly.clear();
+        const char* q = line + 1;
+        while (true) {
+          q = skipSpace(q, lend);
+          if (q >= lend || *q == '\n' || *q == '#') break;
+          long long idx;
+          const char* r = parseInt(q, lend, idx);
+          if (r == nullptr || idx == 0) { chunk.failed = true; break; }
+          long long nlocal = chunk.v.size() / 3;
+          poly.push_back(idx > 0 ? idx - 1 : nlocal + idx + obj_relative);
+          // skip texture and normal indices
+          q = skipToken(r, lend);
+        }
+        for (int i = 1; i + 1 < poly.size(); i++) {
+          chunk.f.push_back(poly[0]);
+          chunk.f.push_back(poly[i]);
+          chunk.f.push_back(poly[i + 1]);
+        }
+      }
+      p = lend;
+    }
+  }
+}
+
+bool loadOBJ(const char* data, size_t len, std::vector<float>& pcoords, std::vector<int>& trifaces) {
+  int nchunk = std::max<size_t>(1, std::min<size_t>(omp_get_max_threads() * 4, len / 4096));
+  std::vector<const char*> bound(nchunk + 1);
+  bound[0] = data;
+  bound[nchunk] = data + len;
+  for (int i = 1; i < nchunk; i++) {
+    // chunks start at a line begin
+    bound[i] = std::max(bound[i - 1], nextLine(data + len / nchunk * i, data + len));
+  }
+
+  std::vector<obj_chunk_t> chunks(nchunk);
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < nchunk; i++) {
+    parseOBJChunk(bound[i], bound[i + 1], chunks[i]);
+  }
+
+  std::vector<size_t> vbase(nchunk + 1, 0), fbase(nchunk + 1, 0);
+  bool failed = false;
+  for (int i = 0; i < nchunk; i++) {
+    vbase[i + 1] = vbase[i] + chunks[i].v.size();
+    fbase[i + 1] = fbase[i] + chunks[i].f.size();
+    failed = failed || chunks[i].failed;
+  }
+  if (failed) {
+    printf("\033[31m-- malformed OBJ record\033[0m\n");
+    return false;
+  }
+
+  size_t nv = vbase[nchunk] / 3;
+  pcoords.resize(vbase[nchunk]);
+  trifaces.resize(fbase[nchunk]);
+  int n_invalid = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:n_invalid)
+  for (int i = 0; i < nchunk; i++) {
+    std::copy(chunks[i].v.begin(), chunks[i].v.end(), pcoords.begin() + vbase[i]);
+    long long voffset = vbase[i] / 3;
+    for (size_t j = 0; j < chunks[i].f.size(); j++) {
+      long long idx = chunks[i].f[j];
+      if (idx < 0) idx = voffset + (idx - obj_relative);
+      if (idx < 0 || idx >= nv) { n_invalid++; idx = 0; }
+      trifaces[fbase[i] + j] = idx;
+    }
+  }
+  if (n_invalid > 0) {
+    printf("\033[31m-- %d OBJ face indices out of range\033[0m\n", n_invalid);
+    return false;
+  }
+  return true;
+}
+
+namespace {
+  struct vkey_hash {
+    size_t operator()(const std::array<unsigned int, 3>& k) const {
+      unsigned long long h = k[0] * 0x9E3779B97F4A7C15ull;
+      h ^= k[1] + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+      h ^= k[2] + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+      return h;
+    }
+  };
+
+  // merge triangle soup corners by exact position
+  void weldSoup(const std::vector<float>& soup, std::vector<float>& pcoords, std::vector<int>& trifaces) {
+    std::unordered_map<std::array<unsigned int, 3>, int, vkey_hash> vmap;
+    vmap.reserve(soup.size() / 3 / 4);
+    pcoords.clear();
+    trifaces.resize(soup.size() / 3);
+    for (size_t i = 0; i < trifaces.size(); i++) {
+      std::array<unsigned int, 3> key;
+      memcpy(key.data(), &soup[i * 3], sizeof(float) * 3);
+      // +0 and -0 are the same point
+      for (int k = 0; k < 3; k++) if (key[k] == 0x80000000u) key[k] = 0;
+      auto res = vmap.emplace(key, int(pcoords.size() / 3));
+      if (res.second) pcoords.insert(pcoords.end(), &soup[i * 3], &soup[i * 3] + 3);
+      trifaces[i] = res.first->second;
+    }
+  }
+}
+
+bool loadSTL(const char* data, size_t len, std::vector<float>& pcoords, std::vector<int>& trifaces) {
+  std::vector<float> soup;
+  unsigned int nface = 0;
+  if (len >= 84) memcpy(&nface, data + 80, sizeof(nface));
+  if (len >= 84 && 84 + size_t(nface) * 50 == len) {
+    soup.resize(size_t(nface) * 9);
+#pragma omp parallel for
+    for (int i = 0; i < int(nface); i++) {
+      memcpy(&soup[size_t(i) * 9], data + 84 + size_t(i) * 50 + 12, sizeof(float) * 9);
+    }
+  }
+  else if (len >= 5 && strncmp(data, "solid", 5) == 0) {
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end) {
+      const char* line = skipSpace(p, end);
+      const char* lend = nextLine(line, end);
+      if (lend - line > 6 && strncmp(line, "vertex", 6) == 0) {
+        const char* q = line + 6;
+        for (int k = 0; k < 3; k++) {
+          double x = 0;
+          q = skipSpace(q, lend);
+          const char* r = parseFloat(q, lend, x);
+          if (r == nullptr) {
+            printf("\033[31m-- malformed STL vertex\033[0m\n");
+            return false;
+          }
+          soup.push_back(x);
+          q = r;
+        }
+      }
+      p = lend;
+    }
+    if (soup.size() % 9 != 0) {
+      printf("\033[31m-- incomplete STL facet\033[0m\n");
+      return false;
+    }
+  }
+  else {
+    printf("\033[31m-- unrecognized STL file\033[0m\n");
+    return false;
+  }
+
+  weldSoup(soup, pcoords, trifaces);
+  return true;
+}
+
+namespace {
+  struct ply_property_t {
+    std::string name;
+    int size = 0;
+    char kind = 'f';
+    bool list = false;
+    int count_size = 0;
+    char count_kind = 'u';
+  };
+
+  struct ply_element_t {
+    std::string name;
+    size_t count = 0;
+    std::vector<ply_property_t> props;
+  };
+
+  // size and kind ('i' signed, 'u' unsigned, 'f' float) of a ply scalar type
+  bool plyType(const std::string& t, int& size, char& kind) {
+    static const struct { const char* name; int size; char kind; } types[] = {
+      {"char",1,'i'}, {"int8",1,'i'}, {"uchar",1,'u'}, {"uint8",1,'u'},
+      {"short",2,'i'}, {"int16",2,'i'}, {"ushort",2,'u'}, {"uint16",2,'u'},
+      {"int",4,'i'}, {"int32",4,'i'}, {"uint",4,'u'}, {"uint32",4,'u'},
+      {"float",4,'f'}, {"float32",4,'f'}, {"double",8,'f'}, {"float64",8,'f'}
+    };
+    for (auto& ty : types) {
+      if (t == ty.name) { size = ty.size; kind = ty.kind; return true; }
+    }
+    return false;
+  }
+
+  inline double readBinary(const char* p, int size, char kind) {
+    switch (size) {
+    case 1: return kind == 'i' ? double(*(const signed char*)p) : double(*(const unsigned char*)p);
+    case 2: { short s; unsigned short us; memcpy(&s, p, 2); memcpy(&us, p, 2); return kind == 'i' ? s : us; }
+    case 4: {
+      if (kind == 'f') { float f; memcpy(&f, p, 4); return f; }
+      int s; unsigned int us; memcpy(&s, p, 4); memcpy(&us, p, 4); return kind == 'i' ? double(s) : double(us);
+    }
+    default: { double d; memcpy(&d, p, 8); return d; }
+    }
+  }
+}
+
+bool loadPLY(const char* data, size_t len, std::vector<float>& pcoords, std::vector<int>& trifaces) {
+  const char* p = data;
+  const char* end = data + len;
+  if (len < 3 || strncmp(p, "ply", 3) != 0) {
+    printf("\033[31m-- not a PLY file\033[0m\n");
+    return false;
+  }
+
+  // header
+  bool binary = false;
+  std::vector<ply_element_t> elements;
+  while (true) {
+    if (p >= end) {
+      printf("\033[31m-- PLY header not terminated\033[0m\n");
+      return false;
+    }
+    const char* lend = nextLine(p, end);
+    std::string line(p, lend);
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+    p = lend;
+    char w0[64] = { 0 }, w1[64] = { 0 }, w2[64] = { 0 }, w3[64] = { 0 }, w4[64] = { 0 };
+    int nw = sscanf(line.c_str(), "%63s %63s %63s %63s %63s", w0, w1, w2, w3, w4);
+    if (nw <= 0) continue;
+    std::string key(w0);
+    if (key == "end_header") break;
+    if (key == "format") {
+      if (std::string(w1) == "binary_little_endian") binary = true;
+      else if (std::string(w1) != "ascii") {
+        printf("\033[31m-- unsupported PLY format %s\033[0m\n", w1);
+        return false;
+      }
+    }
+    else if (key == "element" && nw >= 3) {
+      ply_element_t ele;
+      ele.name = w1;
+      ele.count = strtoull(w2, nullptr, 10);
+      elements.push_back(ele);
+    }
+    else if (key == "property" && !elements.empty()) {
+      ply_property_t prop;
+      bool suc;
+      if (std::string(w1) == "list" && nw >= 5) {
+        prop.list = true;
+        prop.name = w4;
+        suc = plyType(w2, prop.count_size, prop.count_kind) && plyType(w3, prop.size, prop.kind);
+      }
+      else {
+        prop.name = w2;
+        suc = plyType(w1, prop.size, prop.kind);
+      }
+      if (!suc) {
+        printf("\033[31m-- unsupported PLY property %s\033[0m\n", line.c_str());
+        return false;
+      }
+      elements.back().props.push_back(prop);
+    }
+  }
+
+  pcoords.clear();
+  trifaces.clear();
+  std::vector<int> poly;
+  for (auto& ele : elements) {
+    bool isvertex = ele.name == "vertex";
+    bool isface = ele.name == "face";
+    int xyz[3] = { -1, -1, -1 };
+    int vlist = -1;
+    bool fixed = true;
+    size_t stride = 0;
+    std::vector<size_t> propoffset;
+    for (int i = 0; i < ele.props.size(); i++) {
+      auto& pr = ele.props[i];
+      if (pr.name == "x") xyz[0] = i;
+      if (pr.name == "y") xyz[1] = i;
+      if (pr.name == "z") xyz[2] = i;
+      if (pr.list && (pr.name == "vertex_indices" || pr.name == "vertex_index")) vlist = i;
+      if (pr.list) fixed = false;
+      propoffset.push_back(stride);
+      stride += pr.size;
+    }
+    if (isvertex && (xyz[0] < 0 || xyz[1] < 0 || xyz[2] < 0)) {
+      printf("\033[31m-- PLY vertex without x y z\033[0m\n");
+      return false;
+    }
+    if (isvertex) pcoords.resize(ele.count * 3);
+
+    // fixed size binary records are decoded in parallel
+    if (binary && fixed) {
+      if (p + stride * ele.count > end) {
+        printf("\033[31m-- truncated PLY element %s\033[0m\n", ele.name.c_str());
+        return false;
+      }
+      if (isvertex) {
+        const char* base = p;
+#pragma omp parallel for
+        for (long long i = 0; i < (long long)ele.count; i++) {
+          for (int k = 0; k < 3; k++) {
+            auto& pr = ele.props[xyz[k]];
+            pcoords[i * 3 + k] = readBinary(base + i * stride + propoffset[xyz[k]], pr.size, pr.kind);
+          }
+        }
+      }
+      p += stride * ele.count;
+      continue;
+    }
+
+    for (size_t i = 0; i < ele.count; i++) {
+      poly.clear();
+      for (int j = 0; j < ele.props.size(); j++) {
+        auto& pr = ele.props[j];
+        size_t n = 1;
+        if (pr.list) {
+          double cnt = 0;
+          if (binary) {
+            if (p + pr.count_size > end) { printf("\033[31m-- truncated PLY file\033[0m\n"); return false; }
+            cnt = readBinary(p, pr.count_size, pr.count_kind);
+            p += pr.count_size;
+          }
+          else {
+            p = skipSpace(p, end);
+            while (p < end && *p == '\n') p = skipSpace(p + 1, end);
+            const char* r = parseFloat(p, end, cnt);
+            if (r == nullptr) { printf("\033[31m-- malformed PLY record\033[0m\n"); return false; }
+            p = r;
+          }
+          n = size_t(cnt);
+        }
+        for (size_t k = 0; k < n; k++) {
+          double v = 0;
+          if (binary) {
+            if (p + pr.size > end) { printf("\033[31m-- truncated PLY file\033[0m\n"); return false; }
+            v = readBinary(p, pr.size, pr.kind);
+            p += pr.size;
+          }
+          else {
+            p = skipSpace(p, end);
+            while (p < end && *p == '\n') p = skipSpace(p + 1, end);
+            const char* r = parseFloat(p, end, v);
+            if (r == nullptr) { printf("\033[31m-- malformed PLY record\033[0m\n"); return false; }
+            p = r;
+          }
+          if (isvertex && !pr.list) {
+            for (int c = 0; c < 3; c++) if (xyz[c] == j) pcoords[i * 3 + c] = v;
+          }
+          if (isface && j == vlist) poly.push_back(int(v));
+        }
+      }
+      for (int k = 1; k + 1 < poly.size(); k++) {
+        trifaces.push_back(poly[0]);
+        trifaces.push_back(poly[k]);
+        trifaces.push_back(poly[k + 1]);
+      }
+    }
+  }
+
+  int nv = pcoords.size() / 3;
+  for (int id : trifaces) {
+    if (id < 0 || id >= nv) {
+      printf("\033[31m-- PLY face index out of range\033[0m\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool loadMesh(const std::string& filename, std::vector<float>& pcoords, std::vector<int>& trifaces) {
+  _PROF("load_mesh");
+  std::string ext;
+  size_t dot = filename.find_last_of('.');
+  if (dot != std::string::npos) ext = filename.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  if (ext != "obj" && ext != "stl" && ext != "ply") {
+    printf("\033[31m-- unsupported mesh format %s\033[0m\n", filename.c_str());
+    return false;
+  }
+
+  snippet::mapped_file_t file;
+  if (!file.open(filename, snippet::mapped_file_t::willneed)) {
+    printf("\033[31m-- cannot open mesh %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  if (file.size() == 0) {
+    printf("\033[31m-- empty mesh file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+
+  const char* data = file.data();
+  size_t len = file.size();
+  bool suc;
+  if (ext == "obj") suc = loadOBJ(data, len, pcoords, trifaces);
+  else if (ext == "stl") suc = loadSTL(data, len, pcoords, trifaces);
+  else suc = loadPLY(data, len, pcoords, trifaces);
+
+  if (suc) printf("-- loaded %zu vertices, %zu faces from %s\n", pcoords.size() / 3, trifaces.size() / 3, filename.c_str());
+  return suc;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#ifndef __MESH_LOADER_H
+#define __MESH_LOADER_H
+
+#include "vector"
+#include "string"
+
+// Load a triangle mesh as the flattened pcoords / trifaces taken by HierarchyGrid::genFromMesh.
+// The format follows the extension : .obj, .stl (binary or ascii), .ply (ascii or binary little endian).
+// The file is memory mapped, OBJ records are parsed in parallel chunks, polygons are fan triangulated
+// and STL vertices are merged by exact position.
+bool loadMesh(const std::string& filename, std::vector<float>& pcoords, std::vector<int>& trifaces);
+
+bool loadOBJ(const char* data, size_t len, std::vector<float>& pcoords, std::vector<int>& trifaces);
+
+bool loadSTL(const char* data, size_t len, std::vector<float>& pcoords, std::vector<int>& trifaces);
+
+bool loadPLY(const char* data, size_t len, std::vector<float>& pcoords, std::vector<int>& trifaces);
+
+#endif
+
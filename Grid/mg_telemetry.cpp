@@ -0,0 +1,159 @@
+#include "mg_telemetry.h"
+#include "algorithm"
+#include "cmath"
+#include "cstdio"
+
+using namespace grid;
+
+namespace {
+  // empty field for a missing stage
+  void csv_value(FILE* fp, double v) {
+    if (v >= 0) fprintf(fp, ",%.6e", v);
+    else fprintf(fp, ",");
+  }
+
+  void json_value(FILE* fp, const char* key, double v, bool last = false) {
+    if (v >= 0) fprintf(fp, "\"%s\":%.6e", key, v);
+    else fprintf(fp, "\"%s\":null", key);
+    if (!last) fprintf(fp, ",");
+  }
+
+  struct ratio_mean_t {
+    double sum = 0;
+    int n = 0;
+    void add(double num, double den) {
+      if (num < 0 || den <= 0) return;
+      sum += num / den;
+      n++;
+    }
+    double mean(void) const { return n ? sum / n : -1; }
+  };
+}
+
+void mg_telemetry_t::enable(bool on, size_t capacity) {
+  _enabled = on;
+  if (on && _ring.size() != capacity) {
+    _ring.clear();
+    _ring.resize(std::max<size_t>(capacity, 1));
+    _head = 0;
+    _count = 0;
+  }
+}
+
+mg_cycle_sample_t& mg_telemetry_t::begin_cycle(int nlevel, int pre_relax, int post_relax) {
+  mg_cycle_sample_t& c = _ring[_head];
+  _head = (_head + 1) % _ring.size();
+  _count = std::min(_count + 1, _ring.size());
+  c.cycle = _cycles++;
+  c.pre_relax = pre_relax;
+  c.post_relax = post_relax;
+  c.r_before = c.r_after = c.factor = -1;
+  c.levels.assign(nlevel, mg_level_sample_t());
+  return c;
+}
+
+const mg_cycle_sample_t& mg_telemetry_t::operator[](size_t i) const {
+  return _ring[(_head + _ring.size() - _count + i) % _ring.size()];
+}
+
+void mg_telemetry_t::clear(void) {
+  _head = 0;
+  _count = 0;
+  _cycles = 0;
+}
+
+bool mg_telemetry_t::writeCSV(const std::string& filename) const {
+  FILE* fp = fopen(filename.c_str(), "w");
+  if (!fp) {
+    printf("\033[31m-- cannot open telemetry file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  fprintf(fp, "cycle,pre_relax,post_relax,r_before,r_after,factor,layer,force,before_smooth,after_smooth,after_correction,after_post\n");
+  for (size_t k = 0; k < size(); k++) {
+    const mg_cycle_sample_t& c = (*this)[k];
+    for (int i = 0; i < c.levels.size(); i++) {
+      const mg_level_sample_t& l = c.levels[i];
+      if (l.force < 0) continue;
+      fprintf(fp, "%lld,%d,%d", c.cycle, c.pre_relax, c.post_relax);
+      csv_value(fp, c.r_before);
+      csv_value(fp, c.r_after);
+      csv_value(fp, c.factor);
+      fprintf(fp, ",%d", i);
+      csv_value(fp, l.force);
+      csv_value(fp, l.before_smooth);
+      csv_value(fp, l.after_smooth);
+      csv_value(fp, l.after_correction);
+      csv_value(fp, l.after_post);
+      fprintf(fp, "\n");
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+bool mg_telemetry_t::writeJSON(const std::string& filename) const {
+  FILE* fp = fopen(filename.c_str(), "w");
+  if (!fp) {
+    printf("\033[31m-- cannot open telemetry file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  fprintf(fp, "{\"cycles\":[\n");
+  for (size_t k = 0; k < size(); k++) {
+    const mg_cycle_sample_t& c = (*this)[k];
+    fprintf(fp, "%s{\"cycle\":%lld,\"pre_relax\":%d,\"post_relax\":%d,", k ? ",\n" : "", c.cycle, c.pre_relax, c.post_relax);
+    json_value(fp, "r_before", c.r_before);
+    json_value(fp, "r_after", c.r_after);
+    json_value(fp, "factor", c.factor);
+    fprintf(fp, "\"levels\":[");
+    bool first = true;
+    for (int i = 0; i < c.levels.size(); i++) {
+      const mg_level_sample_t& l = c.levels[i];
+      if (l.force < 0) continue;
+      fprintf(fp, "%s{\"layer\":%d,", first ? "" : ",", i);
+      json_value(fp, "force", l.force);
+      json_value(fp, "before_smooth", l.before_smooth);
+      json_value(fp, "after_smooth", l.after_smooth);
+      json_value(fp, "after_correction", l.after_correction);
+      json_value(fp, "after_post", l.after_post, true);
+      fprintf(fp, "}");
+      first = false;
+    }
+    fprintf(fp, "]}");
+  }
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+  return true;
+}
+
+void mg_telemetry_t::report(void) const {
+  if (size() == 0) return;
+  int nlevel = 0;
+  for (size_t k = 0; k < size(); k++) nlevel = std::max<int>(nlevel, (*this)[k].levels.size());
+  std::vector<ratio_mean_t> smooth(nlevel), correction(nlevel), post(nlevel);
+  double logsum = 0;
+  int nfactor = 0;
+  for (size_t k = 0; k < size(); k++) {
+    const mg_cycle_sample_t& c = (*this)[k];
+    if (c.factor > 0) {
+      logsum += std::log(c.factor);
+      nfactor++;
+    }
+    for (int i = 0; i < c.levels.size(); i++) {
+      const mg_level_sample_t& l = c.levels[i];
+      smooth[i].add(l.after_smooth, l.before_smooth);
+      correction[i].add(l.after_correction, l.after_smooth);
+      post[i].add(l.after_post, l.after_correction);
+    }
+  }
+  printf("-- multigrid telemetry : %zu cycles, mean convergence factor %.4lf\n", size(), nfactor ? std::exp(logsum / nfactor) : -1.);
+  printf("%-6s %12s %12s %12s\n", "layer", "smooth", "correction", "post");
+  for (int i = 0; i < nlevel; i++) {
+    if (smooth[i].n == 0) continue;
+    printf("%-6d", i);
+    for (const ratio_mean_t* r : { &smooth[i], &correction[i], &post[i] }) {
+      if (r->n) printf(" %12.4lf", r->mean());
+      else printf(" %12s", "-");
+    }
+    printf("\n");
+  }
+}
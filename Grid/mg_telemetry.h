@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef __MG_TELEMETRY_H
+#define __MG_TELEMETRY_H
+
+#include "string"
+#include "vector"
+
+namespace grid {
+
+	// residual norms of one level in one cycle, -1 where the stage does not exist (dummy layer, no post smoothing on the coarsest)
+	struct mg_level_sample_t {
+		// norm of the right hand side of the level, the restricted residual on coarse levels
+		double force = -1;
+		// before and after the pre smoothing, the direct solve on the coarsest level
+		double before_smooth = -1;
+		double after_smooth = -1;
+		// after the prolongated coarse correction is added and after the post smoothing
+		double after_correction = -1;
+		double after_post = -1;
+	};
+
+	struct mg_cycle_sample_t {
+		long long cycle = 0;
+		// -1 when the per layer sweeps of the hierarchy are used
+		int pre_relax = 0;
+		int post_relax = 0;
+		// relative residual of the finest level before and after the cycle, factor = r_after / r_before
+		double r_before = -1;
+		double r_after = -1;
+		double factor = -1;
+		std::vector<mg_level_sample_t> levels;
+	};
+
+	/*
+	  Ring buffer of per-level convergence samples of the multigrid cycles, the oldest cycles are overwritten.
+	  Recording costs one residual update and norm per stage and level, the cycle only checks enabled() when it is off.
+	*/
+	class mg_telemetry_t {
+		std::vector<mg_cycle_sample_t> _ring;
+		size_t _head = 0;
+		size_t _count = 0;
+		long long _cycles = 0;
+		bool _enabled = false;
+		bool _paused = false;
+	public:
+		void enable(bool on, size_t capacity = 4096);
+
+		bool enabled(void) const { return _enabled && !_paused; }
+
+		// skip recording without dropping the buffer, e.g. during calibration cycles
+		void pause(bool paused) { _paused = paused; }
+
+		// slot of the next cycle with nlevel cleared level samples
+		mg_cycle_sample_t& begin_cycle(int nlevel, int pre_relax, int post_relax);
+
+		// recorded cycles, 0 is the oldest
+		size_t size(void) const { return _count; }
+
+		const mg_cycle_sample_t& operator[](size_t i) const;
+
+		void clear(void);
+
+		// one line per (cycle, level)
+		bool writeCSV(const std::string& filename) const;
+
+		bool writeJSON(const std::string& filename) const;
+
+		// mean reduction of every stage per level and the geometric mean convergence factor of the cycles
+		void report(void) const;
+	};
+};
+
+#endif
+
@@ -1,8 +1,18 @@
 #include "optimization.h"
 #include "projection.h"
+#include "lobpcg.h"
+#include "checkpoint.h"
+#include "capture.h"
+#include "roofline.h"
+#include "async_writer_t.h"
+#include "history_store_t.h"
 //#include "matlab_utils.h"
 #include "binaryIO.h"
 #include "tictoc.h"
+#include "profiler.h"
+#include "memory_registry.h"
+#include <filesystem>
+#include <list>
 
 
 gpu_manager_t gpu_manager;
@@ -11,10 +21,58 @@ grid::HierarchyGrid grids(gpu_manager);
 
 Parameter params;
 
+// per-iteration outputs are written in background while the next iteration runs
+static async_writer_t output_writer;
+
+// density and worst-case load of every iteration, delta compressed
+static history_writer_t density_history;
+static history_writer_t load_history;
+// gs index of every element rank of the finest layer, density frames are recorded in rank order
+static std::vector<int> history_eidmap;
+
+enum WorstCaseSolver {
+  power_method,
+  block_lobpcg
+};
+
+static WorstCaseSolver worst_case_solver = power_method;
+
+static int checkpoint_interval = 0;
+
+static std::string checkpoint_resume;
+
+// grid capture next to the checkpoint of these grids, empty after the grids are rebuilt
+static std::string checkpoint_grid;
+
+// iteration whose solver state is captured for replay, 0 disables
+static int capture_itn = 0;
+
+// kernels timed against the roofline at the end of a run, a peak <= 0 is taken from the device
+static bool roofline_enabled = false;
+static double roofline_peak_gbps = 0;
+static double roofline_peak_gflops = 0;
+
+// per layer sweeps of the v-cycle are tuned again when the void fraction moved by more than the threshold
+static bool cycle_tuning = false;
+static double cycle_retune_threshold = 0.1;
+static double cycle_tuned_void = -1;
+
 void buildGrids(const std::vector<float>& coords, const std::vector<int>& trifaces) {
   grids.set_prefer_reso(params.gridreso);
   grids.set_skip_layer(true);
+  _PROF("build_grids");
   grids.genFromMesh(coords, trifaces);
+  cycle_tuned_void = -1;
+  checkpoint_grid.clear();
+}
+
+void buildGrids(const grid::sdf_t& sdf) {
+  grids.set_prefer_reso(params.gridreso);
+  grids.set_skip_layer(true);
+  _PROF("build_grids");
+  grids.genFromSDF(sdf);
+  cycle_tuned_void = -1;
+  checkpoint_grid.clear();
 }
 
 void logParams(std::string file, std::string version_str, int argc, char** argv) {
@@ -74,6 +132,17 @@ void setWorkMode(const std::string& modestr) {
   }
 }
 
+void setWorstCaseSolver(const std::string& solverstr) {
+  if (solverstr == "pm") {
+    worst_case_solver = power_method;
+  } else if (solverstr == "lobpcg") {
+    worst_case_solver = block_lobpcg;
+  } else {
+    printf("-- unsupported worst case solver\n");
+    exit(-1);
+  }
+}
+
 void solveFEM(void) {
   double rel_res = 1;
   while (rel_res > 1e-4) {
@@ -157,12 +226,12 @@ double modifiedPM(void) {
   while (itn++ < max_itn && (fch > 1e-4 || rel_res > 1e-2)) {
 #if 1
     // do one v_cycle
-    rel_res = grids.v_cycle(1, 1);
+    rel_res = grids.v_cycle();
 #else
     if (fchserial.arising() && itn > 30) {
       rel_res = grids.v_halfcycle(1, 1, 1);
     } else {
-      rel_res = grids.v_cycle(1, 1);
+      rel_res = grids.v_cycle();
     }
 #endif
 
@@ -254,6 +323,43 @@ double modifiedPM(void) {
   return worstCompliance;
 }
 
+double modifiedLOBPCG(int n_mode /*= 3*/) {
+  printf("\033[32m[LOBPCG]\n\033[0m");
+
+  lobpcg_setting_t setting;
+  setting.n_mode = n_mode;
+
+  auto modes = lobpcgWorstModes(grids, setting);
+  if (modes.empty()) {
+    printf("\033[33m-- LOBPCG failed, falling back to the power method\033[0m\n");
+    return modifiedPM();
+  }
+
+  for (int i = 0; i < modes.size(); i++) {
+    printf("-- mode %d : c = %6.3e, r_rel %6.2lf%%\n", i, modes[i].compliance, modes[i].residual * 100);
+  }
+
+  // several modes share the worst compliance, a single load case is not representative
+  int n_degenerate = countDegenerateModes(modes, setting.degenerate_gap);
+  if (n_degenerate > 1) {
+    printf("\033[33m-- worst case is near-degenerate, %d modes within %2.1lf%%\033[0m\n", n_degenerate, setting.degenerate_gap * 100);
+  }
+  grids[0]->_keyvalues["n_degenerate"] = n_degenerate;
+
+  double worstCompliance = grids[0]->compliance();
+
+  if (isnan(worstCompliance)) {
+    printf("\033[31m-- NaN occurred !\033[0m\n");
+    exit(-1);
+  }
+
+  grids[0]->_keyvalues["mu"] = worstCompliance;
+
+  printf("-- Worst Compliance %6.3e\n", worstCompliance);
+
+  return worstCompliance;
+}
+
 #if 0
 double eigenCG(void) {
   // f ( u ) = u ^T P u / u ^ T K u;
@@ -435,7 +541,7 @@ double inCompleteModiPM(double fch_thres /*= 1e-2*/) {
   // 1e-5
   while (itn++<max_itn && fch>fch_thres) {
     // do one v_cycle
-    rel_res = grids.v_cycle(1, 1);
+    rel_res = grids.v_cycle();
 
     // project to balanced load on load region
     grids[0]->v3_copy(grids[0]->getDisplacement(), grids[0]->getForce());
@@ -571,10 +677,32 @@ void findAdjointVariabls(void) {
   //grids[0]->v3_add(2, grids[0]->getDisplacement(), -2 * grids[0]->_keyvalues["mu"], grids[0]->getWorstForce());
 }
 
-void optimization(void) {
-  // allocated total size
-  printf("[GPU] Total Mem :  %4.2lfGB\n", double(gpu_manager.size()) / 1024 / 1024 / 1024);
+// density frames only hold the values of the active elements in lattice rank order, the lattice they belong to is
+// written next to the history (its values are the density at open) for exporting a frame later
+static void setHistoryLattice(const std::string& prefix) {
+  Grid& g = *grids[0];
+  history_eidmap.resize(g.n_elements);
+  gpu_manager_t::download_buf(history_eidmap.data(), g._gbuf.eidmap, sizeof(int) * g.n_elements);
+  grids.writeDensity(grids.getPath(prefix + "density_lattice.svb"));
+}
 
+// the value counts depend on the lattice, reopen after the grids are rebuilt
+static void openHistory(const std::string& prefix) {
+  setHistoryLattice(prefix);
+  density_history.open(grids.getPath(prefix + "density.hist"), grids[0]->n_valid_elements(), 16, 0, 1);
+  load_history.open(grids.getPath(prefix + "load.hist"), 3 * n_loadnodes(), 16);
+}
+
+// continue the histories of the run a checkpoint was written by, start new ones if they cannot be reopened
+static void resumeHistory(const std::string& prefix, int itn) {
+  setHistoryLattice(prefix);
+  if (!density_history.resume(grids.getPath(prefix + "density.hist"), grids[0]->n_valid_elements(), itn))
+    density_history.open(grids.getPath(prefix + "density.hist"), grids[0]->n_valid_elements(), 16, 0, 1);
+  if (!load_history.resume(grids.getPath(prefix + "load.hist"), 3 * n_loadnodes(), itn))
+    load_history.open(grids.getPath(prefix + "load.hist"), 3 * n_loadnodes(), 16);
+}
+
+static void optimizationSetup(OptimizationState& state) {
   grids.testShell();
 
   initDensities(params.volume_ratio);
@@ -586,22 +714,71 @@ void optimization(void) {
 
   grids[0]->randForce();
 
-  //float Vgoal = 1;
-  float Vgoal = params.volume_ratio;
+  state.Vgoal = params.volume_ratio;
 
-  int itn = 0;
+  reportMemory("setup");
+}
+
+static void recordDensityHistory(int itn) {
+  std::vector<float> rhohost(grids[0]->n_rho());
+  gpu_manager_t::download_buf(rhohost.data(), grids[0]->getRho(), sizeof(float) * rhohost.size());
+  std::vector<float> rho(history_eidmap.size());
+  for (int i = 0; i < rho.size(); i++) rho[i] = rhohost[history_eidmap[i]];
+  density_history.append(itn, rho.data());
+}
 
-  snippet::converge_criteria stop_check(1, 2, 5e-3);
+static void recordLoadHistory(int itn) {
+  std::vector<double> fs[3];
+  getForceSupport(grids[0]->getForce(), fs);
+  std::vector<float> f;
+  f.reserve(3 * fs[0].size());
+  for (int i = 0; i < 3; i++) f.insert(f.end(), fs[i].begin(), fs[i].end());
+  load_history.append(itn, f.data());
+}
+
+// fraction of elements whose penalized stiffness is below 1% of the solid, the soft regions are what slows the smoothers down
+static double voidFraction(void) {
+  std::vector<float> rho(grids[0]->n_rho());
+  gpu_manager_t::download_buf(rho.data(), grids[0]->getRho(), sizeof(float) * rho.size());
+  float thres = std::pow(0.01f, 1.f / params.power_penalty);
+  size_t nvoid = 0;
+  for (float r : rho) nvoid += r < thres;
+  return rho.empty() ? 0 : double(nvoid) / rho.size();
+}
+
+// tune on the current stencils when the density layout changed enough since the last tuning
+static void tuneCycle(void) {
+  if (!cycle_tuning) return;
+  double vf = voidFraction();
+  if (cycle_tuned_void >= 0 && std::abs(vf - cycle_tuned_void) < cycle_retune_threshold) return;
+  printf("-- tuning multigrid sweeps, void fraction %.3lf\n", vf);
+  // calibrate on a balanced random load as the power method does, the current force is kept
+  auto fbackup = grids[0]->v3_backup(grids[0]->getForce());
+  grids[0]->randForce();
+  forceProject(grids[0]->getForce());
+  grids[0]->unitizeForce();
+  grids.tune_sweeps();
+  cycle_tuned_void = vf;
+}
 
-  std::vector<double> cRecord, volRecord;
+void enableCycleTuning(bool on, double retune_threshold) {
+  cycle_tuning = on;
+  cycle_retune_threshold = retune_threshold;
+  cycle_tuned_void = -1;
+  if (!on) grids.set_sweeps({}, {});
+}
 
-  std::vector<double> tRecord;
+bool optimizationIterations(OptimizationState& state, int max_itn) {
+  float& Vgoal = state.Vgoal;
 
   double Vc = Vgoal - params.volume_ratio;
 
-  while (itn++ < 100) {
+  while (state.itn < max_itn) {
+    int itn = ++state.itn;
     printf("\n* \033[32mITER %d \033[0m*\n", itn);
 
+    _PROF("iteration");
+
     Vgoal *= (1 - params.volume_decrease);
 
     Vc = Vgoal - params.volume_ratio;
@@ -611,57 +788,337 @@ void optimization(void) {
     // update numeric stencil after density changed
     update_stencil();
 
+    tuneCycle();
+
+    // the state the worst case solver starts from : restricted stencils, sweeps and the last displacement
+    if (capture_itn > 0 && itn == capture_itn) {
+      _PROF("capture");
+      writeCapture(grids.getPath(snippet::formated("capture_iter%d", itn)), itn);
+    }
+
     // solve worst displacement by modified power method
+    tictoc::prof::scope worst_scope("worst_case");
     auto t0 = tictoc::getTag();
 #if 1
-    double c_worst = modifiedPM();
+    double c_worst = worst_case_solver == block_lobpcg ? modifiedLOBPCG() : modifiedPM();
 #else
     double c_worst = MGPSOR();
 #endif
     auto t1 = tictoc::getTag();
-    tRecord.emplace_back(tictoc::Duration<tictoc::ms>(t0, t1));
+    worst_scope.stop();
+    state.tRecord.emplace_back(tictoc::Duration<tictoc::ms>(t0, t1));
 
-    grids.writeSupportForce(grids.getPath(snippet::formated("iter%d_fs", itn)));
+    {
+      _PROF("record");
+      output_writer.writeSupportForce(grids, grids.getPath(snippet::formated("iter%d_fs", itn)));
+      recordLoadHistory(itn);
+    }
 
-    cRecord.emplace_back(c_worst);
-    volRecord.emplace_back(Vgoal);
+    state.cRecord.emplace_back(c_worst);
+    state.volRecord.emplace_back(Vgoal);
 
-    if (stop_check.update(c_worst, &Vc) && Vgoal <= params.volume_ratio + 1e-3) break;
+    if (state.stop_check.update(c_worst, &Vc) && Vgoal <= params.volume_ratio + 1e-3) return true;
 
     grids.log(itn);
     // compute adjoint variables
     //findAdjointVariabls();
 
     // compute sensitivity
-    computeSensitivity();
+    { _PROF("sensitivity"); computeSensitivity(); }
 
     // update density
-    updateDensities(Vgoal);
+    { _PROF("update_density"); updateDensities(Vgoal); }
+    { _PROF("record"); recordDensityHistory(itn); }
+
+    if (checkpoint_interval > 0 && itn % checkpoint_interval == 0) {
+      _PROF("checkpoint");
+      writeCheckpoint(grids.getPath("checkpoint"), state);
+      // the lattice does not change during a run, its capture is written once
+      if (checkpoint_grid != grids.getPath("checkpoint.grid") && writeCapture(grids.getPath("checkpoint.grid"), itn)) {
+        checkpoint_grid = grids.getPath("checkpoint.grid");
+      }
+    }
 
     // DEBUG
     if (itn % 5 == 0) {
-      grids.writeDensity(grids.getPath("out.vdb"));
-      grids.writeSensitivity(grids.getPath("sens.vdb"));
+      output_writer.writeDensity(grids, grids.getPath("out.svb"));
+      output_writer.writeSensitivity(grids, grids.getPath("sens.svb"));
     }
   }
 
+  return false;
+}
+
+static void optimizationFinish(OptimizationState& state) {
   printf("\n=   finished   =\n");
 
+  output_writer.flush();
+
+  density_history.close();
+  load_history.close();
+
   // write result density field
-  grids.writeDensity(grids.getPath("out.vdb"));
+  grids.writeDensity(grids.getPath("out.svb"));
 
   // write worst compliance record during optimization
-  bio::write_vector(grids.getPath("cworst"), cRecord);
+  bio::write_vector(grids.getPath("cworst"), state.cRecord);
 
   // write volume record during optimization
-  bio::write_vector(grids.getPath("vrec"), volRecord);
+  bio::write_vector(grids.getPath("vrec"), state.volRecord);
 
   // write time cost record during optimization
-  bio::write_vector(grids.getPath("trec"), tRecord);
+  bio::write_vector(grids.getPath("trec"), state.tRecord);
 
   // write last worst f and u
   grids.writeSupportForce(grids.getPath("flast"));
   grids.writeDisplacement(grids.getPath("ulast"));
+
+  // write density, sensitivity and worst displacement for visualization
+  grids.writeVTU(grids.getPath("result.vtu"), true);
+
+  // write the optimized shape
+  grids.writeSurface(grids.getPath("result.stl"));
+
+  reportMemory("optimization");
+
+  writeProfile("");
+
+  writeTelemetry("");
+
+  writeRoofline("");
+}
+
+void enableProfiling(bool on, bool sync_device, bool hw_counters) {
+  tictoc::prof::enable(on);
+  tictoc::prof::set_sync(on && sync_device ? std::function<void(void)>(gpu_manager_t::synchronize) : nullptr);
+  tictoc::prof::enable_counters(on && hw_counters);
+}
+
+void writeProfile(const std::string& prefix) {
+  if (!tictoc::prof::enabled()) return;
+  printf("-- writing profile to %s\n", grids.getPath(prefix + "profile.csv").c_str());
+  tictoc::prof::report();
+  tictoc::prof::writeCSV(grids.getPath(prefix + "profile.csv"));
+  tictoc::prof::writeChromeTrace(grids.getPath(prefix + "profile.json"));
+}
+
+void enableRoofline(bool on, double peak_gbps, double peak_gflops) {
+  roofline_enabled = on;
+  roofline_peak_gbps = peak_gbps;
+  roofline_peak_gflops = peak_gflops;
+}
+
+void writeRoofline(const std::string& prefix) {
+  if (!roofline_enabled) return;
+  _PROF("roofline");
+
+  double gbps = roofline_peak_gbps, gflops = roofline_peak_gflops;
+  if (gbps <= 0 || gflops <= 0) {
+    double dev_gbps, dev_gflops;
+    gpu_manager_t::device_peak(&dev_gbps, &dev_gflops);
+    if (gbps <= 0) gbps = dev_gbps;
+    if (gflops <= 0) gflops = dev_gflops;
+  }
+
+  grid::roofline_t roof;
+  roof.set_peak(gbps, gflops);
+  auto median = [](std::function<void(void)> fn) { return grid::timeKernel(fn, 10).median; };
+
+  // the kernels run on the final state, fields and sensitivity are restored afterwards
+  std::list<grid::hostbufbackup_t<double, 3>> backups;
+  for (int i = 0; i < grids.n_grid(); i++) {
+    Grid* g = grids[i];
+    if (g->is_dummy()) continue;
+    backups.emplace_back(g->getDisplacement(), g->n_gsvertices);
+    backups.emplace_back(g->getForce(), g->n_gsvertices);
+    backups.emplace_back(g->getResidual(), g->n_gsvertices);
+  }
+  std::vector<float> senshost(grids[0]->n_rho());
+  gpu_manager_t::download_buf(senshost.data(), grids[0]->getSens(), sizeof(float) * senshost.size());
+
+  int nlayer = grids.n_grid();
+  for (int i = 0; i < nlayer; i++) {
+    Grid* g = grids[i];
+    if (g->is_dummy()) continue;
+    g->use_grid();
+    if (i < nlayer - 1) {
+      roof.add("gs_relax", i, grid::relaxCost(*g), median([=]() { g->gs_relax(); }));
+      roof.add("update_residual", i, grid::residualCost(*g), median([=]() { g->update_residual(); }));
+      roof.add("prolongate_correction", i, grid::prolongateCost(*g), median([=]() { g->prolongate_correction(); }));
+    }
+    if (i > 0) {
+      roof.add("restrict_residual", i, grid::restrictCost(*g), median([=]() { g->restrict_residual(); }));
+      roof.add("restrict_stencil", i, grid::stencilCost(*g), median([=]() { grids.restrict_stencil(*g, *g->fineGrid); }));
+    }
+  }
+  Grid* g0 = grids[0];
+  int radius = params.filter_radius;
+  g0->use_grid();
+  roof.add("filterSensitivity", 0, grid::filterCost(*g0, radius), median([=]() { g0->filterSensitivity(radius); }));
+  roof.add("computeSensitivity", 0, grid::sensitivityCost(*g0, radius), median([]() { computeSensitivity(); }));
+
+  gpu_manager_t::upload_buf(grids[0]->getSens(), senshost.data(), sizeof(float) * senshost.size());
+
+  printf("-- writing roofline to %s\n", grids.getPath(prefix + "roofline.csv").c_str());
+  roof.report();
+  roof.writeCSV(grids.getPath(prefix + "roofline.csv"));
+}
+
+void enableTelemetry(bool on, size_t capacity) {
+  grids._telemetry.enable(on, capacity);
+  grids._telemetry.clear();
+}
+
+void writeTelemetry(const std::string& prefix) {
+  if (!grids._telemetry.enabled()) return;
+  printf("-- writing multigrid telemetry to %s\n", grids.getPath(prefix + "mg_telemetry.csv").c_str());
+  grids._telemetry.report();
+  grids._telemetry.writeCSV(grids.getPath(prefix + "mg_telemetry.csv"));
+  grids._telemetry.writeJSON(grids.getPath(prefix + "mg_telemetry.json"));
+}
+
+void reportMemory(const std::string& phase) {
+  grid::mem::report(phase);
+  size_t free_bytes = 0;
+  size_t device_bytes = gpu_manager_t::device_memory(&free_bytes);
+  int device_reso = grid::mem::predictResolution(grid::mem::device, params.gridreso, device_bytes);
+  int host_reso = grid::mem::predictResolution(grid::mem::host, params.gridreso, grid::mem::host_capacity());
+  // allocated total size
+  printf("[GPU] Total Mem :  %4.2lfGB\n", double(gpu_manager.size()) / 1024 / 1024 / 1024);
+  printf("[GPU] capacity %4.2lfGB, free %4.2lfGB\n", double(device_bytes) / 1024 / 1024 / 1024, double(free_bytes) / 1024 / 1024 / 1024);
+  printf("-- largest resolution that fits : device %d, host %d\n", device_reso, host_reso);
+}
+
+void setCheckpoint(int interval, const std::string& resume_file) {
+  checkpoint_interval = interval;
+  checkpoint_resume = resume_file;
+}
+
+bool resumeGrids(void) {
+  if (checkpoint_resume.empty()) return false;
+  std::string gridfile = checkpoint_resume + ".grid";
+  if (!std::filesystem::exists(gridfile)) {
+    printf("\033[33m-- no grid capture %s, the grids are rebuilt\033[0m\n", gridfile.c_str());
+    return false;
+  }
+  _PROF("restore_grids");
+  if (!readCapture(gridfile)) return false;
+  cycle_tuned_void = -1;
+  checkpoint_grid = gridfile;
+  return true;
+}
+
+void setCapture(int itn) {
+  capture_itn = itn;
+}
+
+void optimization(void) {
+  OptimizationState state;
+
+  optimizationSetup(state);
+
+  if (!checkpoint_resume.empty() && !readCheckpoint(checkpoint_resume, state)) {
+    printf("\033[31mfailed to resume from %s\033[0m\n", checkpoint_resume.c_str());
+    exit(-1);
+  }
+
+  // a resumed run appends to its histories instead of truncating them
+  if (checkpoint_resume.empty()) openHistory("");
+  else resumeHistory("", state.itn);
+
+  optimizationIterations(state, 100);
+
+  optimizationFinish(state);
+}
+
+void parameterSweep(const std::vector<SweepVariant>& variants) {
+  Parameter base_params = params;
+  std::string base_dir = grids._outdir;
+  std::string resume = checkpoint_resume;
+
+  // a checkpoint belongs to one run, never resume sweep variants from it
+  checkpoint_resume.clear();
+
+  for (int i = 0; i < variants.size(); i++) {
+    const SweepVariant& var = variants[i];
+    std::string vardir = base_dir + var.name;
+    std::error_code ec;
+    std::filesystem::create_directories(vardir, ec);
+    if (ec) {
+      printf("\033[31m-- cannot create directory %s, variant skipped\033[0m\n", vardir.c_str());
+      continue;
+    }
+
+    printf("\n= sweep variant %d/%d : %s =\n", i + 1, int(variants.size()), var.name.c_str());
+    printf("-- vol %4.2f  penal %4.2f  filter %d  min_rho %4.2e\n", var.volume_ratio, var.power_penalty, var.filter_radius, var.min_rho);
+
+    params = base_params;
+    params.volume_ratio = var.volume_ratio;
+    params.power_penalty = var.power_penalty;
+    params.filter_radius = var.filter_radius;
+    params.min_rho = var.min_rho;
+    setOutpurDir(vardir + "/");
+
+    // profile and telemetry of a variant start empty, the files in its directory cover only its own run
+    tictoc::prof::reset();
+    grids._telemetry.clear();
+
+    // topology and projection are kept, only the penalty coefficient is re-uploaded.
+    // densities, U/F, sensitivity and stencils are reinitialized by optimization()
+    uploadTemplateMatrix();
+
+    optimization();
+  }
+
+  params = base_params;
+  grids.setOutPath(base_dir);
+  checkpoint_resume = resume;
+  uploadTemplateMatrix();
+}
+
+void multiResOptimization(const std::vector<float>& coords, const std::vector<int>& trifaces, int coarse_reso, int coarse_itn) {
+  int fine_reso = params.gridreso;
+  if (coarse_reso >= fine_reso || coarse_itn <= 0) {
+    printf("-- coarse stage skipped (reso %d, itn %d)\n", coarse_reso, coarse_itn);
+    buildGrids(coords, trifaces);
+    uploadTemplateMatrix();
+    optimization();
+    return;
+  }
+
+  OptimizationState state;
+
+  // coarse stage, the hierarchy and projection data are globals, so the two stages run on the same grids in turn
+  printf("\n= coarse stage : reso %d, %d iterations =\n", coarse_reso, coarse_itn);
+  params.gridreso = coarse_reso;
+  buildGrids(coords, trifaces);
+  uploadTemplateMatrix();
+  optimizationSetup(state);
+  openHistory("coarse_");
+  bool converged = optimizationIterations(state, coarse_itn);
+  grid::density_field_t field = grids.getDensityField();
+  output_writer.writeDensity(grids, grids.getPath("coarse.svb"));
+  output_writer.flush();
+
+  // fine stage, start from the prolongated coarse densities
+  printf("\n= fine stage : reso %d =\n", fine_reso);
+  grids.clear();
+  params.gridreso = fine_reso;
+  buildGrids(coords, trifaces);
+  uploadTemplateMatrix();
+  reportMemory("fine stage build");
+  grids.prolongateDensity(field);
+  grids.fillShell();
+  grids[0]->randForce();
+  openHistory("");
+
+  // the compliance level changes with the lattice, restart the convergence history
+  state.stop_check = snippet::converge_criteria(1, 2, 5e-3);
+  if (converged) printf("-- coarse stage converged, refining on fine lattice\n");
+
+  optimizationIterations(state, 100);
+
+  optimizationFinish(state);
 }
 
 grid::HierarchyGrid& getGrids(void) {
@@ -672,6 +1129,14 @@ void setBoundaryCondition(std::function<bool(double[3])> fixarea, std::function<
   grids._inFixedArea = fixarea;
   grids._inLoadArea = loadarea;
   grids._loadField = loadforce;
+  grids._regions.enabled = false;
+}
+
+void setBoundaryRegions(const grid::region_t& fixarea, const grid::region_t& loadarea, const double force[3]) {
+  grids._regions.enabled = true;
+  grids._regions.fixed = fixarea;
+  grids._regions.load = loadarea;
+  for (int i = 0; i < 3; i++) grids._regions.force[i] = force[i];
 }
 
 void initDensities(double rho) {
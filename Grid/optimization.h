@@ -27,6 +27,9 @@ extern gpu_manager_t gpu_manager;
 
 void buildGrids(const std::vector<float>& coords, const std::vector<int>& trifaces);
 
+// build the grids from an implicit solid, no mesh voxelization or AABB tree
+void buildGrids(const grid::sdf_t& sdf);
+
 void logParams(std::string file, std::string version_str, int argc, char** argv);
 
 void setParameters(
@@ -38,6 +41,9 @@ void setOutpurDir(const std::string& dirname);
 
 void setWorkMode(const std::string& modestr);
 
+// "pm" : modified power method, "lobpcg" : block LOBPCG preconditioned by V-cycle
+void setWorstCaseSolver(const std::string& solverstr);
+
 void setDEBUG(bool debug = false);
 
 double solveAdjointSystem(void);
@@ -51,6 +57,10 @@ double modifiedPM(void);
 
 double eigenCG(void);
 
+// solve several worst-case modes together by LOBPCG, return the worst compliance. Falls back to modifiedPM when
+// LOBPCG cannot start
+double modifiedLOBPCG(int n_mode = 3);
+
 // (pnorm, knorm)
 std::pair<double, double> RayleighGradient(double* u[3], double* g[3]);
 
@@ -68,12 +78,85 @@ bool checkAdjointVariable(void);
 
 float updateDensities(float Vgoal);
 
+struct OptimizationState {
+	int itn = 0;
+	float Vgoal = 1;
+	std::vector<double> cRecord, volRecord, tRecord;
+	snippet::converge_criteria stop_check{ 1, 2, 5e-3 };
+};
+
+// run iterations until converged or state.itn reaches max_itn, return true if converged
+bool optimizationIterations(OptimizationState& state, int max_itn);
+
+// write a checkpoint to <outdir>/checkpoint every interval iterations (0 disables),
+// resume optimization() from resume_file if it is not empty. The first checkpoint of a run also captures the grids
+// to <outdir>/checkpoint.grid
+void setCheckpoint(int interval, const std::string& resume_file = "");
+
+// restore the grids from <resume_file>.grid instead of building them from the mesh, false if there is none
+// or it cannot be read, the grids then have to be built
+bool resumeGrids(void);
+
+// capture the whole hierarchy to <outdir>/capture_iter<itn> after the stencil update of iteration itn (0 disables),
+// the state can be loaded by readCapture (capture.h) and its kernels timed by the replay tool
+void setCapture(int itn);
+
 void optimization(void);
 
+// record the hierarchical profile (tictoc::prof) of grid building, iterations and v-cycles,
+// sync_device synchronizes the GPU at scope boundaries so kernel time is attributed to the scope launching it,
+// hw_counters adds the host cycles, instructions and LLC misses of every scope (perf_event, see tictoc::prof).
+// The device kernels only show up in these as launch and synchronization, the host side solves in full
+void enableProfiling(bool on, bool sync_device = true, bool hw_counters = false);
+
+// print the profile and write <outdir>/<prefix>profile.csv and the chrome trace <prefix>profile.json, optimization() calls it
+void writeProfile(const std::string& prefix);
+
+// record the residual of every level before / after smoothing and after the coarse correction in each v-cycle,
+// the last capacity cycles are kept
+void enableTelemetry(bool on, size_t capacity = 4096);
+
+// print the per level reductions and write <outdir>/<prefix>mg_telemetry.csv and .json, optimization() calls it
+void writeTelemetry(const std::string& prefix);
+
+// time every solver kernel per layer at the end of optimization() and compare its nominal bytes and flops (roofline.h)
+// with the peaks of the device, a peak <= 0 is derived from the device clocks
+void enableRoofline(bool on, double peak_gbps = 0, double peak_gflops = 0);
+
+// print the roofline table and write <outdir>/<prefix>roofline.csv, optimization() calls it
+void writeRoofline(const std::string& prefix);
+
+// choose the v-cycle sweeps of every layer from calibration cycles before the first iteration and again whenever
+// the fraction of void elements changed by more than retune_threshold since the last tuning
+void enableCycleTuning(bool on, double retune_threshold = 0.1);
+
+// print the host and device memory by category and layer (grid::mem) with the peaks since the previous report,
+// and the largest resolution whose peak would fit the device and the host
+void reportMemory(const std::string& phase);
+
+struct SweepVariant {
+	// name of the output subdirectory
+	std::string name;
+	float volume_ratio;
+	float power_penalty;
+	int filter_radius;
+	float min_rho;
+};
+
+// run optimization() once per variant on the already built grids, outputs go to <outdir>/<name>/
+void parameterSweep(const std::vector<SweepVariant>& variants);
+
+// build the grids on a coarse_reso lattice and run coarse_itn iterations there, then prolongate
+// the densities to params.gridreso and continue there. The iteration cap (100) counts both stages.
+void multiResOptimization(const std::vector<float>& coords, const std::vector<int>& trifaces, int coarse_reso, int coarse_itn);
+
 grid::HierarchyGrid& getGrids(void);
 
 void setBoundaryCondition(std::function<bool(double[3])> fixarea, std::function<bool(double[3])> loadarea, std::function<Eigen::Matrix<double, 3, 1>(double[3])> forcefield);
 
+// declarative alternative to setBoundaryCondition, evaluated in batches over the surface nodes
+void setBoundaryRegions(const grid::region_t& fixarea, const grid::region_t& loadarea, const double force[3]);
+
 // upload template matrix and power penalty coefficient
 void uploadTemplateMatrix(void);
 
@@ -0,0 +1,392 @@
+#include "profiler.h"
+#include "atomic"
+#include "mutex"
+#include "memory"
+#include "vector"
+#include "map"
+#include "tuple"
+#include "algorithm"
+#include "chrono"
+#include "cstdio"
+#include "cstring"
+#include "cerrno"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace tictoc;
+
+namespace {
+  struct event_t {
+    int node;
+    long long t0, t1;
+    // counter deltas, -1 when not counted
+    long long counts[prof::n_counter];
+  };
+
+  struct node_t {
+    int parent;
+    std::string name;
+    int arg;
+  };
+
+  struct thread_buffer_t {
+    int tid;
+    std::vector<event_t> events;
+    std::vector<int> stack;
+    // (parent, name pointer, arg) -> node, saves the global lookup for scopes seen before
+    std::map<std::tuple<int, const char*, int>, int> cache;
+    // perf_event descriptors of the thread, cycles leads the group, -1 for counters that did not open
+    int perf_fd[prof::n_counter] = { -1, -1, -1, -1 };
+    bool perf_opened = false;
+    int perf_error = 0;
+  };
+
+  std::atomic<bool> prof_enabled(false);
+
+  std::mutex prof_mutex;
+
+  std::vector<std::shared_ptr<thread_buffer_t>> prof_buffers;
+
+  std::vector<node_t> prof_nodes;
+
+  std::map<std::tuple<int, std::string, int>, int> prof_node_index;
+
+  std::atomic<bool> prof_counters(false);
+
+  std::function<void(void)> prof_sync;
+
+  std::chrono::steady_clock::time_point prof_origin = std::chrono::steady_clock::now();
+
+  long long now_ns(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - prof_origin).count();
+  }
+
+  thread_buffer_t& local_buffer(void) {
+    // shared with prof_buffers so the records survive the thread
+    thread_local std::shared_ptr<thread_buffer_t> buf;
+    if (!buf) {
+      buf = std::make_shared<thread_buffer_t>();
+      std::lock_guard<std::mutex> lk(prof_mutex);
+      buf->tid = prof_buffers.size();
+      prof_buffers.push_back(buf);
+    }
+    return *buf;
+  }
+
+#ifdef __linux__
+  int open_counter(int counter, int group_fd) {
+    static const unsigned long long configs[prof::n_counter] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES
+    };
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = configs[counter];
+    // user space only, allowed up to perf_event_paranoid = 2
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+  }
+#endif
+
+  // open the counters of the calling thread once, 0 or the errno of the cycles counter
+  int open_counters(thread_buffer_t& buf) {
+    if (buf.perf_opened) return buf.perf_error;
+    buf.perf_opened = true;
+#ifdef __linux__
+    for (int c = 0; c < prof::n_counter; c++) {
+      // counters missing on the machine (LLC events in many VMs) are left out of the group
+      buf.perf_fd[c] = open_counter(c, buf.perf_fd[prof::cycles]);
+      if (c == prof::cycles && buf.perf_fd[c] < 0) {
+        buf.perf_error = errno;
+        break;
+      }
+    }
+#else
+    buf.perf_error = ENOSYS;
+#endif
+    return buf.perf_error;
+  }
+
+  void close_counters(thread_buffer_t& buf) {
+#ifdef __linux__
+    for (int c = prof::n_counter - 1; c >= 0; c--) {
+      if (buf.perf_fd[c] >= 0) close(buf.perf_fd[c]);
+      buf.perf_fd[c] = -1;
+    }
+#endif
+    buf.perf_opened = false;
+    buf.perf_error = 0;
+  }
+
+  // running totals of the thread's counters scaled for multiplexing, -1 for counters that are not counted
+  void read_counters(thread_buffer_t& buf, long long counts[prof::n_counter]) {
+    for (int c = 0; c < prof::n_counter; c++) counts[c] = -1;
+    if (open_counters(buf) != 0) return;
+#ifdef __linux__
+    // nr, time enabled, time running, values of the group in opening order
+    unsigned long long data[3 + prof::n_counter];
+    if (read(buf.perf_fd[prof::cycles], data, sizeof(data)) < ssize_t(3 * sizeof(unsigned long long))) return;
+    double scale = data[2] > 0 ? double(data[1]) / data[2] : 1;
+    int k = 0;
+    for (int c = 0; c < prof::n_counter && k < data[0]; c++) {
+      if (buf.perf_fd[c] < 0) continue;
+      counts[c] = (long long)(data[3 + k] * scale);
+      k++;
+    }
+#endif
+  }
+
+  int find_node(thread_buffer_t& buf, int parent, const char* name, int arg) {
+    auto key = std::make_tuple(parent, name, arg);
+    auto it = buf.cache.find(key);
+    if (it != buf.cache.end()) return it->second;
+    std::lock_guard<std::mutex> lk(prof_mutex);
+    auto gkey = std::make_tuple(parent, std::string(name), arg);
+    auto git = prof_node_index.find(gkey);
+    int id;
+    if (git != prof_node_index.end()) {
+      id = git->second;
+    } else {
+      id = prof_nodes.size();
+      prof_nodes.push_back({ parent, name, arg });
+      prof_node_index[gkey] = id;
+    }
+    buf.cache[key] = id;
+    return id;
+  }
+
+  std::string node_label(const node_t& n) {
+    return n.arg >= 0 ? n.name + "[" + std::to_string(n.arg) + "]" : n.name;
+  }
+
+  std::string node_path(int id) {
+    std::string path;
+    while (id >= 0) {
+      path = path.empty() ? node_label(prof_nodes[id]) : node_label(prof_nodes[id]) + "/" + path;
+      id = prof_nodes[id].parent;
+    }
+    return path;
+  }
+
+  std::string json_escape(const std::string& s) {
+    std::string e;
+    for (char c : s) {
+      if (c == '"' || c == '\\') e.push_back('\\');
+      e.push_back(c);
+    }
+    return e;
+  }
+
+  struct scope_stat_t {
+    std::string path;
+    size_t count;
+    double total, mean, min, max, p50, p90, p99;
+    // counter sums (-1 when never counted) and the time of the counted events
+    long long counts[prof::n_counter];
+    double counted_ms;
+
+    double ratio(int num, int den, double scale = 1) const {
+      return counts[num] >= 0 && counts[den] > 0 ? scale * counts[num] / counts[den] : -1;
+    }
+    double ipc(void) const { return ratio(prof::instructions, prof::cycles); }
+    double llc_miss_rate(void) const { return ratio(prof::llc_misses, prof::llc_references); }
+    double llc_mpki(void) const { return ratio(prof::llc_misses, prof::instructions, 1000); }
+    // every miss moves one 64 B line from memory
+    double llc_gbps(void) const {
+      return counts[prof::llc_misses] >= 0 && counted_ms > 0 ? counts[prof::llc_misses] * 64. / (counted_ms * 1e-3) / 1e9 : -1;
+    }
+  };
+
+  std::vector<scope_stat_t> collect_stats(void) {
+    std::vector<std::vector<double>> durations(prof_nodes.size());
+    std::vector<std::vector<long long>> counts(prof_nodes.size(), std::vector<long long>(prof::n_counter, -1));
+    std::vector<double> counted_ms(prof_nodes.size(), 0);
+    for (auto& buf : prof_buffers) {
+      for (const event_t& e : buf->events) {
+        durations[e.node].push_back((e.t1 - e.t0) * 1e-6);
+        if (e.counts[prof::cycles] < 0) continue;
+        counted_ms[e.node] += (e.t1 - e.t0) * 1e-6;
+        for (int c = 0; c < prof::n_counter; c++) {
+          if (e.counts[c] < 0) continue;
+          long long& sum = counts[e.node][c];
+          sum = sum < 0 ? e.counts[c] : sum + e.counts[c];
+        }
+      }
+    }
+    std::vector<scope_stat_t> stats;
+    for (int i = 0; i < durations.size(); i++) {
+      std::vector<double>& d = durations[i];
+      if (d.empty()) continue;
+      std::sort(d.begin(), d.end());
+      scope_stat_t s;
+      s.path = node_path(i);
+      s.count = d.size();
+      s.total = 0;
+      for (double t : d) s.total += t;
+      s.mean = s.total / d.size();
+      s.min = d.front();
+      s.max = d.back();
+      auto pct = [&](double p) { return d[std::min(d.size() - 1, size_t(p * (d.size() - 1) + 0.5))]; };
+      s.p50 = pct(0.5);
+      s.p90 = pct(0.9);
+      s.p99 = pct(0.99);
+      for (int c = 0; c < prof::n_counter; c++) s.counts[c] = counts[i][c];
+      s.counted_ms = counted_ms[i];
+      stats.push_back(s);
+    }
+    return stats;
+  }
+}
+
+void prof::enable(bool on) {
+  prof_enabled.store(on, std::memory_order_relaxed);
+}
+
+bool prof::enabled(void) {
+  return prof_enabled.load(std::memory_order_relaxed);
+}
+
+bool prof::enable_counters(bool on) {
+  if (!on) {
+    prof_counters.store(false, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lk(prof_mutex);
+    for (auto& buf : prof_buffers) close_counters(*buf);
+    return false;
+  }
+  int err = open_counters(local_buffer());
+  if (err != 0) {
+    printf("\033[33m-- hardware counters unavailable (%s), scopes are timed only. "
+      "Counting needs kernel.perf_event_paranoid <= 2 and a PMU visible to the process\033[0m\n", strerror(err));
+    return false;
+  }
+  prof_counters.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+bool prof::counters_enabled(void) {
+  return prof_counters.load(std::memory_order_relaxed);
+}
+
+void prof::set_sync(std::function<void(void)> sync) {
+  prof_sync = sync;
+}
+
+void prof::reset(void) {
+  std::lock_guard<std::mutex> lk(prof_mutex);
+  for (auto& buf : prof_buffers) buf->events.clear();
+  prof_origin = std::chrono::steady_clock::now();
+}
+
+prof::scope::scope(const char* name, int arg) {
+  if (!prof_enabled.load(std::memory_order_relaxed)) return;
+  thread_buffer_t& buf = local_buffer();
+  int parent = buf.stack.empty() ? -1 : buf.stack.back();
+  _node = find_node(buf, parent, name, arg);
+  buf.stack.push_back(_node);
+  if (prof_sync) prof_sync();
+  if (prof_counters.load(std::memory_order_relaxed)) read_counters(buf, _counts);
+  else _counts[cycles] = -1;
+  _born = now_ns();
+}
+
+void prof::scope::stop(void) {
+  if (_node < 0) return;
+  if (prof_sync) prof_sync();
+  long long die = now_ns();
+  thread_buffer_t& buf = local_buffer();
+  event_t e = { _node, _born, die };
+  for (int c = 0; c < n_counter; c++) e.counts[c] = -1;
+  if (_counts[cycles] >= 0 && prof_counters.load(std::memory_order_relaxed)) {
+    long long now[n_counter];
+    read_counters(buf, now);
+    for (int c = 0; c < n_counter; c++) {
+      if (now[c] >= 0 && _counts[c] >= 0) e.counts[c] = now[c] - _counts[c];
+    }
+  }
+  buf.events.push_back(e);
+  buf.stack.pop_back();
+  _node = -1;
+}
+
+bool prof::writeChromeTrace(const std::string& filename) {
+  FILE* fp = fopen(filename.c_str(), "w");
+  if (!fp) {
+    printf("\033[31m-- cannot open trace file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(prof_mutex);
+  std::vector<std::string> names(prof_nodes.size()), paths(prof_nodes.size());
+  for (int i = 0; i < prof_nodes.size(); i++) {
+    names[i] = json_escape(node_label(prof_nodes[i]));
+    paths[i] = json_escape(node_path(i));
+  }
+  fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  for (auto& buf : prof_buffers) {
+    for (const event_t& e : buf->events) {
+      fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"hgrid\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3lf,\"dur\":%.3lf,\"args\":{\"path\":\"%s\"}}",
+        first ? "" : ",\n", names[e.node].c_str(), buf->tid, e.t0 * 1e-3, (e.t1 - e.t0) * 1e-3, paths[e.node].c_str());
+      first = false;
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+  return true;
+}
+
+bool prof::writeCSV(const std::string& filename) {
+  FILE* fp = fopen(filename.c_str(), "w");
+  if (!fp) {
+    printf("\033[31m-- cannot open profile file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(prof_mutex);
+  fprintf(fp, "path,count,total_ms,mean_ms,min_ms,max_ms,p50_ms,p90_ms,p99_ms,"
+    "cycles,instructions,llc_references,llc_misses,ipc,llc_miss_rate,llc_mpki,llc_gbps\n");
+  for (const scope_stat_t& s : collect_stats()) {
+    fprintf(fp, "%s,%zu,%.4lf,%.4lf,%.4lf,%.4lf,%.4lf,%.4lf,%.4lf",
+      s.path.c_str(), s.count, s.total, s.mean, s.min, s.max, s.p50, s.p90, s.p99);
+    // counter columns stay empty when they were not counted
+    for (int c = 0; c < n_counter; c++) {
+      if (s.counts[c] >= 0) fprintf(fp, ",%lld", s.counts[c]);
+      else fprintf(fp, ",");
+    }
+    for (double v : { s.ipc(), s.llc_miss_rate(), s.llc_mpki(), s.llc_gbps() }) {
+      if (v >= 0) fprintf(fp, ",%.4lf", v);
+      else fprintf(fp, ",");
+    }
+    fprintf(fp, "\n");
+  }
+  fclose(fp);
+  return true;
+}
+
+void prof::report(void) {
+  std::lock_guard<std::mutex> lk(prof_mutex);
+  std::vector<scope_stat_t> stats = collect_stats();
+  std::sort(stats.begin(), stats.end(), [](const scope_stat_t& a, const scope_stat_t& b) { return a.total > b.total; });
+  bool counted = std::any_of(stats.begin(), stats.end(), [](const scope_stat_t& s) { return s.counts[cycles] >= 0; });
+  printf("%-48s %8s %12s %10s %10s %10s", "scope", "count", "total(ms)", "mean(ms)", "p90(ms)", "max(ms)");
+  if (counted) printf(" %6s %9s %8s %9s", "IPC", "LLC miss", "MPKI", "LLC GB/s");
+  printf("\n");
+  for (const scope_stat_t& s : stats) {
+    printf("%-48s %8zu %12.2lf %10.3lf %10.3lf %10.3lf", s.path.c_str(), s.count, s.total, s.mean, s.p90, s.max);
+    if (counted) {
+      const char* fmt[4] = { " %6.2lf", " %8.1lf%%", " %8.2lf", " %9.2lf" };
+      const char* wid[4] = { " %6s", " %9s", " %8s", " %9s" };
+      double v[4] = { s.ipc(), s.llc_miss_rate() * 100, s.llc_mpki(), s.llc_gbps() };
+      if (s.llc_miss_rate() < 0) v[1] = -1;
+      for (int k = 0; k < 4; k++) {
+        if (v[k] >= 0) printf(fmt[k], v[k]);
+        else printf(wid[k], "-");
+      }
+    }
+    printf("\n");
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include "string"
+#include "functional"
+
+namespace tictoc {
+
+	/*
+	  Hierarchical scoped profiler. Every thread records into its own buffer, scopes opened inside another
+	  scope of the same thread become its children, e.g. iteration/update_stencil/layer[2]/restrict.
+	  When disabled a scope costs one relaxed atomic load.
+	  The records are read by the export functions, call them (and reset) outside of profiled parallel regions.
+	*/
+	namespace prof {
+
+		void enable(bool on);
+
+		bool enabled(void);
+
+		// called when a scope opens and closes, e.g. a device synchronization so asynchronous kernels are
+		// accounted to the scope launching them. Pass nullptr to time the host side only.
+		void set_sync(std::function<void(void)> sync);
+
+		// hardware counters read when a scope opens and closes
+		enum counter_t {
+			cycles,
+			instructions,
+			llc_references,
+			llc_misses,
+			n_counter
+		};
+
+		// count cycles, instructions and last level cache references / misses of every scope with perf_event_open
+		// (user space of the thread opening the scope, not the OpenMP threads it forks nor the GPU). The report adds
+		// IPC, LLC miss rate, misses per kilo instruction and the bandwidth of the misses (64 B lines) next to the
+		// timing. Returns false when the counters are unavailable (perf_event_paranoid, containers, VMs, not linux),
+		// the scopes are then timed only
+		bool enable_counters(bool on);
+
+		bool counters_enabled(void);
+
+		// drop all records, the time origin restarts
+		void reset(void);
+
+		// trace viewable in chrome://tracing or Perfetto, one complete event per scope
+		bool writeChromeTrace(const std::string& filename);
+
+		// one line per scope path : count, total, mean, min, max, p50, p90, p99 in ms
+		bool writeCSV(const std::string& filename);
+
+		// print the CSV table sorted by total time
+		void report(void);
+
+		class scope {
+			int _node = -1;
+			long long _born;
+			long long _counts[n_counter];
+		public:
+			// name must outlive the profiler (a string literal), arg >= 0 is appended as name[arg]
+			scope(const char* name, int arg = -1);
+			~scope() { if (_node >= 0) stop(); }
+			// close the scope before the end of its block, later calls do nothing
+			void stop(void);
+			scope(const scope&) = delete;
+			scope& operator=(const scope&) = delete;
+		};
+	}
+};
+
+#define _PROF_CAT_(a, b) a##b
+#define _PROF_CAT(a, b) _PROF_CAT_(a, b)
+
+#define _PROF(name) tictoc::prof::scope _PROF_CAT(_prof_scope_, __LINE__)(name)
+
+#define _PROF_ARG(name, arg) tictoc::prof::scope _PROF_CAT(_prof_scope_, __LINE__)(name, arg)
+
+#endif
+
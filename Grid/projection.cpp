@@ -5,6 +5,7 @@
 #include "CGALDefinition.h"
 //#include "matlab_utils.h"
 #include "binaryIO.h"
+#include "memory_registry.h"
 
 std::vector<int> _loadnodes;
 
@@ -53,38 +54,22 @@ void setNodes(BitSAT<unsigned int>& vbits, int vreso, const std::vector<int>& le
 
   _R.resize(n_gs * 3, 6);
   _R.fill(0);
-  int vreso2 = pow(vreso, 2);
-  #pragma omp parallel for
-  for (int i = 0; i < vbits._bitArray.size(); i++) {
-    unsigned int word = vbits._bitArray[i];
-    if (word == 0) continue;
-    int vidoffset = vbits._chunkSat[i];
-    int vidword = 0;
-    for (int j = 0; j < BitCount<unsigned int>::value; j++) {
-      if (read_bit(word, j)) {
-        int vid = vidword + vidoffset;
-        int gsvid = lex2gs[vid];
-        int bitid = i * BitCount<unsigned int>::value + j;
-        int  p[3] = { bitid % vreso, bitid % vreso2 / vreso,bitid / vreso / vreso };
-        Eigen::Matrix<double, 3, 3> phat;
-        phat << 0, -p[2], p[1],
-             p[2], 0, -p[0],
-             -p[1], p[0], 0;
-        _R.block<3, 3>(gsvid * 3, 0) = Eigen::Matrix<double, 3, 3>::Identity();
-        _R.block<3, 3>(gsvid * 3, 3) = phat;
-
-        //for (int k = 0; k < 3; k++) {
-        //	_Ru[k][k][gsvid] = 1;
-        //	_Ru[k + 3][0][gsvid] = phat(0, k);
-        //	_Ru[k + 3][1][gsvid] = phat(1, k);
-        //	_Ru[k + 3][2][gsvid] = phat(2, k);
-        //}
-
-
-        vidword++;
-      }
-    }
-  }
+  for_each_set_bit(vbits, vreso, [&](size_t bitid, int vid, const int* p) {
+    int gsvid = lex2gs[vid];
+    Eigen::Matrix<double, 3, 3> phat;
+    phat << 0, -p[2], p[1],
+         p[2], 0, -p[0],
+         -p[1], p[0], 0;
+    _R.block<3, 3>(gsvid * 3, 0) = Eigen::Matrix<double, 3, 3>::Identity();
+    _R.block<3, 3>(gsvid * 3, 3) = phat;
+
+    //for (int k = 0; k < 3; k++) {
+    //	_Ru[k][k][gsvid] = 1;
+    //	_Ru[k + 3][0][gsvid] = phat(0, k);
+    //	_Ru[k + 3][1][gsvid] = phat(1, k);
+    //	_Ru[k + 3][2][gsvid] = phat(2, k);
+    //}
+  });
 
 
   // Gram-Schmitt Orthogonalization
@@ -109,6 +94,10 @@ void setNodes(BitSAT<unsigned int>& vbits, int vreso, const std::vector<int>& le
   _vlex2gs_dev = vlex2gs_dev;
   _n_gsnodes = n_gs;
 
+  // the dense rigid motion basis and its per component copy, both 18 doubles per vertex
+  grid::mem::track("projection R", grid::mem::projection, grid::mem::host, sizeof(double) * _R.size(), 0);
+  grid::mem::track("projection Ru", grid::mem::projection, grid::mem::host, sizeof(double) * 18 * n_gs, 0);
+
   //_R.resize(1, 6);
 #if 0
   Eigen::Matrix<double, -1, 6> pR[3];
@@ -262,6 +251,9 @@ void setLoadNodes(
 
   _f.resize(_loadnodes.size() * 3, 1);
 
+  grid::mem::track("projection load basis", grid::mem::projection, grid::mem::host,
+    (sizeof(double) + sizeof(int)) * _Nd.nonZeros() + sizeof(double) * (_Rd.size() + _f.size()));
+
   uploadLoadNodes(_loadnodes, vtangent, vnormal);
 
   setLoadForce(_loadforce);
@@ -283,6 +275,15 @@ const std::vector<int>& getLoadNodes(void) {
   return _loadnodes;
 }
 
+void getLoadGeometry(
+  std::vector<Eigen::Matrix<double, 3, 1>>& loadpos,
+  std::vector<Eigen::Matrix<double, 3, 1>>& loadnormal,
+  std::vector<Eigen::Matrix<double, 3, 1>>& loadforce) {
+  loadpos = _loadpos;
+  loadnormal = _loadnormals;
+  loadforce = _loadforce;
+}
+
 void forceProject(std::vector<double> f[3]) {
   // FOR DEBUG
   //{
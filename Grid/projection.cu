@@ -1,6 +1,7 @@
 #include "projection.h"
 #include "lib.cuh"
 #include "snippet.h"
+#include "memory_registry.h"
 
 #include "helper_cuda.h"
 
@@ -115,6 +116,10 @@ void uploadLoadNodes(const std::vector<int>& loadnodes, std::vector<double> vtan
 	}
 	// finished SAT computation
 
+	size_t nload = loadnodes.size();
+	grid::mem::track("projection load nodes", grid::mem::projection, grid::mem::device,
+		sizeof(int) * nload + sizeof(double) * 9 * nload + sizeof(unsigned int) * nbitword + sizeof(int) * (nbitword + 1));
+
 	// DEBUG check tangent and normal 
 }
 
@@ -124,6 +129,7 @@ void uploadLoadForce(double const* const fhost[3])
 		cudaMalloc(&fload[i], sizeof(double) * getLoadNodes().size());
 		cudaMemcpy(fload[i], fhost[i], sizeof(double) * getLoadNodes().size(), cudaMemcpyHostToDevice);
 	}
+	grid::mem::track("projection load force", grid::mem::projection, grid::mem::device, sizeof(double) * 3 * getLoadNodes().size());
 }
 
 //void displacementProject(double* u_dev[3])
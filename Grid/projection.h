@@ -26,6 +26,13 @@ void setLoadForce(std::vector<Eigen::Matrix<double, 3, 1>> flist);
 
 const std::vector<int>& getLoadNodes(void);
 
+// positions, outward normals and preload of the load nodes in the order of getLoadNodes
+void getLoadGeometry(
+	std::vector<Eigen::Matrix<double, 3, 1>>& loadpos,
+	std::vector<Eigen::Matrix<double, 3, 1>>& loadnormal,
+	std::vector<Eigen::Matrix<double, 3, 1>>& loadforce
+);
+
 void forceProject(std::vector<double> fsupport[3]);
 
 void forceProject(double* f_dev[3]);
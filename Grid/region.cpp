@@ -0,0 +1,321 @@
+#include "region.h"
+#include "algorithm"
+#include "cmath"
+#include "cstdio"
+#include "cstdlib"
+#include "cstring"
+#include "sstream"
+#include "limits"
+
+using namespace grid;
+
+region_t region_t::box(const double lo[3], const double hi[3]) {
+  region_t r;
+  r._kind = box_region;
+  for (int i = 0; i < 3; i++) {
+    r._p[i] = lo[i];
+    r._p[i + 3] = hi[i];
+  }
+  return r;
+}
+
+region_t region_t::sphere(const double center[3], double radius) {
+  region_t r;
+  r._kind = sphere_region;
+  for (int i = 0; i < 3; i++) r._p[i] = center[i];
+  r._p[3] = radius;
+  return r;
+}
+
+region_t region_t::cylinder(const double p0[3], const double p1[3], double radius) {
+  region_t r;
+  r._kind = cylinder_region;
+  for (int i = 0; i < 3; i++) {
+    r._p[i] = p0[i];
+    r._p[i + 3] = p1[i];
+  }
+  r._p[6] = radius;
+  return r;
+}
+
+region_t region_t::halfspace(const double point[3], const double normal[3]) {
+  region_t r;
+  r._kind = halfspace_region;
+  for (int i = 0; i < 3; i++) {
+    r._p[i] = point[i];
+    r._p[i + 3] = normal[i];
+  }
+  return r;
+}
+
+region_t region_t::faces(const std::vector<int>& faceids, double tol) {
+  region_t r;
+  r._kind = faces_region;
+  r._faceids = faceids;
+  r._p[0] = tol;
+  return r;
+}
+
+region_t region_t::combine(kind_t op, const std::vector<region_t>& children) {
+  region_t r;
+  r._kind = op;
+  r._children = children;
+  return r;
+}
+
+void region_t::bindMesh(const std::vector<float>& pcoords, const std::vector<int>& trifaces) {
+  for (auto& c : _children) c.bindMesh(pcoords, trifaces);
+  if (_kind != faces_region) return;
+  _tris.clear();
+  int nface = trifaces.size() / 3;
+  for (int f : _faceids) {
+    if (f < 0 || f >= nface) {
+      printf("\033[31m-- region face %d is out of range\033[0m\n", f);
+      continue;
+    }
+    for (int k = 0; k < 3; k++) {
+      int v = trifaces[f * 3 + k];
+      for (int j = 0; j < 3; j++) _tris.push_back(pcoords[v * 3 + j]);
+    }
+  }
+}
+
+bool region_t::contains(const double pos[3]) const {
+  unsigned char inside;
+  evaluate(1, &pos[0], &pos[1], &pos[2], &inside);
+  return inside;
+}
+
+namespace {
+  inline double segDist2(double px, double py, double pz, const double a[3], const double e[3], double inv_ee) {
+    double vx = px - a[0], vy = py - a[1], vz = pz - a[2];
+    double t = (vx * e[0] + vy * e[1] + vz * e[2]) * inv_ee;
+    t = std::min(std::max(t, 0.), 1.);
+    vx -= t * e[0]; vy -= t * e[1]; vz -= t * e[2];
+    return vx * vx + vy * vy + vz * vz;
+  }
+}
+
+void region_t::evaluateFaces(int n, const double* x, const double* y, const double* z, unsigned char* inside) const {
+  double tol2 = _p[0] * _p[0];
+  std::fill(inside, inside + n, 0);
+  for (size_t f = 0; f + 9 <= _tris.size(); f += 9) {
+    const double* v[3] = { &_tris[f], &_tris[f + 3], &_tris[f + 6] };
+    double e[3][3];
+    double inv_ee[3];
+    for (int k = 0; k < 3; k++) {
+      for (int j = 0; j < 3; j++) e[k][j] = v[(k + 1) % 3][j] - v[k][j];
+      double ee = e[k][0] * e[k][0] + e[k][1] * e[k][1] + e[k][2] * e[k][2];
+      inv_ee[k] = ee > 0 ? 1 / ee : 0;
+    }
+    double nrm[3] = {
+      e[0][1] * e[1][2] - e[0][2] * e[1][1],
+      e[0][2] * e[1][0] - e[0][0] * e[1][2],
+      e[0][0] * e[1][1] - e[0][1] * e[1][0]
+    };
+    double nn = nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2];
+    double inv_nn = nn > 0 ? 1 / nn : 0;
+    // edge normals in the triangle plane, a point projects inside if it is on the inner side of all edges
+    double en[3][3];
+    for (int k = 0; k < 3; k++) {
+      en[k][0] = nrm[1] * e[k][2] - nrm[2] * e[k][1];
+      en[k][1] = nrm[2] * e[k][0] - nrm[0] * e[k][2];
+      en[k][2] = nrm[0] * e[k][1] - nrm[1] * e[k][0];
+    }
+    const double* a = v[0];
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      double side[3];
+      for (int k = 0; k < 3; k++) {
+        side[k] = (x[i] - v[k][0]) * en[k][0] + (y[i] - v[k][1]) * en[k][1] + (z[i] - v[k][2]) * en[k][2];
+      }
+      double h = (x[i] - a[0]) * nrm[0] + (y[i] - a[1]) * nrm[1] + (z[i] - a[2]) * nrm[2];
+      double dplane = h * h * inv_nn;
+      double dedge = std::min(std::min(
+        segDist2(x[i], y[i], z[i], v[0], e[0], inv_ee[0]),
+        segDist2(x[i], y[i], z[i], v[1], e[1], inv_ee[1])),
+        segDist2(x[i], y[i], z[i], v[2], e[2], inv_ee[2]));
+      bool inprism = nn > 0 && side[0] >= 0 && side[1] >= 0 && side[2] >= 0;
+      double d2 = inprism ? dplane : dedge;
+      inside[i] |= d2 <= tol2;
+    }
+  }
+}
+
+void region_t::evaluate(int n, const double* x, const double* y, const double* z, unsigned char* inside) const {
+  const double* p = _p;
+  switch (_kind) {
+  case box_region:
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      inside[i] = (x[i] >= p[0]) & (x[i] <= p[3]) & (y[i] >= p[1]) & (y[i] <= p[4]) & (z[i] >= p[2]) & (z[i] <= p[5]);
+    }
+    break;
+  case sphere_region: {
+    double r2 = p[3] * p[3];
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      double dx = x[i] - p[0], dy = y[i] - p[1], dz = z[i] - p[2];
+      inside[i] = dx * dx + dy * dy + dz * dz <= r2;
+    }
+    break;
+  }
+  case cylinder_region: {
+    double ax = p[3] - p[0], ay = p[4] - p[1], az = p[5] - p[2];
+    double aa = ax * ax + ay * ay + az * az;
+    double r2 = p[6] * p[6];
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      double dx = x[i] - p[0], dy = y[i] - p[1], dz = z[i] - p[2];
+      double t = dx * ax + dy * ay + dz * az;
+      double radial = (dx * dx + dy * dy + dz * dz) * aa - t * t;
+      inside[i] = (t >= 0) & (t <= aa) & (radial <= r2 * aa);
+    }
+    break;
+  }
+  case halfspace_region:
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      inside[i] = (x[i] - p[0]) * p[3] + (y[i] - p[1]) * p[4] + (z[i] - p[2]) * p[5] <= 0;
+    }
+    break;
+  case faces_region:
+    evaluateFaces(n, x, y, z, inside);
+    break;
+  case union_region:
+  case intersect_region:
+  case subtract_region: {
+    if (_children.empty()) {
+      std::fill(inside, inside + n, 0);
+      break;
+    }
+    _children[0].evaluate(n, x, y, z, inside);
+    std::vector<unsigned char> tmp(n);
+    for (int c = 1; c < _children.size(); c++) {
+      _children[c].evaluate(n, x, y, z, tmp.data());
+      unsigned char* t = tmp.data();
+      if (_kind == union_region) {
+#pragma omp simd
+        for (int i = 0; i < n; i++) inside[i] |= t[i];
+      } else if (_kind == intersect_region) {
+#pragma omp simd
+        for (int i = 0; i < n; i++) inside[i] &= t[i];
+      } else {
+#pragma omp simd
+        for (int i = 0; i < n; i++) inside[i] &= !t[i];
+      }
+    }
+    break;
+  }
+  default:
+    std::fill(inside, inside + n, 0);
+  }
+}
+
+std::string region_t::str(void) const {
+  static const char* names[] = { "empty", "box", "sphere", "cylinder", "halfspace", "faces", "union", "intersect", "subtract" };
+  static const int nparam[] = { 0, 6, 4, 7, 6, 1 };
+  std::ostringstream os;
+  os.precision(10);
+  os << names[_kind];
+  if (_kind >= union_region) {
+    os << "(";
+    for (int i = 0; i < _children.size(); i++) os << (i ? ", " : "") << _children[i].str();
+    os << ")";
+    return os.str();
+  }
+  for (int i = 0; i < nparam[_kind]; i++) os << " " << _p[i];
+  for (int f : _faceids) os << " " << f;
+  return os.str();
+}
+
+namespace {
+  struct region_parser_t {
+    const char* begin;
+    const char* p;
+
+    void skip(void) { while (*p == ' ' || *p == '\t') p++; }
+
+    bool fail(const char* what) {
+      printf("\033[31m-- region syntax error at %d (%s) : %s\033[0m\n", int(p - begin), what, begin);
+      return false;
+    }
+
+    bool number(double& v) {
+      skip();
+      char* end;
+      v = strtod(p, &end);
+      if (end == p) return false;
+      p = end;
+      return true;
+    }
+
+    bool expr(region_t& r) {
+      skip();
+      const char* w = p;
+      while ((*p >= 'a' && *p <= 'z') || *p == '_') p++;
+      std::string name(w, p);
+      if (name == "union" || name == "intersect" || name == "subtract") {
+        skip();
+        if (*p++ != '(') return fail("expected (");
+        std::vector<region_t> children;
+        while (true) {
+          children.emplace_back();
+          if (!expr(children.back())) return false;
+          skip();
+          if (*p == ',') { p++; continue; }
+          if (*p == ')') { p++; break; }
+          return fail("expected , or )");
+        }
+        region_t::kind_t op = name == "union" ? region_t::union_region : (name == "intersect" ? region_t::intersect_region : region_t::subtract_region);
+        r = region_t::combine(op, children);
+        return true;
+      }
+      double v[7];
+      int n = name == "box" || name == "halfspace" ? 6 : (name == "sphere" ? 4 : (name == "cylinder" ? 7 : (name == "faces" ? 1 : -1)));
+      if (n < 0) return fail("unknown region");
+      for (int i = 0; i < n; i++) {
+        if (!number(v[i])) return fail("expected number");
+      }
+      if (name == "box") r = region_t::box(v, v + 3);
+      else if (name == "halfspace") r = region_t::halfspace(v, v + 3);
+      else if (name == "sphere") r = region_t::sphere(v, v[3]);
+      else if (name == "cylinder") r = region_t::cylinder(v, v + 3, v[6]);
+      else {
+        std::vector<int> ids;
+        double id;
+        while (number(id)) ids.push_back(int(id));
+        r = region_t::faces(ids, v[0]);
+      }
+      return true;
+    }
+  };
+}
+
+bool region_t::parse(const std::string& text, region_t& region) {
+  region_parser_t parser{ text.c_str(), text.c_str() };
+  if (!parser.expr(region)) return false;
+  parser.skip();
+  if (*parser.p != '\0') return parser.fail("trailing characters");
+  return true;
+}
+
+std::vector<int> grid::selectFacesByNormal(const std::vector<float>& pcoords, const std::vector<int>& trifaces, const double dir[3], double max_angle) {
+  std::vector<int> ids;
+  double dn = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+  double cosmax = std::cos(max_angle);
+  for (int f = 0; f < trifaces.size() / 3; f++) {
+    const float* v[3];
+    for (int k = 0; k < 3; k++) v[k] = &pcoords[trifaces[f * 3 + k] * 3];
+    double e0[3], e1[3];
+    for (int j = 0; j < 3; j++) {
+      e0[j] = v[1][j] - v[0][j];
+      e1[j] = v[2][j] - v[0][j];
+    }
+    double nrm[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+    double nn = std::sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+    if (nn == 0 || dn == 0) continue;
+    if ((nrm[0] * dir[0] + nrm[1] * dir[1] + nrm[2] * dir[2]) / (nn * dn) >= cosmax) ids.push_back(f);
+  }
+  return ids;
+}
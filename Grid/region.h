@@ -0,0 +1,101 @@
+#pragma once
+
+#ifndef __REGION_H
+#define __REGION_H
+
+#include "vector"
+#include "string"
+
+namespace grid {
+
+	/*
+	  Declarative point set used for support and load areas. Regions are built from primitives and combined
+	  by union / intersection / difference. The text form is the one accepted by parse, e.g.
+	    union(box 0 0 0 0.1 1 1, sphere 1 0.5 0.5 0.2)
+	    intersect(cylinder 0 0.5 0.5 1 0.5 0.5 0.3, halfspace 0.5 0 0 -1 0 0)
+	    faces 0.01 12 13 14
+	  evaluate classifies a whole position array, primitive tests are branch free loops the compiler vectorizes.
+	*/
+	class region_t {
+	public:
+		enum kind_t {
+			empty_region,
+			// lo[3] hi[3]
+			box_region,
+			// center[3] radius
+			sphere_region,
+			// p0[3] p1[3] radius, capped at both ends
+			cylinder_region,
+			// point[3] normal[3], the side the normal points away from
+			halfspace_region,
+			// points within tol of the selected mesh faces
+			faces_region,
+			union_region,
+			intersect_region,
+			// first child minus the others
+			subtract_region
+		};
+
+	private:
+		kind_t _kind = empty_region;
+		double _p[7] = { 0 };
+		std::vector<region_t> _children;
+		std::vector<int> _faceids;
+		// 9 coordinates per selected face, set by bindMesh
+		std::vector<double> _tris;
+
+		void evaluateFaces(int n, const double* x, const double* y, const double* z, unsigned char* inside) const;
+
+	public:
+		region_t(void) {}
+
+		static region_t box(const double lo[3], const double hi[3]);
+
+		static region_t sphere(const double center[3], double radius);
+
+		static region_t cylinder(const double p0[3], const double p1[3], double radius);
+
+		static region_t halfspace(const double point[3], const double normal[3]);
+
+		static region_t faces(const std::vector<int>& faceids, double tol);
+
+		static region_t combine(kind_t op, const std::vector<region_t>& children);
+
+		region_t operator|(const region_t& other) const { return combine(union_region, { *this, other }); }
+
+		region_t operator&(const region_t& other) const { return combine(intersect_region, { *this, other }); }
+
+		region_t operator-(const region_t& other) const { return combine(subtract_region, { *this, other }); }
+
+		kind_t kind(void) const { return _kind; }
+
+		bool empty(void) const { return _kind == empty_region; }
+
+		// attach the triangles of face selections, required before evaluating them
+		void bindMesh(const std::vector<float>& pcoords, const std::vector<int>& trifaces);
+
+		bool contains(const double pos[3]) const;
+
+		// inside[i] = 1 if (x[i], y[i], z[i]) is in the region, 0 otherwise
+		void evaluate(int n, const double* x, const double* y, const double* z, unsigned char* inside) const;
+
+		std::string str(void) const;
+
+		// parse the text form, return false and print the position on syntax errors
+		static bool parse(const std::string& text, region_t& region);
+	};
+
+	// declarative support / load areas with a constant load, replaces the boundary callbacks when enabled
+	struct boundary_regions_t {
+		bool enabled = false;
+		region_t fixed;
+		region_t load;
+		double force[3] = { 0, 0, 0 };
+	};
+
+	// faces of the mesh whose normal is within max_angle (radian) of dir
+	std::vector<int> selectFacesByNormal(const std::vector<float>& pcoords, const std::vector<int>& trifaces, const double dir[3], double max_angle);
+}
+
+#endif
+
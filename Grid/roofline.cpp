@@ -0,0 +1,184 @@
+#include "roofline.h"
+#include "tictoc.h"
+#include "algorithm"
+#include "cmath"
+#include "cstdio"
+
+using namespace grid;
+
+namespace {
+  struct point_t {
+    // flop per byte, -1 without flops
+    double intensity;
+    double gbps, gflops;
+    // fractions of the peaks and of the roof at the intensity, -1 when the peak is unknown
+    double bw_fraction, flop_fraction, roof_fraction;
+    const char* bound;
+  };
+
+  point_t locate(const roofline_entry_t& e, double peak_gbps, double peak_gflops) {
+    point_t p;
+    double s = e.ms * 1e-3;
+    p.gbps = s > 0 ? e.cost.bytes / s / 1e9 : 0;
+    p.gflops = s > 0 ? e.cost.flops / s / 1e9 : 0;
+    p.intensity = e.cost.flops > 0 && e.cost.bytes > 0 ? e.cost.flops / e.cost.bytes : -1;
+    p.bw_fraction = peak_gbps > 0 ? p.gbps / peak_gbps : -1;
+    p.flop_fraction = peak_gflops > 0 && e.cost.flops > 0 ? p.gflops / peak_gflops : -1;
+    p.roof_fraction = p.bw_fraction;
+    p.bound = "memory";
+    if (p.intensity > 0 && peak_gbps > 0 && peak_gflops > 0) {
+      double roof = std::min(peak_gflops, p.intensity * peak_gbps);
+      p.roof_fraction = p.gflops / roof;
+      // right of the ridge point the flops limit the kernel
+      if (p.intensity * peak_gbps > peak_gflops) p.bound = "compute";
+    }
+    return p;
+  }
+
+  void print_fraction(double f) {
+    if (f >= 0) printf(" %7.1lf%%", f * 100);
+    else printf(" %8s", "-");
+  }
+}
+
+kernel_cost_t grid::relaxCost(Grid& g) {
+  kernel_cost_t c;
+  double nv = g.n_gsvertices, ne = g.n_gselements;
+  // per vertex : displacement read + write, force, v2v indices and the flag word
+  if (g._layer == 0) {
+    // the 8 element blocks of every neighbour are assembled on the fly from rho (OTFA)
+    c.bytes = nv * (48 + 24 + 27 * 4 + 8 * 4 + 4) + ne * 4;
+    c.flops = nv * (8 * 8 * 9 * 2 + 30);
+  } else {
+    // 27 3x3 blocks of the stencil
+    c.bytes = nv * (48 + 24 + 27 * 4 + 4 + 27 * 9 * 8);
+    c.flops = nv * (27 * 9 * 2 + 30);
+  }
+  return c;
+}
+
+kernel_cost_t grid::residualCost(Grid& g) {
+  // same traffic with the residual written instead of the displacement, no 3x3 solve
+  kernel_cost_t c = relaxCost(g);
+  c.flops -= double(g.n_gsvertices) * (30 - 6);
+  return c;
+}
+
+kernel_cost_t grid::restrictCost(Grid& g) {
+  // every fine residual is distributed to the 8 coarse vertices of its cell
+  kernel_cost_t c;
+  double nvf = g.fineGrid->n_gsvertices, nvc = g.n_gsvertices;
+  c.bytes = nvf * 24 + nvc * (24 + 27 * 4);
+  c.flops = nvf * 8 * 3 * 2;
+  return c;
+}
+
+kernel_cost_t grid::prolongateCost(Grid& g) {
+  // every fine vertex interpolates the 8 coarse vertices of its cell
+  kernel_cost_t c;
+  double nvf = g.n_gsvertices, nvc = g.coarseGrid->n_gsvertices;
+  c.bytes = nvf * (48 + 8 * 4) + nvc * 24;
+  c.flops = nvf * 8 * 3 * 2;
+  return c;
+}
+
+kernel_cost_t grid::stencilCost(Grid& g) {
+  // Galerkin product P^T K P : every fine matrix entry goes to the 8 x 8 coarse vertex pairs of its two nodes,
+  // 3 flops for the two weights and the sum
+  kernel_cost_t c;
+  Grid& f = *g.fineGrid;
+  c.bytes = double(g.n_gsvertices) * 27 * 9 * 8;
+  if (f._layer == 0) {
+    // element matrices from rho and the 24x24 template
+    c.bytes += double(f.n_gselements) * 4 + double(f.n_gsvertices) * 8 * 4;
+    c.flops = double(f.n_gselements) * 24 * 24 * 64 * 3;
+  } else {
+    c.bytes += double(f.n_gsvertices) * 27 * 9 * 8;
+    c.flops = double(f.n_gsvertices) * 27 * 9 * 64 * 3;
+  }
+  return c;
+}
+
+kernel_cost_t grid::filterCost(Grid& g, int radius) {
+  // every element gathers the sensitivity of the (2r+1)^3 box through the bit array and id map
+  kernel_cost_t c;
+  double ne = g.n_gselements, nb = std::pow(2 * radius + 1, 3);
+  c.bytes = ne * (4 + 4 + 4 + 4);
+  c.flops = ne * nb * 8;
+  return c;
+}
+
+kernel_cost_t grid::sensitivityCost(Grid& g, int radius) {
+  // u^T K_e u accumulated per vertex over its 8 elements, plus the filter
+  kernel_cost_t c = filterCost(g, radius);
+  double nv = g.n_gsvertices, ne = g.n_gselements;
+  c.bytes += nv * (24 + 8 * 4 + 27 * 4 + 4) + ne * (4 + 8);
+  c.flops += nv * 8 * 8 * 9 * 2;
+  return c;
+}
+
+kernel_time_t grid::timeKernel(std::function<void(void)> fn, int reps) {
+  for (int i = 0; i < 2; i++) fn();
+  gpu_manager_t::synchronize();
+  std::vector<double> t(reps);
+  for (int i = 0; i < reps; i++) {
+    auto t0 = tictoc::getTag();
+    fn();
+    gpu_manager_t::synchronize();
+    auto t1 = tictoc::getTag();
+    t[i] = tictoc::Duration<tictoc::ms>(t0, t1);
+  }
+  std::sort(t.begin(), t.end());
+  kernel_time_t kt;
+  kt.calls = reps;
+  kt.min = t.front();
+  kt.median = t[reps / 2];
+  for (double ti : t) kt.mean += ti / reps;
+  return kt;
+}
+
+void roofline_t::add(const std::string& kernel, int layer, const kernel_cost_t& cost, double ms) {
+  _entries.push_back({ kernel, layer, cost, ms });
+}
+
+void roofline_t::report(void) const {
+  printf("-- roofline : peak %.1lf GB/s, %.1lf GFLOP/s (fp64), ridge at %.2lf flop/B\n", _peak_gbps, _peak_gflops,
+    _peak_gbps > 0 ? _peak_gflops / _peak_gbps : 0.);
+  printf("%-5s %-22s %10s %10s %8s %10s %9s %9s %8s %8s %8s %8s\n", "layer", "kernel", "MB", "MFLOP", "flop/B",
+    "median(ms)", "GB/s", "GFLOP/s", "of BW", "of FLOP", "of roof", "bound");
+  for (const roofline_entry_t& e : _entries) {
+    point_t p = locate(e, _peak_gbps, _peak_gflops);
+    printf("%-5d %-22s %10.2lf %10.2lf", e.layer, e.kernel.c_str(), e.cost.bytes / 1e6, e.cost.flops / 1e6);
+    if (p.intensity >= 0) printf(" %8.2lf", p.intensity);
+    else printf(" %8s", "-");
+    printf(" %10.3lf %9.1lf %9.1lf", e.ms, p.gbps, p.gflops);
+    print_fraction(p.bw_fraction);
+    print_fraction(p.flop_fraction);
+    print_fraction(p.roof_fraction);
+    printf(" %8s\n", p.bound);
+  }
+}
+
+bool roofline_t::writeCSV(const std::string& filename) const {
+  FILE* fp = fopen(filename.c_str(), "w");
+  if (!fp) {
+    printf("\033[31m-- cannot open roofline file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  fprintf(fp, "layer,kernel,bytes,flops,intensity,median_ms,gbps,gflops,peak_gbps,peak_gflops,bw_fraction,flop_fraction,roof_fraction,bound\n");
+  for (const roofline_entry_t& e : _entries) {
+    point_t p = locate(e, _peak_gbps, _peak_gflops);
+    fprintf(fp, "%d,%s,%.0lf,%.0lf", e.layer, e.kernel.c_str(), e.cost.bytes, e.cost.flops);
+    // empty fields where a value is undefined
+    if (p.intensity >= 0) fprintf(fp, ",%.4lf", p.intensity);
+    else fprintf(fp, ",");
+    fprintf(fp, ",%.4lf,%.3lf,%.3lf,%.1lf,%.1lf", e.ms, p.gbps, p.gflops, _peak_gbps, _peak_gflops);
+    for (double v : { p.bw_fraction, p.flop_fraction, p.roof_fraction }) {
+      if (v >= 0) fprintf(fp, ",%.4lf", v);
+      else fprintf(fp, ",");
+    }
+    fprintf(fp, ",%s\n", p.bound);
+  }
+  fclose(fp);
+  return true;
+}
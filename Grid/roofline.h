@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef __ROOFLINE_H
+#define __ROOFLINE_H
+
+#include "Grid.h"
+#include "string"
+#include "vector"
+#include "functional"
+
+namespace grid {
+
+	// nominal traffic and work of one call of a kernel : every array is moved once per call and the algorithmic
+	// flops are counted, so intensities are lower bounds comparable across kernel versions, not hardware counts
+	struct kernel_cost_t {
+		double bytes = 0;
+		double flops = 0;
+	};
+
+	// one Gauss-Seidel sweep over all colors of g
+	kernel_cost_t relaxCost(Grid& g);
+
+	kernel_cost_t residualCost(Grid& g);
+
+	// restriction of the fine residual onto the coarse layer g
+	kernel_cost_t restrictCost(Grid& g);
+
+	// prolongation of the correction of the coarse layer onto g
+	kernel_cost_t prolongateCost(Grid& g);
+
+	// assembly of the 27x9 stencil of the coarse layer g from its fine layer
+	kernel_cost_t stencilCost(Grid& g);
+
+	kernel_cost_t filterCost(Grid& g, int radius);
+
+	kernel_cost_t sensitivityCost(Grid& g, int radius);
+
+	struct kernel_time_t {
+		int calls = 0;
+		double mean = 0, median = 0, min = 0;
+	};
+
+	// time reps calls of fn (ms), every call is followed by a device synchronization and timed separately
+	// after two warm up calls for caches, lazy allocations and the temp buffer
+	kernel_time_t timeKernel(std::function<void(void)> fn, int reps);
+
+	struct roofline_entry_t {
+		std::string kernel;
+		int layer;
+		kernel_cost_t cost;
+		// median time of one call
+		double ms;
+	};
+
+	/*
+	  Measured kernel times against the roofline of the device : the attainable GFLOP/s of a kernel is
+	  min(peak GFLOP/s, intensity * peak GB/s), the fraction of it the kernel reaches tells its headroom.
+	  Kernels without flops are compared to the peak bandwidth.
+	*/
+	class roofline_t {
+		std::vector<roofline_entry_t> _entries;
+		double _peak_gbps = 0;
+		double _peak_gflops = 0;
+	public:
+		void set_peak(double gbps, double gflops) { _peak_gbps = gbps; _peak_gflops = gflops; }
+
+		void add(const std::string& kernel, int layer, const kernel_cost_t& cost, double ms);
+
+		void clear(void) { _entries.clear(); }
+
+		// one line per (layer, kernel) : bytes, flops, intensity, achieved GB/s and GFLOP/s, fractions of the peaks and of the roof
+		void report(void) const;
+
+		bool writeCSV(const std::string& filename) const;
+	};
+};
+
+#endif
+
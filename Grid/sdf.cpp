@@ -0,0 +1,302 @@
+#include "sdf.h"
+#include "algorithm"
+#include "cmath"
+#include "limits"
+
+using namespace grid;
+
+sdf_t sdf_t::sphere(const double center[3], double radius) {
+  sdf_t s;
+  s._kind = sphere_sdf;
+  for (int i = 0; i < 3; i++) s._p[i] = center[i];
+  s._p[3] = radius;
+  return s;
+}
+
+sdf_t sdf_t::box(const double lo[3], const double hi[3]) {
+  sdf_t s;
+  s._kind = box_sdf;
+  for (int i = 0; i < 3; i++) {
+    s._p[i] = lo[i];
+    s._p[i + 3] = hi[i];
+  }
+  return s;
+}
+
+sdf_t sdf_t::cylinder(const double p0[3], const double p1[3], double radius) {
+  sdf_t s;
+  s._kind = cylinder_sdf;
+  for (int i = 0; i < 3; i++) {
+    s._p[i] = p0[i];
+    s._p[i + 3] = p1[i];
+  }
+  s._p[6] = radius;
+  return s;
+}
+
+sdf_t sdf_t::torus(const double center[3], double major_radius, double minor_radius) {
+  sdf_t s;
+  s._kind = torus_sdf;
+  for (int i = 0; i < 3; i++) s._p[i] = center[i];
+  s._p[3] = major_radius;
+  s._p[4] = minor_radius;
+  return s;
+}
+
+sdf_t sdf_t::halfspace(const double point[3], const double normal[3]) {
+  sdf_t s;
+  s._kind = halfspace_sdf;
+  double len = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  for (int i = 0; i < 3; i++) {
+    s._p[i] = point[i];
+    s._p[i + 3] = normal[i] / len;
+  }
+  return s;
+}
+
+sdf_t sdf_t::gyroid(double cell, double thickness) {
+  sdf_t s;
+  s._kind = gyroid_sdf;
+  s._p[0] = cell;
+  s._p[1] = thickness;
+  return s;
+}
+
+sdf_t sdf_t::shell(const sdf_t& child, double thickness) {
+  sdf_t s;
+  s._kind = shell_sdf;
+  s._p[0] = thickness;
+  s._children.push_back(child);
+  return s;
+}
+
+sdf_t sdf_t::combine(kind_t op, const std::vector<sdf_t>& children) {
+  if (children.size() == 1) return children[0];
+  sdf_t s;
+  s._kind = children.empty() ? empty_sdf : op;
+  s._children = children;
+  return s;
+}
+
+double sdf_t::eval(const double p[3]) const {
+  double d;
+  evaluate(1, p, p + 1, p + 2, &d);
+  return d;
+}
+
+void sdf_t::evaluate(int n, const double* x, const double* y, const double* z, double* d) const {
+  const double* p = _p;
+  switch (_kind) {
+  case sphere_sdf:
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      double dx = x[i] - p[0], dy = y[i] - p[1], dz = z[i] - p[2];
+      d[i] = std::sqrt(dx * dx + dy * dy + dz * dz) - p[3];
+    }
+    break;
+  case box_sdf: {
+    double c[3], h[3];
+    for (int k = 0; k < 3; k++) {
+      c[k] = (p[k] + p[k + 3]) / 2;
+      h[k] = (p[k + 3] - p[k]) / 2;
+    }
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      double qx = std::abs(x[i] - c[0]) - h[0], qy = std::abs(y[i] - c[1]) - h[1], qz = std::abs(z[i] - c[2]) - h[2];
+      double ox = std::max(qx, 0.), oy = std::max(qy, 0.), oz = std::max(qz, 0.);
+      d[i] = std::sqrt(ox * ox + oy * oy + oz * oz) + std::min(std::max(qx, std::max(qy, qz)), 0.);
+    }
+    break;
+  }
+  case cylinder_sdf: {
+    double a[3] = { p[3] - p[0], p[4] - p[1], p[5] - p[2] };
+    double len = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    for (int k = 0; k < 3; k++) a[k] /= len;
+    double r = p[6];
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      double dx = x[i] - p[0], dy = y[i] - p[1], dz = z[i] - p[2];
+      double t = dx * a[0] + dy * a[1] + dz * a[2];
+      double rx = dx - t * a[0], ry = dy - t * a[1], rz = dz - t * a[2];
+      // radial and axial excess over the cap
+      double qr = std::sqrt(rx * rx + ry * ry + rz * rz) - r;
+      double qa = std::abs(t - len / 2) - len / 2;
+      double ox = std::max(qr, 0.), oy = std::max(qa, 0.);
+      d[i] = std::sqrt(ox * ox + oy * oy) + std::min(std::max(qr, qa), 0.);
+    }
+    break;
+  }
+  case torus_sdf:
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      double dx = x[i] - p[0], dy = y[i] - p[1], dz = z[i] - p[2];
+      double q = std::sqrt(dx * dx + dy * dy) - p[3];
+      d[i] = std::sqrt(q * q + dz * dz) - p[4];
+    }
+    break;
+  case halfspace_sdf:
+#pragma omp simd
+    for (int i = 0; i < n; i++) {
+      d[i] = (x[i] - p[0]) * p[3] + (y[i] - p[1]) * p[4] + (z[i] - p[2]) * p[5];
+    }
+    break;
+  case gyroid_sdf: {
+    // |grad g| is about 1.5 w on the zero set, so |g| < 1.5 w thickness / 2 is a wall of about the given thickness.
+    // |grad g| <= sqrt(6) w everywhere, dividing by it keeps the distance a lower bound
+    double w = 2 * M_PI / p[0];
+    double s = 1 / (std::sqrt(6.) * w);
+    double t = 1.5 * w * p[1] / 2;
+    for (int i = 0; i < n; i++) {
+      double u = x[i] * w, v = y[i] * w, q = z[i] * w;
+      double g = std::sin(u) * std::cos(v) + std::sin(v) * std::cos(q) + std::sin(q) * std::cos(u);
+      d[i] = (std::abs(g) - t) * s;
+    }
+    break;
+  }
+  case shell_sdf: {
+    _children[0].evaluate(n, x, y, z, d);
+    double t = p[0] / 2;
+#pragma omp simd
+    for (int i = 0; i < n; i++) d[i] = std::abs(d[i]) - t;
+    break;
+  }
+  case union_sdf:
+  case intersect_sdf:
+  case subtract_sdf: {
+    _children[0].evaluate(n, x, y, z, d);
+    std::vector<double> t(n);
+    for (int c = 1; c < _children.size(); c++) {
+      _children[c].evaluate(n, x, y, z, t.data());
+      if (_kind == union_sdf) {
+#pragma omp simd
+        for (int i = 0; i < n; i++) d[i] = std::min(d[i], t[i]);
+      } else if (_kind == intersect_sdf) {
+#pragma omp simd
+        for (int i = 0; i < n; i++) d[i] = std::max(d[i], t[i]);
+      } else {
+#pragma omp simd
+        for (int i = 0; i < n; i++) d[i] = std::max(d[i], -t[i]);
+      }
+    }
+    break;
+  }
+  default:
+    std::fill(d, d + n, std::numeric_limits<double>::infinity());
+    break;
+  }
+}
+
+void sdf_t::gradient(const double p[3], double h, double g[3]) const {
+  double x[6], y[6], z[6], d[6];
+  for (int k = 0; k < 6; k++) {
+    x[k] = p[0] + (k / 2 == 0 ? (k % 2 ? h : -h) : 0);
+    y[k] = p[1] + (k / 2 == 1 ? (k % 2 ? h : -h) : 0);
+    z[k] = p[2] + (k / 2 == 2 ? (k % 2 ? h : -h) : 0);
+  }
+  evaluate(6, x, y, z, d);
+  double len = 0;
+  for (int k = 0; k < 3; k++) {
+    g[k] = d[2 * k + 1] - d[2 * k];
+    len += g[k] * g[k];
+  }
+  len = std::sqrt(len);
+  if (len == 0) return;
+  for (int k = 0; k < 3; k++) g[k] /= len;
+}
+
+bool sdf_t::bounds(double lo[3], double hi[3]) const {
+  const double* p = _p;
+  switch (_kind) {
+  case sphere_sdf:
+    for (int k = 0; k < 3; k++) {
+      lo[k] = p[k] - p[3];
+      hi[k] = p[k] + p[3];
+    }
+    return true;
+  case box_sdf:
+    for (int k = 0; k < 3; k++) {
+      lo[k] = p[k];
+      hi[k] = p[k + 3];
+    }
+    return true;
+  case cylinder_sdf:
+    for (int k = 0; k < 3; k++) {
+      lo[k] = std::min(p[k], p[k + 3]) - p[6];
+      hi[k] = std::max(p[k], p[k + 3]) + p[6];
+    }
+    return true;
+  case torus_sdf:
+    for (int k = 0; k < 3; k++) {
+      double r = k < 2 ? p[3] + p[4] : p[4];
+      lo[k] = p[k] - r;
+      hi[k] = p[k] + r;
+    }
+    return true;
+  case shell_sdf: {
+    if (!_children[0].bounds(lo, hi)) return false;
+    for (int k = 0; k < 3; k++) {
+      lo[k] -= p[0] / 2;
+      hi[k] += p[0] / 2;
+    }
+    return true;
+  }
+  case union_sdf: {
+    for (int k = 0; k < 3; k++) {
+      lo[k] = std::numeric_limits<double>::infinity();
+      hi[k] = -lo[k];
+    }
+    for (const sdf_t& c : _children) {
+      double clo[3], chi[3];
+      if (!c.bounds(clo, chi)) return false;
+      for (int k = 0; k < 3; k++) {
+        lo[k] = std::min(lo[k], clo[k]);
+        hi[k] = std::max(hi[k], chi[k]);
+      }
+    }
+    return true;
+  }
+  case intersect_sdf: {
+    bool bounded = false;
+    for (int k = 0; k < 3; k++) {
+      lo[k] = -std::numeric_limits<double>::infinity();
+      hi[k] = -lo[k];
+    }
+    for (const sdf_t& c : _children) {
+      double clo[3], chi[3];
+      if (!c.bounds(clo, chi)) continue;
+      bounded = true;
+      for (int k = 0; k < 3; k++) {
+        lo[k] = std::max(lo[k], clo[k]);
+        hi[k] = std::min(hi[k], chi[k]);
+      }
+    }
+    return bounded;
+  }
+  case subtract_sdf:
+    return _children[0].bounds(lo, hi);
+  default:
+    return false;
+  }
+}
+
+bool grid::benchShape(const std::string& name, sdf_t& sdf) {
+  double c[3] = { 0.5,0.5,0.5 };
+  if (name == "cube") {
+    double lo[3] = { 0,0,0 }, hi[3] = { 1,1,1 };
+    sdf = sdf_t::box(lo, hi);
+  } else if (name == "sphere") {
+    sdf = sdf_t::sphere(c, 0.5);
+  } else if (name == "shell") {
+    // hollow sphere with a wall of 0.1
+    sdf = sdf_t::shell(sdf_t::sphere(c, 0.45), 0.1);
+  } else if (name == "beam") {
+    // 1 x 0.25 x 0.25 beam filled with a gyroid lattice, solid skin at both ends
+    double lo[3] = { 0,0.375,0.375 }, hi[3] = { 1,0.625,0.625 };
+    double l0[3] = { 0,0.375,0.375 }, l1[3] = { 0.05,0.625,0.625 };
+    double r0[3] = { 0.95,0.375,0.375 }, r1[3] = { 1,0.625,0.625 };
+    sdf = (sdf_t::box(lo, hi) & sdf_t::gyroid(0.125, 0.02)) | sdf_t::box(l0, l1) | sdf_t::box(r0, r1);
+  } else {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef __SDF_H
+#define __SDF_H
+
+#include "vector"
+#include "string"
+
+namespace grid {
+
+	/*
+	  Implicit solid given by a signed distance function, negative inside. Primitives are combined by
+	  union / intersection / difference, all operations keep the function 1-Lipschitz so |d| never
+	  overestimates the distance to the surface, which lets the lattice builder classify whole blocks
+	  from one sample. The distance of the gyroid is a scaled lower bound, the others are exact or bounds.
+	*/
+	class sdf_t {
+	public:
+		enum kind_t {
+			empty_sdf,
+			// center[3] radius
+			sphere_sdf,
+			// lo[3] hi[3]
+			box_sdf,
+			// p0[3] p1[3] radius, capped at both ends
+			cylinder_sdf,
+			// center[3] major radius, minor radius, axis along z
+			torus_sdf,
+			// point[3] normal[3], the side the normal points away from is inside
+			halfspace_sdf,
+			// gyroid sheet of period cell and thickness, unbounded, intersect it with a bounded shape
+			gyroid_sdf,
+			// hollow the child to a wall of the given thickness centered on its surface
+			shell_sdf,
+			union_sdf,
+			intersect_sdf,
+			// first child minus the others
+			subtract_sdf
+		};
+
+	private:
+		kind_t _kind = empty_sdf;
+		double _p[7] = { 0 };
+		std::vector<sdf_t> _children;
+
+	public:
+		sdf_t(void) {}
+
+		static sdf_t sphere(const double center[3], double radius);
+
+		static sdf_t box(const double lo[3], const double hi[3]);
+
+		static sdf_t cylinder(const double p0[3], const double p1[3], double radius);
+
+		static sdf_t torus(const double center[3], double major_radius, double minor_radius);
+
+		static sdf_t halfspace(const double point[3], const double normal[3]);
+
+		static sdf_t gyroid(double cell, double thickness);
+
+		static sdf_t shell(const sdf_t& child, double thickness);
+
+		static sdf_t combine(kind_t op, const std::vector<sdf_t>& children);
+
+		sdf_t operator|(const sdf_t& other) const { return combine(union_sdf, { *this, other }); }
+
+		sdf_t operator&(const sdf_t& other) const { return combine(intersect_sdf, { *this, other }); }
+
+		sdf_t operator-(const sdf_t& other) const { return combine(subtract_sdf, { *this, other }); }
+
+		kind_t kind(void) const { return _kind; }
+
+		bool empty(void) const { return _kind == empty_sdf; }
+
+		double eval(const double p[3]) const;
+
+		// d[i] = distance at (x[i], y[i], z[i]), branch free per primitive so the loops vectorize
+		void evaluate(int n, const double* x, const double* y, const double* z, double* d) const;
+
+		// normalized central difference gradient with step h, the outward normal on the surface
+		void gradient(const double p[3], double h, double g[3]) const;
+
+		// bounding box of the solid, false if it is unbounded (halfspace, gyroid not intersected with a bounded shape)
+		bool bounds(double lo[3], double hi[3]) const;
+	};
+
+	// the analytic shapes inside [0,1]^3 the bench and perfcheck tools build without mesh voxelization :
+	// cube, sphere, shell and beam. False for any other name
+	bool benchShape(const std::string& name, sdf_t& sdf);
+}
+
+#endif
+
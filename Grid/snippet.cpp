@@ -1,6 +1,19 @@
 #include "snippet.h"
 #include <chrono>
 #include <thread>
+#include <sstream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 void snippet::trim(std::string& str)
 {
@@ -8,8 +21,96 @@ void snippet::trim(std::string& str)
 	str.erase(std::find_if(str.rbegin(), str.rend(), [](unsigned char ch) {return ch != ' '; }).base(), str.end());
 }
 
+std::vector<std::string> snippet::split(const std::string& str, char delim)
+{
+	std::vector<std::string> items;
+	std::istringstream is(str);
+	std::string item;
+	while (std::getline(is, item, delim)) if (!item.empty()) items.push_back(item);
+	return items;
+}
+
 void snippet::stop_ms(int millisecond)
 {
 	//Sleep(millisecond);
 	std::this_thread::sleep_for(std::chrono::milliseconds(millisecond));
 }
+
+bool snippet::mapped_file_t::open(const std::string& filename, hint_t hint)
+{
+	close();
+#ifdef _WIN32
+	HANDLE hfile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		hint == sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hfile == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(hfile, &fsize)) {
+		CloseHandle(hfile);
+		return false;
+	}
+	_hfile = hfile;
+	_len = size_t(fsize.QuadPart);
+	_open = true;
+	if (_len == 0) return true;
+	HANDLE hmap = CreateFileMappingA(hfile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* view = hmap == nullptr ? nullptr : MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		if (hmap != nullptr) CloseHandle(hmap);
+		close();
+		return false;
+	}
+	_hmap = hmap;
+	_data = (const char*)view;
+	return true;
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd == -1) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	_len = st.st_size;
+	_open = true;
+	if (_len == 0) {
+		::close(fd);
+		return true;
+	}
+	void* pmap = mmap(nullptr, _len, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (pmap == MAP_FAILED) {
+		close();
+		return false;
+	}
+	if (hint == sequential) madvise(pmap, _len, MADV_SEQUENTIAL);
+	else if (hint == willneed) madvise(pmap, _len, MADV_WILLNEED);
+	_data = (const char*)pmap;
+	return true;
+#endif
+}
+
+void snippet::mapped_file_t::close(void)
+{
+#ifdef _WIN32
+	if (_data != nullptr) UnmapViewOfFile(_data);
+	if (_hmap != nullptr) CloseHandle(_hmap);
+	if (_hfile != nullptr) CloseHandle(_hfile);
+	_hmap = nullptr;
+	_hfile = nullptr;
+#else
+	if (_data != nullptr) munmap((void*)_data, _len);
+#endif
+	_data = nullptr;
+	_len = 0;
+	_open = false;
+}
+
+bool snippet::sync_file(FILE* fp)
+{
+	if (fflush(fp) != 0) return false;
+#ifdef _WIN32
+	return _commit(_fileno(fp)) == 0;
+#else
+	return fsync(fileno(fp)) == 0;
+#endif
+}
@@ -12,8 +12,10 @@
 #include "stack"
 #include "string"
 #include "numeric"
+#include "vector"
 
 #include "array"
+#include "cstdio"
 
 #ifdef __linux__
 #ifndef sprintf_s
@@ -24,6 +26,9 @@
 namespace snippet {
 	void trim(std::string& str);
 
+	// items of str separated by delim, empty items are dropped
+	std::vector<std::string> split(const std::string& str, char delim);
+
 	template<typename Vec>
 	void write_vector(const std::string& filename, const Vec& v) {
 		std::ofstream ofs(filename);
@@ -210,6 +215,27 @@ namespace snippet {
 			_itn++;
 			return  _stopcounter > _maxcounter;
 		}
+
+		// history of the criteria as [stopcounter, itn, oldvalue[20], oldconstrain[nConstrain][20]]
+		std::vector<double> getHistory(void) {
+			std::vector<double> his{ double(_stopcounter), double(_itn) };
+			for (int i = 0; i < 20; i++) his.emplace_back(_oldvalue[i]);
+			for (int j = 0; j < _nConstrain; j++) {
+				for (int i = 0; i < 20; i++) his.emplace_back(_oldconstrain[j][i]);
+			}
+			return his;
+		}
+
+		bool setHistory(const double* his, size_t len) {
+			if (len != 22 + _nConstrain * 20) return false;
+			_stopcounter = his[0];
+			_itn = his[1];
+			for (int i = 0; i < 20; i++) _oldvalue[i] = his[2 + i];
+			for (int j = 0; j < _nConstrain; j++) {
+				for (int i = 0; i < 20; i++) _oldconstrain[j][i] = his[22 + j * 20 + i];
+			}
+			return true;
+		}
 	};
 
 	template<int modulu = 0>
@@ -317,6 +343,39 @@ namespace snippet {
 	};
 
 	void stop_ms(int millisecond);
+
+	// read only mapping of a whole file, mmap on POSIX and a file mapping on Windows, unmapped on close or destruction
+	class mapped_file_t {
+		const char* _data = nullptr;
+		size_t _len = 0;
+		bool _open = false;
+#ifdef _WIN32
+		void* _hfile = nullptr;
+		void* _hmap = nullptr;
+#endif
+	public:
+		// access pattern hint for the kernel, ignored where it is not supported
+		enum hint_t { normal, sequential, willneed };
+
+		mapped_file_t(void) = default;
+		mapped_file_t(const mapped_file_t&) = delete;
+		mapped_file_t& operator=(const mapped_file_t&) = delete;
+		~mapped_file_t() { close(); }
+
+		// false if the file cannot be opened or mapped, an empty file is open with size 0 and no data
+		bool open(const std::string& filename, hint_t hint = normal);
+
+		void close(void);
+
+		bool is_open(void) const { return _open; }
+
+		const char* data(void) const { return _data; }
+
+		size_t size(void) const { return _len; }
+	};
+
+	// flush the data written to fp down to the disk (fsync, _commit on Windows), false on failure
+	bool sync_file(FILE* fp);
 };
 
 
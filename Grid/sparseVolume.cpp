@@ -0,0 +1,273 @@
+#include "sparseVolume.h"
+#include "cstring"
+#include "cstdio"
+#include "cmath"
+#include "snippet.h"
+
+using namespace grid;
+
+static const char svol_magic[8] = { 'H','E','X','S','V','O','L','\0' };
+
+static const int svol_version = 1;
+
+static int quantBytes(int quant) {
+  switch (quant) {
+  case svol_float32: return sizeof(float);
+  case svol_uint16: return sizeof(unsigned short);
+  case svol_uint8: return sizeof(unsigned char);
+  default: return 0;
+  }
+}
+
+// visit active elements of a brick in mask order, fn(local bit, element rank)
+template<typename Func>
+static void forEachBrickElement(const BitSAT<unsigned int>& esat, int ereso, const int bpos[3], Func fn) {
+  int base[3] = { bpos[0] * svol_brick_dim, bpos[1] * svol_brick_dim, bpos[2] * svol_brick_dim };
+  int nx = (std::min)(svol_brick_dim, ereso - base[0]);
+  for (int lz = 0; lz < svol_brick_dim && base[2] + lz < ereso; lz++) {
+    for (int ly = 0; ly < svol_brick_dim && base[1] + ly < ereso; ly++) {
+      size_t rowbit = base[0] + size_t(base[1] + ly) * ereso + size_t(base[2] + lz) * ereso * ereso;
+      // the nx bits of the row, they may straddle two words
+      size_t w = rowbit / BitCount<unsigned int>::value;
+      int off = rowbit % BitCount<unsigned int>::value;
+      unsigned long long row = esat._bitArray[w] >> off;
+      if (off + nx > BitCount<unsigned int>::value && w + 1 < esat._bitArray.size()) {
+        row |= (unsigned long long)esat._bitArray[w + 1] << (BitCount<unsigned int>::value - off);
+      }
+      row &= (1ull << nx) - 1;
+      if (row == 0) continue;
+      // ranks of set bits in one row are consecutive
+      int eid = esat[rowbit];
+      for_each_bit(row, [&](int lx) {
+        fn(lx + ly * svol_brick_dim + lz * svol_brick_dim * svol_brick_dim, eid++);
+      });
+    }
+  }
+}
+
+bool grid::writeSparseVolume(
+  const std::string& filename, const BitSAT<unsigned int>& esat, int ereso, const float box[2][3],
+  const std::vector<int>& eidmap, const std::vector<float>& gsvalue, svol_quant quant
+) {
+  int nb = (ereso + svol_brick_dim - 1) / svol_brick_dim;
+  size_t nbtotal = size_t(nb) * nb * nb;
+
+  // value range for quantization
+  float vmin = 1e30f, vmax = -1e30f;
+#pragma omp parallel for reduction(min:vmin) reduction(max:vmax)
+  for (int i = 0; i < eidmap.size(); i++) {
+    float v = gsvalue[eidmap[i]];
+    vmin = (std::min)(vmin, v);
+    vmax = (std::max)(vmax, v);
+  }
+  if (eidmap.empty()) { vmin = 0; vmax = 0; }
+
+  // masks and counts of all bricks
+  std::vector<svol_brick_t> bricks(nbtotal);
+#pragma omp parallel for schedule(dynamic)
+  for (int bid = 0; bid < nbtotal; bid++) {
+    svol_brick_t& brk = bricks[bid];
+    memset(&brk, 0, sizeof(brk));
+    brk.pos[0] = bid % nb; brk.pos[1] = bid / nb % nb; brk.pos[2] = bid / nb / nb;
+    forEachBrickElement(esat, ereso, brk.pos, [&](int lbit, int eid) {
+      brk.mask[lbit / 64] |= 1ull << (lbit % 64);
+      brk.n_value++;
+    });
+  }
+
+  // compact the index and assign value offsets
+  size_t nactive = 0;
+  long long nvalue = 0;
+  for (int bid = 0; bid < nbtotal; bid++) {
+    if (bricks[bid].n_value == 0) continue;
+    bricks[bid].offset = nvalue;
+    nvalue += bricks[bid].n_value;
+    bricks[nactive++] = bricks[bid];
+  }
+  bricks.resize(nactive);
+
+  int vbytes = quantBytes(quant);
+  std::vector<char> values(size_t(nvalue) * vbytes);
+  float vscale = vmax > vmin ? 1.f / (vmax - vmin) : 0;
+  float qmax = quant == svol_uint16 ? 65535.f : 255.f;
+
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < nactive; i++) {
+    const svol_brick_t& brk = bricks[i];
+    long long k = brk.offset;
+    forEachBrickElement(esat, ereso, brk.pos, [&](int lbit, int eid) {
+      float v = gsvalue[eidmap[eid]];
+      char* pv = values.data() + size_t(k) * vbytes;
+      if (quant == svol_float32) {
+        memcpy(pv, &v, sizeof(float));
+      }
+      else {
+        unsigned int q = std::lround((v - vmin) * vscale * qmax);
+        if (quant == svol_uint16) { unsigned short q16 = q; memcpy(pv, &q16, sizeof(q16)); }
+        else { unsigned char q8 = q; memcpy(pv, &q8, sizeof(q8)); }
+      }
+      k++;
+    });
+  }
+
+  svol_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, svol_magic, sizeof(svol_magic));
+  header.version = svol_version;
+  header.ereso = ereso;
+  header.quant = quant;
+  header.n_brick = nactive;
+  header.n_value = nvalue;
+  header.vrange[0] = vmin;
+  header.vrange[1] = vmax;
+  for (int i = 0; i < 6; i++) (&header.box[0][0])[i] = (&box[0][0])[i];
+
+  FILE* fp = fopen(filename.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("\033[31m-- cannot open file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  bool suc = fwrite(&header, sizeof(header), 1, fp) == 1;
+  if (nactive > 0) suc = suc && fwrite(bricks.data(), sizeof(svol_brick_t), nactive, fp) == nactive;
+  if (!values.empty()) suc = suc && fwrite(values.data(), 1, values.size(), fp) == values.size();
+  suc = fclose(fp) == 0 && suc;
+  if (!suc) {
+    printf("\033[31m-- failed to write %s\033[0m\n", filename.c_str());
+  }
+  return suc;
+}
+
+// map a volume file and check its header, size and brick table, every brick lies in the lattice and its values
+// in the packed array, so a corrupted offset, mask or position cannot read past the mapping or the bit array
+static bool mapSparseVolume(const std::string& filename, snippet::mapped_file_t& file, svol_header_t& header) {
+  if (!file.open(filename, snippet::mapped_file_t::sequential)) {
+    printf("\033[31m-- cannot open file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+  size_t filesize = file.size();
+  if (filesize < sizeof(svol_header_t)) {
+    printf("\033[31m-- invalid volume file %s\033[0m\n", filename.c_str());
+    return false;
+  }
+
+  const char* pdata = file.data();
+  memcpy(&header, pdata, sizeof(header));
+  int vbytes = quantBytes(header.quant);
+  if (memcmp(header.magic, svol_magic, sizeof(svol_magic)) != 0 || header.version != svol_version || vbytes == 0
+    || header.ereso <= 0 || header.n_brick < 0 || header.n_value < 0) {
+    printf("\033[31m-- %s is not a sparse volume file\033[0m\n", filename.c_str());
+    return false;
+  }
+  if (filesize != sizeof(header) + sizeof(svol_brick_t) * size_t(header.n_brick) + size_t(header.n_value) * vbytes) {
+    printf("\033[31m-- volume file %s is truncated\033[0m\n", filename.c_str());
+    return false;
+  }
+
+  int nbrick_axis = (header.ereso + svol_brick_dim - 1) / svol_brick_dim;
+  for (int i = 0; i < header.n_brick; i++) {
+    svol_brick_t brk;
+    memcpy(&brk, pdata + sizeof(header) + sizeof(svol_brick_t) * i, sizeof(brk));
+    long long count = 0;
+    for (int w = 0; w < sizeof(brk.mask) / sizeof(brk.mask[0]); w++) count += countOne(brk.mask[w]);
+    bool inside = true;
+    for (int k = 0; k < 3; k++) inside = inside && brk.pos[k] >= 0 && brk.pos[k] < nbrick_axis;
+    if (!inside || brk.offset < 0 || count != brk.n_value || brk.offset + count > header.n_value) {
+      printf("\033[31m-- volume file %s has an invalid brick %d\033[0m\n", filename.c_str(), i);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool grid::readSparseVolume(
+  const std::string& filename, const BitSAT<unsigned int>& esat, int ereso,
+  const std::vector<int>& eidmap, std::vector<float>& gsvalue
+) {
+  snippet::mapped_file_t file;
+  svol_header_t header;
+  if (!mapSparseVolume(filename, file, header)) return false;
+  if (header.ereso != ereso) {
+    printf("\033[31m-- unmatched grid and file, reso %d vs %d\033[0m\n", header.ereso, ereso);
+    return false;
+  }
+
+  const char* pdata = file.data();
+  int vbytes = quantBytes(header.quant);
+  const svol_brick_t* bricks = (const svol_brick_t*)(pdata + sizeof(header));
+  const char* values = (const char*)(bricks + header.n_brick);
+  float vmin = header.vrange[0];
+  float vlen = header.vrange[1] - header.vrange[0];
+  float qmax = header.quant == svol_uint16 ? 65535.f : 255.f;
+  int n_unmatched = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+:n_unmatched)
+  for (int i = 0; i < header.n_brick; i++) {
+    svol_brick_t brk;
+    memcpy(&brk, &bricks[i], sizeof(brk));
+    int base[3] = { brk.pos[0] * svol_brick_dim, brk.pos[1] * svol_brick_dim, brk.pos[2] * svol_brick_dim };
+    long long k = brk.offset;
+    for (int lbit = 0; lbit < svol_brick_dim * svol_brick_dim * svol_brick_dim; lbit++) {
+      if (!(brk.mask[lbit / 64] & (1ull << (lbit % 64)))) continue;
+      const char* pv = values + size_t(k++) * vbytes;
+      int epos[3] = {
+        base[0] + lbit % svol_brick_dim,
+        base[1] + lbit / svol_brick_dim % svol_brick_dim,
+        base[2] + lbit / svol_brick_dim / svol_brick_dim };
+      if (epos[0] < 0 || epos[1] < 0 || epos[2] < 0 || epos[0] >= ereso || epos[1] >= ereso || epos[2] >= ereso) {
+        n_unmatched++;
+        continue;
+      }
+      int eid = esat(epos[0] + size_t(epos[1]) * ereso + size_t(epos[2]) * ereso * ereso);
+      if (eid == -1) { n_unmatched++; continue; }
+      float v;
+      if (header.quant == svol_float32) {
+        memcpy(&v, pv, sizeof(float));
+      }
+      else if (header.quant == svol_uint16) {
+        unsigned short q16; memcpy(&q16, pv, sizeof(q16));
+        v = vmin + q16 / qmax * vlen;
+      }
+      else {
+        unsigned char q8; memcpy(&q8, pv, sizeof(q8));
+        v = vmin + q8 / qmax * vlen;
+      }
+      gsvalue[eidmap[eid]] = v;
+    }
+  }
+
+  if (n_unmatched > 0) {
+    printf("\033[31m-- unmatched grid and file, %d elements of %s are not in the grid\033[0m\n", n_unmatched, filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool grid::readSparseLattice(const std::string& filename, std::vector<unsigned int>& ebits, int& ereso, float box[2][3]) {
+  snippet::mapped_file_t file;
+  svol_header_t header;
+  if (!mapSparseVolume(filename, file, header)) return false;
+
+  ereso = header.ereso;
+  for (int i = 0; i < 6; i++) (&box[0][0])[i] = (&header.box[0][0])[i];
+  size_t nbit = size_t(ereso) * ereso * ereso;
+  ebits.assign(snippet::Round<BitCount<unsigned int>::value>(nbit) / BitCount<unsigned int>::value, 0);
+
+  const svol_brick_t* bricks = (const svol_brick_t*)(file.data() + sizeof(header));
+  for (int i = 0; i < header.n_brick; i++) {
+    svol_brick_t brk;
+    memcpy(&brk, &bricks[i], sizeof(brk));
+    for (int lbit = 0; lbit < svol_brick_dim * svol_brick_dim * svol_brick_dim; lbit++) {
+      if (!(brk.mask[lbit / 64] & (1ull << (lbit % 64)))) continue;
+      int epos[3] = {
+        brk.pos[0] * svol_brick_dim + lbit % svol_brick_dim,
+        brk.pos[1] * svol_brick_dim + lbit / svol_brick_dim % svol_brick_dim,
+        brk.pos[2] * svol_brick_dim + lbit / svol_brick_dim / svol_brick_dim };
+      if (epos[0] >= ereso || epos[1] >= ereso || epos[2] >= ereso) {
+        printf("\033[31m-- volume file %s has an invalid brick %d\033[0m\n", filename.c_str(), i);
+        return false;
+      }
+      set_bit(ebits.data(), epos[0] + size_t(epos[1]) * ereso + size_t(epos[2]) * ereso * ereso);
+    }
+  }
+  return true;
+}
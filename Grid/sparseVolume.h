@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef __SPARSE_VOLUME_H
+#define __SPARSE_VOLUME_H
+
+#include "Grid.h"
+#include "string"
+
+// Sparse brick volume (.svb), element fields of the finest lattice without openvdb.
+// Layout (native endian) :
+//   svol_header_t | svol_brick_t [n_brick] | packed values [n_value]
+// The lattice is split into 8^3 bricks, only bricks with active elements are stored. Each brick keeps
+// a 512 bit mask (bit lx + ly * 8 + lz * 64) and the values of its active elements packed in mask order.
+namespace grid {
+
+	enum svol_quant {
+		svol_float32 = 0,
+		// linear quantization in [vmin, vmax] of the written field
+		svol_uint16 = 1,
+		svol_uint8 = 2
+	};
+
+	constexpr int svol_brick_dim = 8;
+
+	struct svol_header_t {
+		char magic[8];
+		int version;
+		int ereso;
+		int quant;
+		int n_brick;
+		long long n_value;
+		float vrange[2];
+		float box[2][3];
+	};
+
+	struct svol_brick_t {
+		int pos[3];
+		int n_value;
+		// offset of the first value in the packed value array
+		long long offset;
+		unsigned long long mask[svol_brick_dim * svol_brick_dim * svol_brick_dim / 64];
+	};
+
+	// gsvalue is in gs order, eidmap maps element rank of esat to gs order
+	bool writeSparseVolume(
+		const std::string& filename, const BitSAT<unsigned int>& esat, int ereso, const float box[2][3],
+		const std::vector<int>& eidmap, const std::vector<float>& gsvalue, svol_quant quant = svol_float32);
+
+	// map the file and scatter its values to gsvalue, the lattice of the file must match esat
+	bool readSparseVolume(
+		const std::string& filename, const BitSAT<unsigned int>& esat, int ereso,
+		const std::vector<int>& eidmap, std::vector<float>& gsvalue);
+
+	// element bits of the lattice a file was written on (ereso^3 bits, x fastest), its values are not read
+	bool readSparseLattice(const std::string& filename, std::vector<unsigned int>& ebits, int& ereso, float box[2][3]);
+}
+
+#endif
+
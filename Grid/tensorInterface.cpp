@@ -0,0 +1,213 @@
+#ifdef TORCH_INTERFACE
+
+#include "tensorInterface.h"
+#include "optimization.h"
+
+using namespace grid;
+
+namespace {
+  struct tensor_slot_t {
+    int64_t shape[1];
+    int64_t strides[1];
+  };
+
+  tensor_slot_t tensor_slots[hg_field_count][3];
+
+  bool gridsReady(void) {
+    if (grids.n_grid() == 0 || grids[0] == nullptr) {
+      printf("\033[31m-- tensor interface : grids are not built\033[0m\n");
+      return false;
+    }
+    return true;
+  }
+
+  // validate rank and element type, sizes of the leading dims are checked by the caller
+  bool checkTensor(const hg_tensor_t* t, const char* name, int ndim_min, int ndim_max, uint8_t code, uint8_t bits, int64_t inner) {
+    if (t == nullptr || t->data == nullptr) {
+      printf("\033[31m-- tensor interface : %s is null\033[0m\n", name);
+      return false;
+    }
+    if (t->ndim < ndim_min || t->ndim > ndim_max || t->dtype.code != code || t->dtype.bits != bits || t->dtype.lanes != 1) {
+      printf("\033[31m-- tensor interface : %s has unexpected rank or dtype\033[0m\n", name);
+      return false;
+    }
+    if (t->shape[t->ndim - 1] != inner) {
+      printf("\033[31m-- tensor interface : %s has %lld entries per row, expected %lld\033[0m\n", name, (long long)t->shape[t->ndim - 1], (long long)inner);
+      return false;
+    }
+    if (t->device.device_type != hg_device_cpu && t->device.device_type != hg_device_cuda) {
+      printf("\033[31m-- tensor interface : %s is on an unsupported device\033[0m\n", name);
+      return false;
+    }
+    // rows are copied with a pitch, broadcast or reversed rows have none
+    if (t->strides != nullptr && t->strides[t->ndim - 1] < 1) {
+      printf("\033[31m-- tensor interface : %s has a non positive row stride\033[0m\n", name);
+      return false;
+    }
+    return true;
+  }
+
+  int64_t stride(const hg_tensor_t* t, int dim) {
+    if (t->strides != nullptr) return t->strides[dim];
+    // compact row major
+    int64_t s = 1;
+    for (int i = dim + 1; i < t->ndim; i++) s *= t->shape[i];
+    return s;
+  }
+
+  char* address(const hg_tensor_t* t, const int64_t* idx, int nidx) {
+    int64_t off = 0;
+    for (int i = 0; i < nidx; i++) off += idx[i] * stride(t, i);
+    return (char*)t->data + t->byte_offset + off * (t->dtype.bits / 8);
+  }
+
+  // copy the row of t selected by the leading indices idx to / from the contiguous device buffer dev
+  template<typename T>
+  void copyRow(const hg_tensor_t* t, const int64_t* idx, int nidx, T* dev, int64_t n, bool todev) {
+    char* p = address(t, idx, nidx);
+    int64_t s = stride(t, t->ndim - 1);
+    if (s == 1) {
+      if (todev) gpu_manager_t::copy_buf(dev, p, sizeof(T) * n);
+      else gpu_manager_t::copy_buf(p, dev, sizeof(T) * n);
+      return;
+    }
+    // strided rows are gathered / scattered by one pitched copy, every element being a row of sizeof(T) bytes
+    if (todev) gpu_manager_t::copy_buf2D(dev, sizeof(T), p, sizeof(T) * s, sizeof(T), n);
+    else gpu_manager_t::copy_buf2D(p, sizeof(T) * s, dev, sizeof(T), sizeof(T), n);
+  }
+
+  void setRho(const hg_tensor_t* rho, int64_t b) {
+    int64_t idx[1] = { b };
+    copyRow(rho, idx, rho->ndim - 1, grids[0]->getRho(), grids[0]->n_rho(), true);
+    grids.update_stencil();
+  }
+
+  void setForce(const hg_tensor_t* force, int64_t b) {
+    double** f = grids[0]->getForce();
+    // [3, n] or [batch, 3, n]
+    for (int64_t k = 0; k < 3; k++) {
+      int64_t idx[2] = { b, k };
+      int nidx = force->ndim - 1;
+      copyRow(force, idx + 2 - nidx, nidx, f[k], grids[0]->n_nodes(), true);
+    }
+  }
+}
+
+int hg_get_lattice(int* ereso, float box[6]) {
+  if (!gridsReady()) return -1;
+  if (ereso != nullptr) *ereso = grids[0]->_ereso;
+  if (box != nullptr) {
+    for (int i = 0; i < 6; i++) box[i] = grids[0]->_box[i / 3][i % 3];
+  }
+  return 0;
+}
+
+int hg_get_tensor(int field, int component, hg_tensor_t* tensor) {
+  if (!gridsReady() || tensor == nullptr) return -1;
+  if (field < 0 || field >= hg_field_count) {
+    printf("\033[31m-- tensor interface : invalid field %d\033[0m\n", field);
+    return -1;
+  }
+  bool vec = field == hg_field_u || field == hg_field_f;
+  if (vec && (component < 0 || component > 2)) {
+    printf("\033[31m-- tensor interface : invalid component %d\033[0m\n", component);
+    return -1;
+  }
+  if (!vec) component = 0;
+
+  Grid& g = *grids[0];
+  void* data = nullptr;
+  int64_t n = 0;
+  hg_dtype_t dtype = { hg_dtype_float, 32, 1 };
+  switch (field) {
+  case hg_field_rho:
+    data = g.getRho(); n = g.n_rho();
+    break;
+  case hg_field_sens:
+    data = g.getSens(); n = g.n_rho();
+    break;
+  case hg_field_u:
+    data = g.getDisplacement()[component]; n = g.n_nodes(); dtype.bits = 64;
+    break;
+  case hg_field_f:
+    data = g.getForce()[component]; n = g.n_nodes(); dtype.bits = 64;
+    break;
+  case hg_field_eidmap:
+    data = g.getEidmap(); n = g.n_valid_elements(); dtype.code = hg_dtype_int;
+    break;
+  case hg_field_vidmap:
+    data = g.getVidmap(); n = g.n_vertices; dtype.code = hg_dtype_int;
+    break;
+  case hg_field_ebits:
+    data = g._gbuf.eActiveBits; n = g._gbuf.nword_ebits; dtype.code = hg_dtype_uint;
+    break;
+  }
+
+  tensor_slot_t& slot = tensor_slots[field][component];
+  slot.shape[0] = n;
+  slot.strides[0] = 1;
+  tensor->data = data;
+  tensor->device.device_type = hg_device_cuda;
+  tensor->device.device_id = gpu_manager_t::device_id();
+  tensor->ndim = 1;
+  tensor->dtype = dtype;
+  tensor->shape = slot.shape;
+  tensor->strides = slot.strides;
+  tensor->byte_offset = 0;
+  return 0;
+}
+
+int hg_set_rho(const hg_tensor_t* rho) {
+  if (!gridsReady()) return -1;
+  if (!checkTensor(rho, "rho", 1, 1, hg_dtype_float, 32, grids[0]->n_rho())) return -1;
+  setRho(rho, 0);
+  return 0;
+}
+
+int hg_set_force(const hg_tensor_t* force) {
+  if (!gridsReady()) return -1;
+  if (!checkTensor(force, "force", 2, 2, hg_dtype_float, 64, grids[0]->n_nodes())) return -1;
+  if (force->shape[0] != 3) {
+    printf("\033[31m-- tensor interface : force must have 3 components\033[0m\n");
+    return -1;
+  }
+  setForce(force, 0);
+  return 0;
+}
+
+int hg_solve_batch(const hg_tensor_t* rho, const hg_tensor_t* force, hg_tensor_t* u, double* compliance) {
+  if (!gridsReady()) return -1;
+  if (!checkTensor(force, "force", 3, 3, hg_dtype_float, 64, grids[0]->n_nodes())) return -1;
+  if (!checkTensor(u, "u", 3, 3, hg_dtype_float, 64, grids[0]->n_nodes())) return -1;
+  int64_t batch = force->shape[0];
+  if (force->shape[1] != 3 || u->shape[1] != 3 || u->shape[0] != batch) {
+    printf("\033[31m-- tensor interface : force and u must be [batch, 3, n_nodes]\033[0m\n");
+    return -1;
+  }
+  if (rho != nullptr) {
+    if (!checkTensor(rho, "rho", 1, 2, hg_dtype_float, 32, grids[0]->n_rho())) return -1;
+    if (rho->ndim == 2 && rho->shape[0] != batch) {
+      printf("\033[31m-- tensor interface : rho batch %lld does not match force batch %lld\033[0m\n", (long long)rho->shape[0], (long long)batch);
+      return -1;
+    }
+    // a shared field only needs the stencils once
+    if (rho->ndim == 1) setRho(rho, 0);
+  }
+
+  double** U = grids[0]->getDisplacement();
+  for (int64_t b = 0; b < batch; b++) {
+    if (rho != nullptr && rho->ndim == 2) setRho(rho, b);
+    setForce(force, b);
+    grids.resetAllResidual();
+    grids[0]->reset_displacement();
+    solveFEM();
+    for (int64_t k = 0; k < 3; k++) {
+      int64_t idx[2] = { b, k };
+      copyRow(u, idx, 2, U[k], grids[0]->n_nodes(), false);
+    }
+    if (compliance != nullptr) compliance[b] = grids[0]->compliance();
+  }
+  return 0;
+}
+
+#endif
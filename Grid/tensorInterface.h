@@ -0,0 +1,98 @@
+#pragma once
+
+#ifndef __TENSOR_INTERFACE_H
+#define __TENSOR_INTERFACE_H
+
+#ifdef TORCH_INTERFACE
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/*
+	  C interface exposing the finest layer buffers without copies. The descriptors have the memory layout
+	  of DLPack's DLDevice / DLDataType / DLTensor, so an embedding process can wrap them in a DLManagedTensor
+	  (with a no-op deleter) and pass them to torch.utils.dlpack.from_dlpack. Data pointers, shapes and strides
+	  stay valid until the grids are rebuilt or cleared. Buffers are indexed in Gauss-Seidel order.
+	*/
+
+	typedef enum {
+		hg_device_cpu = 1,
+		hg_device_cuda = 2
+	} hg_device_type;
+
+	typedef enum {
+		hg_dtype_int = 0,
+		hg_dtype_uint = 1,
+		hg_dtype_float = 2
+	} hg_dtype_code;
+
+	typedef struct {
+		int32_t device_type;
+		int32_t device_id;
+	} hg_device_t;
+
+	typedef struct {
+		uint8_t code;
+		uint8_t bits;
+		uint16_t lanes;
+	} hg_dtype_t;
+
+	typedef struct {
+		void* data;
+		hg_device_t device;
+		int32_t ndim;
+		hg_dtype_t dtype;
+		int64_t* shape;
+		// in elements, never null for descriptors returned by hg_get_tensor
+		int64_t* strides;
+		uint64_t byte_offset;
+	} hg_tensor_t;
+
+	typedef enum {
+		// float32 [n_rho]
+		hg_field_rho = 0,
+		// float32 [n_rho]
+		hg_field_sens,
+		// float64 [n_nodes], one tensor per component
+		hg_field_u,
+		// float64 [n_nodes], one tensor per component
+		hg_field_f,
+		// int32 [n_valid_elements], element rank in the lattice bit set -> gs index of rho / sens
+		hg_field_eidmap,
+		// int32 [n_vertices], vertex rank in the vertex lattice bit set -> gs index of u / f
+		hg_field_vidmap,
+		// uint32 [n_words], active element bits of the ereso^3 lattice, bit id = x + y * ereso + z * ereso^2
+		hg_field_ebits,
+		hg_field_count
+	} hg_field;
+
+	// element resolution of the finest layer and its bounding box [xmin ymin zmin xmax ymax zmax]
+	int hg_get_lattice(int* ereso, float box[6]);
+
+	// descriptor of a finest layer buffer, component selects the axis of u / f and is ignored otherwise.
+	// returns 0 on success, -1 if the grids are not built or the field is invalid
+	int hg_get_tensor(int field, int component, hg_tensor_t* tensor);
+
+	// copy float32 [n_rho] densities (host or cuda, any stride) into rho and update the stencils
+	int hg_set_rho(const hg_tensor_t* rho);
+
+	// copy float64 [3, n_nodes] loads (host or cuda, any strides) into f
+	int hg_set_force(const hg_tensor_t* force);
+
+	// run batch solves back to back : for each b, set rho[b] (rho may be null to keep the current
+	// densities, or 1-D to share one field), set force[b], solve the displacement and copy it to u[b].
+	// rho is [batch, n_rho] float32, force and u are [batch, 3, n_nodes] float64, compliance is a host
+	// array of batch doubles or null
+	int hg_solve_batch(const hg_tensor_t* rho, const hg_tensor_t* force, hg_tensor_t* u, double* compliance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif
+
@@ -2,6 +2,8 @@
 
 std::map<std::string, float> tictoc::Record::_table;
 
+std::mutex tictoc::Record::_mutex;
+
 
 tictoc::void_buf tictoc::_voidBuf;
 
@@ -14,6 +16,7 @@ std::chrono::steady_clock::time_point tictoc::getTag(void)
 
 float tictoc::get_record(const std::string& rec_name)
 {
+	std::lock_guard<std::mutex> lk(_record._mutex);
 	auto it = _record._table.find(rec_name);
 	if (it != _record._table.end()) {
 		return it->second;
@@ -25,6 +28,7 @@ float tictoc::get_record(const std::string& rec_name)
 
 std::map<std::string, float> tictoc::clear_record(void)
 {
+	std::lock_guard<std::mutex> lk(_record._mutex);
 	std::map<std::string, float> oldmap = _record._table;
 	_record._table.clear();
 	return oldmap;
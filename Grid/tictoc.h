@@ -8,6 +8,7 @@
 #include "chrono"
 #include "iostream"
 #include "sstream"
+#include "mutex"
 
 namespace tictoc {
 
@@ -17,6 +18,7 @@ namespace tictoc {
 
 	class Record {
 		static std::map<std::string, float> _table;
+		static std::mutex _mutex;
 		friend float get_record(const std::string& rec_name);
 		friend std::map<std::string, float> clear_record(void);
 		friend class live;
@@ -46,6 +48,7 @@ namespace tictoc {
 			std::chrono::microseconds _age = std::chrono::duration_cast<std::chrono::microseconds>(_die - _born);
 			float _cost = float(_age.count()) / 1000;
 			tout << "[*] time cost on " << _name <<" : "<<_cost << " ms" << std::endl;
+			std::lock_guard<std::mutex> lk(_record._mutex);
 			_record._table[_name] += _cost;
 		}
 	};
@@ -0,0 +1,319 @@
+#include "optimization.h"
+#include "meshLoader.h"
+#include "tictoc.h"
+#include "profiler.h"
+#include <filesystem>
+#include <algorithm>
+#include <map>
+
+using namespace grid;
+
+/*
+  batch <jobfile>
+  Runs the jobs of the file in one process. A job starts with a [job] line followed by "key = value" lines,
+  '#' starts a comment. Keys left out keep the value of the previous job.
+    name = bracket                 label in the timing report
+    mesh = bracket.obj             .obj / .stl / .ply
+    scale = 1 0.5 0.25             per axis scale applied to the mesh
+    reso = 128
+    mode = nscf                    nscf / nsff / wscf / wsff
+    solver = pm                    pm / lobpcg
+    fixed = box 0 0 0 0.1 1 1      regions in the text form of region_t (box, sphere, cylinder, halfspace,
+    load = sphere 1 0.5 0.5 0.2    faces, union/intersect/subtract), repeated lines are united,
+                                   "clear" drops the inherited ones
+    force = 1 0 0
+    volume_ratio = 0.3, volume_decrease, design_step, filter_radius, damp_ratio, power_penalty,
+    min_rho, youngs_modulus, poisson_ratio, shell_width
+    multires = 64 20               coarse reso and iterations, 0 0 for a single level run
+    outdir = out/bracket
+    profile = 1                    write profile.csv and the chrome trace profile.json into outdir,
+                                   2 also counts host IPC and LLC misses per scope when perf_event is allowed
+    telemetry = 1                  write the per level v-cycle residuals mg_telemetry.csv / .json into outdir
+    tune_cycle = 0.1               tune the per layer v-cycle sweeps, retuned when the void fraction moves by 0.1
+    roofline = 1                   time the kernels against the device roofline into outdir/roofline.csv,
+                                   peaks can follow in GB/s and GFLOP/s : roofline = 1 900 7000
+    capture = 12                   capture the solver state of iteration 12 to outdir/capture_iter12 for the replay tool
+    checkpoint = 10 out/a/checkpoint
+                                   write outdir/checkpoint every 10 iterations, the optional file resumes the job from
+                                   a checkpoint and its .grid capture without building the grids, it is not inherited
+    sweep = lowvol 0.2 3 2 1e-3    parameter sweep variant : name volume_ratio power_penalty filter_radius min_rho,
+                                   repeated lines add variants run on the same grids into outdir/<name>/,
+                                   "clear" drops the inherited ones
+  Jobs with the same mesh, scale, resolution, shell width, regions and force reuse the built grids,
+  other jobs rebuild them into the recycled GPU memory of the previous grids.
+*/
+
+struct Job {
+  std::string name,mesh,mode="nscf",solver="pm",outdir="out";
+  double scale[3]={1,1,1};
+  int reso=128;
+  std::vector<region_t> fixed,load;
+  double force[3]={1,0,0};
+  float volume_ratio=0.3,volume_decrease=0.05,design_step=0.03,filter_radius=2,damp_ratio=0.5,power_penalty=3;
+  float min_rho=1e-3,youngs_modulus=1,poisson_ratio=0.3,shell_width=2;
+  int coarse_reso=0,coarse_itn=0;
+  int profile=0;
+  int telemetry=0;
+  // retune threshold on the void fraction, 0 keeps 1 / 1 sweeps
+  float tune_cycle=0;
+  // iteration captured for replay, 0 for none
+  int capture=0;
+  // checkpoint interval, 0 for none, and the checkpoint the job resumes from
+  int checkpoint=0;
+  std::string resume;
+  int roofline=0;
+  // 0 takes the peak of the device
+  double peak_gbps=0,peak_gflops=0;
+  // run parameterSweep over these instead of a single optimization
+  std::vector<SweepVariant> sweep;
+  // everything that goes into buildGrids
+  std::string gridKey() const {
+    std::ostringstream os;
+    os << mesh << "|" << scale[0] << " " << scale[1] << " " << scale[2] << "|" << reso << "|" << shell_width << "|";
+    for(const std::vector<region_t>* rs : {&fixed,&load}) {
+      for(const region_t& r : *rs) os << r.str() << ";";
+      os << "|";
+    }
+    os << force[0] << " " << force[1] << " " << force[2];
+    return os.str();
+  }
+};
+
+static bool parseRegion(const std::string& value,std::vector<region_t>& regions) {
+  size_t b=value.find_first_not_of(" \t");
+  if(b!=std::string::npos && value.compare(b,5,"clear")==0) {
+    regions.clear();
+    return true;
+  }
+  region_t r;
+  if(!region_t::parse(value,r)) return false;
+  regions.push_back(r);
+  return true;
+}
+
+static bool parseVariant(const std::string& value,std::vector<SweepVariant>& variants) {
+  std::istringstream is(value);
+  SweepVariant var;
+  if(!(is >> var.name)) return false;
+  if(var.name=="clear") {
+    variants.clear();
+    return true;
+  }
+  if(!(is >> var.volume_ratio >> var.power_penalty >> var.filter_radius >> var.min_rho)) return false;
+  variants.push_back(var);
+  return true;
+}
+
+static bool setKey(Job& job,const std::string& key,const std::string& value) {
+  std::istringstream is(value);
+  std::map<std::string,float*> floats={
+    {"volume_ratio",&job.volume_ratio},{"volume_decrease",&job.volume_decrease},{"design_step",&job.design_step},
+    {"filter_radius",&job.filter_radius},{"damp_ratio",&job.damp_ratio},{"power_penalty",&job.power_penalty},
+    {"min_rho",&job.min_rho},{"youngs_modulus",&job.youngs_modulus},{"poisson_ratio",&job.poisson_ratio},
+    {"shell_width",&job.shell_width}
+  };
+  if(floats.count(key)) return bool(is >> *floats[key]);
+  if(key=="name") return bool(is >> job.name);
+  if(key=="mesh") return bool(is >> job.mesh);
+  if(key=="mode") return bool(is >> job.mode);
+  if(key=="solver") return bool(is >> job.solver);
+  if(key=="outdir") return bool(is >> job.outdir);
+  if(key=="reso") return bool(is >> job.reso);
+  if(key=="profile") return bool(is >> job.profile);
+  if(key=="telemetry") return bool(is >> job.telemetry);
+  if(key=="tune_cycle") return bool(is >> job.tune_cycle);
+  if(key=="capture") return bool(is >> job.capture);
+  if(key=="checkpoint") {
+    if(!(is >> job.checkpoint)) return false;
+    job.resume.clear();
+    is >> job.resume;
+    return true;
+  }
+  if(key=="roofline") {
+    if(!(is >> job.roofline)) return false;
+    is >> job.peak_gbps >> job.peak_gflops;
+    return true;
+  }
+  if(key=="scale") return bool(is >> job.scale[0] >> job.scale[1] >> job.scale[2]);
+  if(key=="force") return bool(is >> job.force[0] >> job.force[1] >> job.force[2]);
+  if(key=="multires") return bool(is >> job.coarse_reso >> job.coarse_itn);
+  if(key=="fixed") return parseRegion(value,job.fixed);
+  if(key=="load") return parseRegion(value,job.load);
+  if(key=="sweep") return parseVariant(value,job.sweep);
+  return false;
+}
+
+static bool readJobs(const std::string& path,std::vector<Job>& jobs) {
+  std::ifstream is(path);
+  if(!is) {
+    printf("\033[31m-- cannot open job file %s\033[0m\n",path.c_str());
+    return false;
+  }
+  std::string line;
+  int lineno=0;
+  Job cur;
+  bool injob=false;
+  while(std::getline(is,line)) {
+    lineno++;
+    line=line.substr(0,line.find('#'));
+    size_t b=line.find_first_not_of(" \t\r");
+    if(b==std::string::npos) continue;
+    line=line.substr(b,line.find_last_not_of(" \t\r")-b+1);
+    if(line=="[job]") {
+      if(injob) jobs.push_back(cur);
+      injob=true;
+      cur.name="job"+std::to_string(jobs.size());
+      // a checkpoint belongs to the job that wrote it
+      cur.resume.clear();
+      continue;
+    }
+    size_t eq=line.find('=');
+    if(!injob || eq==std::string::npos) {
+      printf("\033[31m-- %s:%d : expected [job] or key = value\033[0m\n",path.c_str(),lineno);
+      return false;
+    }
+    std::string key=line.substr(0,line.find_last_not_of(" \t",eq-1)+1);
+    std::string value=line.substr(eq+1);
+    if(!setKey(cur,key,value)) {
+      printf("\033[31m-- %s:%d : invalid %s\033[0m\n",path.c_str(),lineno,key.c_str());
+      return false;
+    }
+  }
+  if(injob) jobs.push_back(cur);
+  return true;
+}
+
+static bool validJob(const Job& job) {
+  const char* modes[]={"nscf","nsff","wscf","wsff"};
+  if(std::find(std::begin(modes),std::end(modes),job.mode)==std::end(modes)) {
+    printf("\033[31m-- job %s : unsupported mode %s\033[0m\n",job.name.c_str(),job.mode.c_str());
+    return false;
+  }
+  if(job.solver!="pm" && job.solver!="lobpcg") {
+    printf("\033[31m-- job %s : unsupported solver %s\033[0m\n",job.name.c_str(),job.solver.c_str());
+    return false;
+  }
+  if(job.mesh.empty() || job.fixed.empty() || job.load.empty()) {
+    printf("\033[31m-- job %s : mesh, fixed and load are required\033[0m\n",job.name.c_str());
+    return false;
+  }
+  if(!job.sweep.empty() && job.coarse_reso>0 && job.coarse_itn>0) {
+    printf("\033[31m-- job %s : sweep runs on a single level, set multires = 0 0\033[0m\n",job.name.c_str());
+    return false;
+  }
+  if(!job.resume.empty() && ((job.coarse_reso>0 && job.coarse_itn>0) || !job.sweep.empty())) {
+    printf("\033[31m-- job %s : only single level runs resume from a checkpoint\033[0m\n",job.name.c_str());
+    return false;
+  }
+  return true;
+}
+
+struct JobTiming {
+  std::string name;
+  bool ok=false;
+  bool reused=false;
+  double load=0,build=0,optimize=0;
+};
+
+int main(int argc,char** argv) {
+  if(argc<2) {
+    printf("usage : batch <jobfile>\n");
+    return -1;
+  }
+  std::vector<Job> jobs;
+  if(!readJobs(argv[1],jobs)) return -1;
+  printf("-- %zu jobs in %s\n",jobs.size(),argv[1]);
+
+  // grids of consecutive jobs are rebuilt into the memory released by the previous ones
+  gpu_manager.enable_recycle(true);
+
+  std::string meshpath,gridkey;
+  std::vector<float> meshcoords;
+  std::vector<int> meshfaces;
+  std::vector<JobTiming> timings;
+  for(const Job& job : jobs) {
+    JobTiming tm;
+    tm.name=job.name;
+    printf("\n\033[32m== job %s ==\033[0m\n",job.name.c_str());
+    if(!validJob(job)) {
+      timings.push_back(tm);
+      continue;
+    }
+
+    enableProfiling(job.profile!=0,true,job.profile>1);
+    enableTelemetry(job.telemetry!=0);
+    enableCycleTuning(job.tune_cycle>0,job.tune_cycle);
+    setCapture(job.capture);
+    setCheckpoint(job.checkpoint,job.resume);
+    enableRoofline(job.roofline!=0,job.peak_gbps,job.peak_gflops);
+    tictoc::prof::reset();
+
+    auto t0=tictoc::getTag();
+    if(job.mesh!=meshpath) {
+      meshpath.clear();
+      gridkey.clear();
+      if(!loadMesh(job.mesh,meshcoords,meshfaces)) {
+        timings.push_back(tm);
+        continue;
+      }
+      meshpath=job.mesh;
+    }
+    auto t1=tictoc::getTag();
+
+    std::string outdir=job.outdir;
+    if(outdir.back()!='/') outdir.push_back('/');
+    std::filesystem::create_directories(outdir);
+    setOutpurDir(outdir);
+    setParameters(job.volume_ratio,job.volume_decrease,job.design_step,job.filter_radius,job.damp_ratio,job.power_penalty,
+                  job.min_rho,job.reso,job.youngs_modulus,job.poisson_ratio,job.shell_width,false,false);
+    setWorkMode(job.mode);
+    setWorstCaseSolver(job.solver);
+    setBoundaryRegions(region_t::combine(region_t::union_region,job.fixed),region_t::combine(region_t::union_region,job.load),job.force);
+
+    if(job.coarse_reso>0 && job.coarse_itn>0) {
+      // the multi-resolution driver builds both lattices itself
+      std::vector<float> coords=meshcoords;
+      for(int i=0; i<(int)coords.size(); i++) coords[i]*=job.scale[i%3];
+      grids.clear();
+      auto t2=tictoc::getTag();
+      multiResOptimization(coords,meshfaces,job.coarse_reso,job.coarse_itn);
+      auto t3=tictoc::getTag();
+      gpu_manager.trim();
+      gridkey.clear();
+      tm.build=tictoc::Duration<tictoc::ms>(t1,t2);
+      tm.optimize=tictoc::Duration<tictoc::ms>(t2,t3);
+    } else {
+      std::string key=job.gridKey();
+      tm.reused=key==gridkey;
+      if(!tm.reused) {
+        grids.clear();
+        // a resumed job restores the grids captured with its checkpoint
+        if(job.resume.empty() || !resumeGrids()) {
+          std::vector<float> coords=meshcoords;
+          for(int i=0; i<(int)coords.size(); i++) coords[i]*=job.scale[i%3];
+          buildGrids(coords,meshfaces);
+        }
+        // pooled memory no lattice buffer fitted into
+        gpu_manager.trim();
+        gridkey=key;
+      }
+      uploadTemplateMatrix();
+      auto t2=tictoc::getTag();
+      if(job.sweep.empty()) optimization();
+      else parameterSweep(job.sweep);
+      auto t3=tictoc::getTag();
+      tm.build=tictoc::Duration<tictoc::ms>(t1,t2);
+      tm.optimize=tictoc::Duration<tictoc::ms>(t2,t3);
+    }
+    tm.load=tictoc::Duration<tictoc::ms>(t0,t1);
+    tm.ok=true;
+    timings.push_back(tm);
+  }
+
+  printf("\n%-20s %10s %10s %12s %s\n","job","load(ms)","build(ms)","optimize(ms)","");
+  for(const JobTiming& tm : timings) {
+    if(!tm.ok) printf("%-20s %10s %10s %12s\n",tm.name.c_str(),"-","-","failed");
+    else printf("%-20s %10.0lf %10.0lf %12.0lf %s\n",tm.name.c_str(),tm.load,tm.build,tm.optimize,tm.reused ? "(grids reused)" : "");
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include "optimization.h"
+#include "tictoc.h"
+#include "roofline.h"
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+using namespace grid;
+
+/*
+  bench [--shapes cube,sphere,shell,beam] [--reso 64,128,256] [--reps 20] [--csv bench.csv]
+  Builds the hierarchy of each analytic shape (sdf_t) at each resolution and times the multigrid kernels per layer.
+  Every call is followed by a device synchronization and timed separately, the throughput uses the median.
+  GB/s and GFLOP/s come from the nominal cost model of roofline.h : each array is accessed once per call and the 3x3
+  block products of the stencils are counted, so they are lower bounds comparable across versions rather
+  than hardware counters. Kernels without a meaningful operation count report 0 GFLOP/s.
+  The CSV has one line per (shape, reso, layer, kernel) and is appended to, so runs of several versions
+  can be collected in one file.
+*/
+
+// ---- timing ----
+
+struct Result {
+  std::string shape,kernel;
+  int reso,layer,nv,ne,calls;
+  double mean,median,min,gbps,gflops;
+};
+
+static Result measure(const std::string& kernel,Grid* g,int reps,const kernel_cost_t& cost,std::function<void(void)> fn) {
+  kernel_time_t kt=timeKernel(fn,reps);
+  Result r;
+  r.kernel=kernel;
+  r.layer=g ? g->_layer : -1;
+  r.nv=g ? g->n_vertices : 0;
+  r.ne=g ? g->n_elements : 0;
+  r.calls=kt.calls;
+  r.min=kt.min;
+  r.median=kt.median;
+  r.mean=kt.mean;
+  r.gbps=r.median>0 ? cost.bytes/(r.median*1e-3)/1e9 : 0;
+  r.gflops=r.median>0 ? cost.flops/(r.median*1e-3)/1e9 : 0;
+  return r;
+}
+
+int main(int argc,char** argv) {
+  std::vector<std::string> shapes={"cube","sphere","shell","beam"};
+  std::vector<int> resos={64,128,256};
+  int reps=20;
+  std::string csvpath="bench.csv";
+  for(int i=1; i+1<argc; i+=2) {
+    std::string key=argv[i],value=argv[i+1];
+    if(key=="--shapes") shapes=snippet::split(value,',');
+    else if(key=="--reso") {
+      resos.clear();
+      for(const std::string& r : snippet::split(value,',')) resos.push_back(std::stoi(r));
+    } else if(key=="--reps") reps=std::max(1,std::stoi(value));
+    else if(key=="--csv") csvpath=value;
+    else {
+      printf("usage : bench [--shapes cube,sphere,shell,beam] [--reso 64,128,256] [--reps 20] [--csv bench.csv]\n");
+      return -1;
+    }
+  }
+
+  std::filesystem::create_directories("bench_out");
+  setOutpurDir("bench_out/");
+
+  bool newfile=!std::filesystem::exists(csvpath);
+  FILE* csv=fopen(csvpath.c_str(),"a");
+  if(!csv) {
+    printf("\033[31m-- cannot open %s\033[0m\n",csvpath.c_str());
+    return -1;
+  }
+  if(newfile) fprintf(csv,"shape,reso,layer,kernel,vertices,elements,calls,mean_ms,median_ms,min_ms,gbps,gflops\n");
+
+  double fixpt[3]={0.05,0,0},fixn[3]={1,0,0};
+  double loadpt[3]={0.95,0,0},loadn[3]={-1,0,0};
+  double force[3]={0,0,-1};
+
+  for(const std::string& shape : shapes) {
+    sdf_t sdf;
+    if(!benchShape(shape,sdf)) {
+      printf("\033[31m-- unknown shape %s\033[0m\n",shape.c_str());
+      continue;
+    }
+    for(int reso : resos) {
+      printf("\n\033[32m== %s %d ==\033[0m\n",shape.c_str(),reso);
+      setParameters(0.3,0.05,0.03,2,0.5,3,1e-3,reso,1,0.3,2,false,false);
+      setWorkMode("nscf");
+      setBoundaryRegions(region_t::halfspace(fixpt,fixn),region_t::halfspace(loadpt,loadn),force);
+      grids.clear();
+      buildGrids(sdf);
+      uploadTemplateMatrix();
+      initDensities(params.volume_ratio);
+      update_stencil();
+      grids[0]->randForce();
+
+      std::vector<Result> results;
+      int nlayer=grids.n_grid();
+      for(int i=0; i<nlayer; i++) {
+        Grid* g=grids[i];
+        if(g->is_dummy()) continue;
+        g->use_grid();
+        if(i<nlayer-1) {
+          results.push_back(measure("gs_relax",g,reps,relaxCost(*g),[=]() { g->gs_relax(); }));
+          results.push_back(measure("update_residual",g,reps,residualCost(*g),[=]() { g->update_residual(); }));
+          results.push_back(measure("prolongate_correction",g,reps,prolongateCost(*g),[=]() { g->prolongate_correction(); }));
+        }
+        if(i>0) {
+          results.push_back(measure("restrict_residual",g,reps,restrictCost(*g),[=]() { g->restrict_residual(); }));
+          results.push_back(measure("restrict_stencil",g,reps,stencilCost(*g),[=]() { grids.restrict_stencil(*g,*g->fineGrid); }));
+        }
+      }
+      // the restricted stencils are rebuilt so the v-cycle runs on a consistent hierarchy
+      update_stencil();
+      grids[0]->use_grid();
+      int radius=params.filter_radius;
+      results.push_back(measure("filterSensitivity",grids[0],reps,filterCost(*grids[0],radius),[=]() { grids[0]->filterSensitivity(radius); }));
+      results.push_back(measure("computeSensitivity",grids[0],reps,sensitivityCost(*grids[0],radius),[]() { computeSensitivity(); }));
+      results.push_back(measure("v_cycle",grids[0],reps,kernel_cost_t(),[]() { grids.v_cycle(); }));
+
+      printf("%-5s %-22s %10s %10s %10s %10s %8s %8s\n","layer","kernel","vertices","median(ms)","mean(ms)","min(ms)","GB/s","GFLOP/s");
+      for(Result& r : results) {
+        r.shape=shape;
+        r.reso=reso;
+        if(r.kernel=="v_cycle") r.layer=-1;
+        printf("%-5d %-22s %10d %10.3lf %10.3lf %10.3lf %8.1lf %8.1lf\n",r.layer,r.kernel.c_str(),r.nv,r.median,r.mean,r.min,r.gbps,r.gflops);
+        fprintf(csv,"%s,%d,%d,%s,%d,%d,%d,%.4lf,%.4lf,%.4lf,%.3lf,%.3lf\n",r.shape.c_str(),r.reso,r.layer,r.kernel.c_str(),
+                r.nv,r.ne,r.calls,r.mean,r.median,r.min,r.gbps,r.gflops);
+      }
+      fflush(csv);
+    }
+  }
+  fclose(csv);
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include "history_store_t.h"
+#include "sparseVolume.h"
+#include <string>
+
+using namespace grid;
+
+/*
+  histexport <density.hist> <density_lattice.svb> <iter> [out.svb]
+  Reconstructs the density of one recorded iteration from the history of a run and writes it as a sparse volume.
+  Density frames hold the active elements of the finest layer in lattice rank order, the lattice is taken from the
+  volume the optimization writes next to the history (coarse_density_lattice.svb for coarse_density.hist).
+  iter -1 exports the last recorded frame, the output defaults to density<iter>.svb.
+*/
+
+int main(int argc,char** argv) {
+  if(argc<4) {
+    printf("usage : histexport <density.hist> <density_lattice.svb> <iter> [out.svb]\n");
+    return -1;
+  }
+  std::string histpath=argv[1],latticepath=argv[2];
+  int itn=std::stoi(argv[3]);
+
+  history_reader_t history;
+  if(!history.open(histpath)) return -1;
+  if(history.n_frame()==0) {
+    printf("\033[31m-- history %s has no frames\033[0m\n",histpath.c_str());
+    return -1;
+  }
+  int frame=itn<0 ? history.n_frame()-1 : history.find(itn);
+  if(frame<0) {
+    printf("\033[31m-- iter %d was not recorded in %s\033[0m\n",itn,histpath.c_str());
+    return -1;
+  }
+  itn=history.itn(frame);
+
+  std::vector<unsigned int> ebits;
+  int ereso;
+  float box[2][3];
+  if(!readSparseLattice(latticepath,ebits,ereso,box)) return -1;
+  BitSAT<unsigned int> esat(std::move(ebits));
+  if(esat.total()!=history.n_value()) {
+    printf("\033[31m-- lattice %s has %zu elements, the history %zu values\033[0m\n",latticepath.c_str(),esat.total(),
+           history.n_value());
+    return -1;
+  }
+
+  std::vector<float> rho;
+  if(!history.read(frame,rho)) return -1;
+  // the values are already in rank order
+  std::vector<int> eidmap(rho.size());
+  for(int i=0; i<eidmap.size(); i++) eidmap[i]=i;
+
+  std::string outpath=argc>4 ? argv[4] : "density"+std::to_string(itn)+".svb";
+  if(!writeSparseVolume(outpath,esat,ereso,box,eidmap,rho)) return -1;
+  printf("-- exported iter %d of %s to %s\n",itn,histpath.c_str(),outpath.c_str());
+  return 0;
+}
@@ -1,44 +1,15 @@
 #include "optimization.h"
+#include "meshLoader.h"
 
 using namespace grid;
 
-std::vector<float> readVertices3D(const std::string& path) {
-  std::string line;
-  std::ifstream is(path);
-  std::vector<float> vertices;
-  while(std::getline(is,line)) {
-    char c;
-    double vx,vy,vz;
-    if((int)line.size()>1 && line[0]=='v' && line[1]==' ') {
-      std::istringstream(line) >> c >> vx >> vy >> vz;
-      vertices.push_back(vx);
-      vertices.push_back(vy);
-      vertices.push_back(vz);
-    }
-  }
-  return vertices;
-}
-std::vector<int> readTriangles(const std::string& path) {
-  std::string line;
-  std::ifstream is(path);
-  std::vector<int> faces;
-  while(std::getline(is,line)) {
-    char c;
-    std::string fx,fy,fz;
-    if((int)line.size()>1 && line[0]=='f' && line[1]==' ') {
-      std::istringstream(line) >> c >> fx >> fy >> fz;
-      faces.push_back(atoi(strtok((char*)fx.c_str(),"/"))-1);
-      faces.push_back(atoi(strtok((char*)fy.c_str(),"/"))-1);
-      faces.push_back(atoi(strtok((char*)fz.c_str(),"/"))-1);
-    }
-  }
-  return faces;
-}
 int main() {
   //std::string path="cube.obj";
   std::string path="sphere.obj";
-  std::vector<float> pcoords=readVertices3D(path);
-  std::vector<int> facevertices=readTriangles(path);
+  std::vector<float> pcoords;
+  std::vector<int> facevertices;
+  if(!loadMesh(path,pcoords,facevertices))
+    return -1;
   for(int i=0; i<(int)pcoords.size(); i+=3) {
     pcoords[i+1]*=0.5;
     pcoords[i+2]*=0.25;
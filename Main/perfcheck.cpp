@@ -0,0 +1,263 @@
+#include "optimization.h"
+#include "tictoc.h"
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <cmath>
+#include <map>
+
+using namespace grid;
+
+/*
+  perfcheck [--baseline perf/baseline.json] [--reps 7] [--cycles 10] [--tolerance 0.1] [--report perfcheck_report.txt] [--update]
+            [--skip-missing]
+  Runs a fixed set of synthetic hierarchies through the grid build, update_stencil, a number of v-cycles and the
+  compute of one optimization iteration (stencil, worst case by the power method, sensitivity, density update, no output).
+  Every stage is timed between device synchronizations, repeated, and summarized by its median and median absolute
+  deviation after one discarded warm up run.
+  A stage regresses when its median exceeds the baseline median by more than max(tolerance * baseline, 3 sigma) with
+  sigma = 1.4826 * the larger MAD of both runs. The diff is printed and written to the report, the exit code is 1 when a
+  stage regressed. --update writes the current run as the baseline instead, run it on the reference machine with a
+  pinned CPU governor and GPU clocks and commit the file. With --skip-missing a missing baseline skips the check
+  with exit code 0, which is what the perf_regression target does until a reference baseline is committed.
+*/
+
+// ---- fixed cases, analytic shapes inside [0,1]^3 ----
+
+struct Case {
+  std::string name,shape;
+  int reso;
+  sdf_t sdf;
+};
+
+// shapes of the bench tool (sdf.h), a baseline is only comparable while they stay the same
+static std::vector<Case> makeCases(void) {
+  std::vector<Case> cases={{"sphere_64","sphere",64},{"shell_128","shell",128},{"beam_128","beam",128}};
+  for(Case& c : cases) benchShape(c.shape,c.sdf);
+  return cases;
+}
+
+// ---- statistics ----
+
+struct Stat {
+  std::string key;
+  double median=0,mad=0;
+};
+
+static double median(std::vector<double> v) {
+  std::sort(v.begin(),v.end());
+  size_t n=v.size();
+  return n%2 ? v[n/2] : (v[n/2-1]+v[n/2])/2;
+}
+
+static Stat summarize(const std::string& key,const std::vector<double>& t) {
+  Stat s;
+  s.key=key;
+  s.median=median(t);
+  std::vector<double> dev;
+  for(double ti : t) dev.push_back(std::abs(ti-s.median));
+  s.mad=median(dev);
+  return s;
+}
+
+// ---- baseline file, one metric per line so it can be read back without a json library ----
+
+static std::string cpuGovernor(void) {
+  std::ifstream is("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+  std::string gov;
+  if(!(is >> gov)) gov="unknown";
+  return gov;
+}
+
+static bool writeBaseline(const std::string& path,const std::vector<Stat>& stats,int reps,int cycles) {
+  std::filesystem::path p(path);
+  if(p.has_parent_path()) std::filesystem::create_directories(p.parent_path());
+  FILE* fp=fopen(path.c_str(),"w");
+  if(!fp) {
+    printf("\033[31m-- cannot open %s\033[0m\n",path.c_str());
+    return false;
+  }
+  fprintf(fp,"{\n\"governor\": \"%s\",\n\"reps\": %d,\n\"cycles\": %d,\n\"metrics\": [\n",cpuGovernor().c_str(),reps,cycles);
+  for(int i=0; i<stats.size(); i++) {
+    fprintf(fp,"{\"key\": \"%s\", \"median_ms\": %.4lf, \"mad_ms\": %.4lf}%s\n",stats[i].key.c_str(),stats[i].median,stats[i].mad,
+            i+1<stats.size() ? "," : "");
+  }
+  fprintf(fp,"]\n}\n");
+  fclose(fp);
+  return true;
+}
+
+// value of "name": in a line, quotes stripped
+static bool jsonField(const std::string& line,const std::string& name,std::string& value) {
+  size_t k=line.find("\""+name+"\"");
+  if(k==std::string::npos) return false;
+  size_t b=line.find(':',k);
+  if(b==std::string::npos) return false;
+  b=line.find_first_not_of(" \t\"",b+1);
+  size_t e=line.find_first_of("\",}",b);
+  if(b==std::string::npos || e==std::string::npos) return false;
+  value=line.substr(b,e-b);
+  return true;
+}
+
+static bool readBaseline(const std::string& path,std::map<std::string,Stat>& stats,std::string& governor) {
+  std::ifstream is(path);
+  if(!is) return false;
+  std::string line,key,med,mad;
+  while(std::getline(is,line)) {
+    jsonField(line,"governor",governor);
+    if(!jsonField(line,"key",key) || !jsonField(line,"median_ms",med) || !jsonField(line,"mad_ms",mad)) continue;
+    Stat s;
+    s.key=key;
+    s.median=std::stod(med);
+    s.mad=std::stod(mad);
+    stats[key]=s;
+  }
+  return !stats.empty();
+}
+
+// ---- runs ----
+
+static double timed(std::function<void(void)> fn) {
+  gpu_manager_t::synchronize();
+  auto t0=tictoc::getTag();
+  fn();
+  gpu_manager_t::synchronize();
+  auto t1=tictoc::getTag();
+  return tictoc::Duration<tictoc::ms>(t0,t1);
+}
+
+static void runCase(const Case& c,int reps,int cycles,std::vector<Stat>& stats) {
+  double fixpt[3]={0.05,0,0},fixn[3]={1,0,0};
+  double loadpt[3]={0.95,0,0},loadn[3]={-1,0,0};
+  double force[3]={0,0,-1};
+  std::map<std::string,std::vector<double>> t;
+  for(int r=0; r<=reps; r++) {
+    printf("\n\033[32m== %s rep %d/%d ==\033[0m\n",c.name.c_str(),r,reps);
+    setParameters(0.3,0.05,0.03,2,0.5,3,1e-3,c.reso,1,0.3,2,false,false);
+    setWorkMode("nscf");
+    setBoundaryRegions(region_t::halfspace(fixpt,fixn),region_t::halfspace(loadpt,loadn),force);
+    grids.clear();
+    std::map<std::string,double> rep;
+    rep["build"]=timed([&]() { buildGrids(c.sdf); uploadTemplateMatrix(); });
+    initDensities(params.volume_ratio);
+    rep["update_stencil"]=timed([]() { update_stencil(); });
+    grids[0]->randForce();
+    grids[0]->reset_displacement();
+    rep["v_cycles"]=timed([=]() { for(int i=0; i<cycles; i++) grids.v_cycle(); });
+    rep["iteration"]=timed([]() {
+      update_stencil();
+      modifiedPM();
+      computeSensitivity();
+      updateDensities(params.volume_ratio);
+    });
+    // the first run pays for context creation and first touch allocations
+    if(r==0) continue;
+    for(auto& it : rep) t[it.first].push_back(it.second);
+  }
+  for(auto& it : t) stats.push_back(summarize(c.name+"/"+it.first,it.second));
+}
+
+int main(int argc,char** argv) {
+  std::string basepath="perf/baseline.json",reportpath="perfcheck_report.txt";
+  int reps=7,cycles=10;
+  double tolerance=0.1;
+  bool update=false,skipmissing=false;
+  for(int i=1; i<argc; i++) {
+    std::string key=argv[i];
+    if(key=="--update") {
+      update=true;
+      continue;
+    }
+    if(key=="--skip-missing") {
+      skipmissing=true;
+      continue;
+    }
+    if(i+1>=argc) key.clear();
+    if(key=="--baseline") basepath=argv[++i];
+    else if(key=="--report") reportpath=argv[++i];
+    else if(key=="--reps") reps=std::max(1,std::stoi(argv[++i]));
+    else if(key=="--cycles") cycles=std::max(1,std::stoi(argv[++i]));
+    else if(key=="--tolerance") tolerance=std::stod(argv[++i]);
+    else {
+      printf("usage : perfcheck [--baseline perf/baseline.json] [--reps 7] [--cycles 10] [--tolerance 0.1] [--report perfcheck_report.txt] [--update]"
+             " [--skip-missing]\n");
+      return -1;
+    }
+  }
+
+  if(!update && skipmissing && !std::filesystem::exists(basepath)) {
+    printf("\033[33m-- no baseline %s, regression check skipped. Record one with --update on the reference machine"
+           " and commit it\033[0m\n",basepath.c_str());
+    return 0;
+  }
+
+  std::string governor=cpuGovernor();
+  if(governor!="performance") {
+    printf("\033[33m-- cpu governor is %s, timings are noisy. Pin it with `cpupower frequency-set -g performance`"
+           " and lock the GPU clocks with `nvidia-smi -lgc <clock>` for comparable runs\033[0m\n",governor.c_str());
+  }
+
+  std::map<std::string,Stat> base;
+  std::string basegov="unknown";
+  if(!update && !readBaseline(basepath,base,basegov)) {
+    printf("\033[31m-- cannot read baseline %s, create it with --update\033[0m\n",basepath.c_str());
+    return -1;
+  }
+
+  std::filesystem::create_directories("perfcheck_out");
+  setOutpurDir("perfcheck_out/");
+
+  std::vector<Stat> stats;
+  for(const Case& c : makeCases()) runCase(c,reps,cycles,stats);
+
+  if(update) {
+    if(!writeBaseline(basepath,stats,reps,cycles)) return -1;
+    printf("-- baseline written to %s\n",basepath.c_str());
+    return 0;
+  }
+
+  // diff report
+  std::ostringstream os;
+  char line[512];
+  if(basegov!=governor) os << "warning : baseline governor " << basegov << ", current " << governor << "\n";
+  snprintf(line,sizeof(line),"%-28s %12s %12s %9s %12s  %s\n","stage","base(ms)","now(ms)","delta","allowed(ms)","status");
+  os << line;
+  int nregressed=0;
+  for(const Stat& s : stats) {
+    auto it=base.find(s.key);
+    if(it==base.end()) {
+      snprintf(line,sizeof(line),"%-28s %12s %12.2lf %9s %12s  %s\n",s.key.c_str(),"-",s.median,"-","-","new");
+      os << line;
+      continue;
+    }
+    const Stat& b=it->second;
+    double allowed=std::max(tolerance*b.median,3*1.4826*std::max(b.mad,s.mad));
+    double diff=s.median-b.median;
+    const char* status="ok";
+    if(diff>allowed) {
+      status="REGRESSED";
+      nregressed++;
+    } else if(-diff>allowed) {
+      status="improved";
+    }
+    snprintf(line,sizeof(line),"%-28s %12.2lf %12.2lf %+8.1lf%% %12.2lf  %s\n",s.key.c_str(),b.median,s.median,
+             b.median>0 ? diff/b.median*100 : 0.,allowed,status);
+    os << line;
+  }
+  for(auto& it : base) {
+    if(std::none_of(stats.begin(),stats.end(),[&](const Stat& s) { return s.key==it.first; })) {
+      snprintf(line,sizeof(line),"%-28s %12.2lf %12s %9s %12s  %s\n",it.first.c_str(),it.second.median,"-","-","-","missing");
+      os << line;
+    }
+  }
+  os << nregressed << " regressed stage(s)\n";
+
+  printf("\n%s",os.str().c_str());
+  std::ofstream rs(reportpath);
+  if(rs) rs << os.str();
+  else printf("\033[31m-- cannot write report %s\033[0m\n",reportpath.c_str());
+
+  return nregressed>0 ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+#include "optimization.h"
+#include "capture.h"
+#include "roofline.h"
+#include "tictoc.h"
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+
+using namespace grid;
+
+/*
+  replay <capture> [--kernels gs_relax,update_residual,...] [--layers 0,2,3] [--reps 20] [--csv replay.csv]
+  Loads a solver state written by setCapture (batch key capture = <iter>) and times the chosen v-cycle kernels on it
+  in isolation, without the mesh and without running the optimization up to the captured iteration.
+  Kernels : gs_relax, update_residual, prolongate_correction (all but the coarsest layer), restrict_residual,
+  restrict_stencil (all but the finest), solve_coarsest (the coarsest) and v_cycle (the whole hierarchy, layer -1).
+  Every call is followed by a device synchronization and timed separately after two warm up calls. U / F / R of all
+  layers are restored after each kernel, so every kernel starts from the captured state.
+  The CSV has one line per (layer, kernel) and is appended to, so kernel variants can be compared on the same capture.
+*/
+
+static const std::vector<std::string> all_kernels={"gs_relax","update_residual","prolongate_correction","restrict_residual",
+                                                   "restrict_stencil","solve_coarsest","v_cycle"};
+
+struct Result {
+  std::string kernel;
+  int layer,nv,calls;
+  double mean,median,min;
+};
+
+static Result measure(const std::string& kernel,Grid* g,int reps,std::function<void(void)> fn) {
+  kernel_time_t kt=timeKernel(fn,reps);
+  Result r;
+  r.kernel=kernel;
+  r.layer=g ? g->_layer : -1;
+  r.nv=g ? g->n_vertices : 0;
+  r.calls=kt.calls;
+  r.min=kt.min;
+  r.median=kt.median;
+  r.mean=kt.mean;
+  return r;
+}
+
+// U / F / R of every layer on host
+struct FieldBackup {
+  std::vector<std::vector<double>> bufs;
+  std::vector<double*> dev;
+  std::vector<size_t> len;
+  FieldBackup(void) {
+    for(int i=0; i<grids.n_grid(); i++) {
+      Grid* g=grids[i];
+      if(g->is_dummy()) continue;
+      for(double** v : {g->getDisplacement(),g->getForce(),g->getResidual()}) {
+        for(int k=0; k<3; k++) {
+          bufs.emplace_back(g->n_gsvertices);
+          gpu_manager_t::download_buf(bufs.rbegin()->data(),v[k],sizeof(double)*g->n_gsvertices);
+          dev.push_back(v[k]);
+          len.push_back(g->n_gsvertices);
+        }
+      }
+    }
+  }
+  void restore(void) {
+    for(int i=0; i<bufs.size(); i++) gpu_manager_t::upload_buf(dev[i],bufs[i].data(),sizeof(double)*len[i]);
+  }
+};
+
+int main(int argc,char** argv) {
+  if(argc<2) {
+    printf("usage : replay <capture> [--kernels gs_relax,update_residual,...] [--layers 0,2,3] [--reps 20] [--csv replay.csv]\n");
+    return -1;
+  }
+  std::string capturepath=argv[1];
+  std::vector<std::string> kernels=all_kernels;
+  std::vector<int> layers;
+  int reps=20;
+  std::string csvpath="replay.csv";
+  for(int i=2; i+1<argc; i+=2) {
+    std::string key=argv[i],value=argv[i+1];
+    if(key=="--kernels") kernels=snippet::split(value,',');
+    else if(key=="--layers") {
+      for(const std::string& l : snippet::split(value,',')) layers.push_back(std::stoi(l));
+    } else if(key=="--reps") reps=std::max(1,std::stoi(value));
+    else if(key=="--csv") csvpath=value;
+    else {
+      printf("usage : replay <capture> [--kernels gs_relax,update_residual,...] [--layers 0,2,3] [--reps 20] [--csv replay.csv]\n");
+      return -1;
+    }
+  }
+  for(const std::string& k : kernels) {
+    if(std::find(all_kernels.begin(),all_kernels.end(),k)==all_kernels.end()) {
+      printf("\033[31m-- unknown kernel %s\033[0m\n",k.c_str());
+      return -1;
+    }
+  }
+
+  std::filesystem::create_directories("replay_out");
+  setOutpurDir("replay_out/");
+
+  int itn=0;
+  if(!readCapture(capturepath,&itn)) return -1;
+
+  bool newfile=!std::filesystem::exists(csvpath);
+  FILE* csv=fopen(csvpath.c_str(),"a");
+  if(!csv) {
+    printf("\033[31m-- cannot open %s\033[0m\n",csvpath.c_str());
+    return -1;
+  }
+  if(newfile) fprintf(csv,"capture,itn,layer,kernel,vertices,calls,mean_ms,median_ms,min_ms\n");
+
+  auto selected=[&](const std::string& k) { return std::find(kernels.begin(),kernels.end(),k)!=kernels.end(); };
+  auto layerSelected=[&](int l) { return layers.empty() || std::find(layers.begin(),layers.end(),l)!=layers.end(); };
+
+  FieldBackup backup;
+  std::vector<Result> results;
+  auto run=[&](const std::string& kernel,Grid* g,std::function<void(void)> fn) {
+    if(!selected(kernel)) return;
+    if(g) g->use_grid();
+    results.push_back(measure(kernel,g,reps,fn));
+    backup.restore();
+  };
+
+  int nlayer=grids.n_grid();
+  for(int i=0; i<nlayer; i++) {
+    Grid* g=grids[i];
+    if(g->is_dummy() || !layerSelected(i)) continue;
+    if(i<nlayer-1) {
+      run("gs_relax",g,[=]() { g->gs_relax(); });
+      run("update_residual",g,[=]() { g->update_residual(); });
+      run("prolongate_correction",g,[=]() { g->prolongate_correction(); });
+    }
+    if(i>0) {
+      run("restrict_residual",g,[=]() { g->restrict_residual(); });
+      run("restrict_stencil",g,[=]() { grids.restrict_stencil(*g,*g->fineGrid); });
+    }
+    if(i==nlayer-1) run("solve_coarsest",g,[=]() { g->solve_fem_host(); });
+  }
+  run("v_cycle",nullptr,[]() { grids.v_cycle(); });
+
+  printf("%-5s %-22s %10s %10s %10s %10s\n","layer","kernel","vertices","median(ms)","mean(ms)","min(ms)");
+  for(const Result& r : results) {
+    printf("%-5d %-22s %10d %10.3lf %10.3lf %10.3lf\n",r.layer,r.kernel.c_str(),r.nv,r.median,r.mean,r.min);
+    fprintf(csv,"%s,%d,%d,%s,%d,%d,%.4lf,%.4lf,%.4lf\n",capturepath.c_str(),itn,r.layer,r.kernel.c_str(),r.nv,r.calls,
+            r.mean,r.median,r.min);
+  }
+  fclose(csv);
+  return 0;
+}
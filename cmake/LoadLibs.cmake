@@ -33,3 +33,14 @@ IF(CGAL_FOUND)
 ELSE(CGAL_FOUND)
   MESSAGE(STATUS "Cannot find CGAL, 3D meshing not supported!")
 ENDIF(CGAL_FOUND)
+
+#ZLIB
+FIND_PACKAGE(ZLIB QUIET)
+IF(ZLIB_FOUND)
+  INCLUDE_DIRECTORIES(${ZLIB_INCLUDE_DIRS})
+  MESSAGE(STATUS "Found ZLIB @ ${ZLIB_INCLUDE_DIRS}")
+  LIST(APPEND ALL_LIBRARIES ${ZLIB_LIBRARIES})
+  ADD_DEFINITIONS(-DWITH_ZLIB)
+ELSE(ZLIB_FOUND)
+  MESSAGE(STATUS "Cannot find ZLIB, vtu compression not supported!")
+ENDIF(ZLIB_FOUND)